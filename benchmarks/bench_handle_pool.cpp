@@ -0,0 +1,119 @@
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+
+#include <libusb.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+/**
+ * Compares the per-call latency of reading the four port states of the first
+ * MEGA4 hub with a fresh libusb_open/libusb_close per call (previous behaviour)
+ * against Mega4Hub::getPortStates(), which reuses a pooled handle.
+ *
+ * Usage: bench_handle_pool [iterations]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static libusb_device* findFirstMega4(libusb_context* ctx)
+{
+    libusb_device** list = nullptr;
+    const ssize_t count = libusb_get_device_list(ctx, &list);
+    libusb_device* found = nullptr;
+
+    for (ssize_t i = 0; i < count && !found; ++i)
+    {
+        libusb_device_descriptor desc{};
+        if (libusb_get_device_descriptor(list[i], &desc) == 0 && desc.idVendor == 0x2109 &&
+            (desc.idProduct == 0x2817 || desc.idProduct == 0x0817))
+        {
+            found = libusb_ref_device(list[i]);
+        }
+    }
+
+    if (count >= 0) libusb_free_device_list(list, 1);
+    return found;
+}
+
+static bool readStatesWithFreshHandle(libusb_device* dev)
+{
+    libusb_device_handle* handle = nullptr;
+    if (libusb_open(dev, &handle) != 0)
+        return false;
+
+    for (int port = 1; port <= 4; ++port)
+    {
+        uint8_t status[4] = {0};
+        libusb_control_transfer(handle,
+                                LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER,
+                                LIBUSB_REQUEST_GET_STATUS, 0, port, status, sizeof(status), 1000);
+    }
+
+    libusb_close(handle);
+    return true;
+}
+
+template <typename Fn>
+static double averageMicroseconds(const int iterations, Fn&& fn)
+{
+    const auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i)
+        fn();
+    const auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start);
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? std::atoi(argv[1]) : 1000;
+    if (iterations <= 0)
+    {
+        std::cerr << "Iterations must be a positive number\n";
+        return 1;
+    }
+
+    libusb_context* ctx = nullptr;
+    if (libusb_init(&ctx) != 0)
+    {
+        std::cerr << "Failed to initialize libusb\n";
+        return 1;
+    }
+
+    libusb_device* dev = findFirstMega4(ctx);
+    if (!dev)
+    {
+        std::cout << "No MEGA4 hubs detected — nothing to benchmark.\n";
+        libusb_exit(ctx);
+        return 0;
+    }
+
+    try
+    {
+        if (!readStatesWithFreshHandle(dev))
+            throw std::runtime_error("Failed to open USB device");
+
+        const double fresh = averageMicroseconds(iterations, [dev] { readStatesWithFreshHandle(dev); });
+
+        UUGear::Mega4::Mega4Hub hub;
+        (void)hub.getPortStates(0); // warm up: opens the pooled handle
+        const double pooled = averageMicroseconds(iterations, [&hub] { (void)hub.getPortStates(0); });
+
+        std::cout << "getPortStates over " << iterations << " iterations\n";
+        std::cout << "  open/close per call : " << fresh << " us/call\n";
+        std::cout << "  pooled handle       : " << pooled << " us/call\n";
+        std::cout << "  speedup             : " << fresh / pooled << "x\n";
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << "\n";
+        libusb_unref_device(dev);
+        libusb_exit(ctx);
+        return 1;
+    }
+
+    libusb_unref_device(dev);
+    libusb_exit(ctx);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+#if defined(UUGEAR_PLUGIN_LINK_MODE_MODULE)
+#include "UUGear/Mega4/PluginManager.hpp"
+#elif defined(UUGEAR_HAS_STORAGE_PLUGIN)
+#include "UUGear/Mega4/plugins/StoragePlugin.hpp"
+#endif
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Google Benchmark suite for the hub and plugin hot paths.
+ *
+ * Runs against the first MEGA4 found, or against an in-process SimulatedMega4
+ * (with a storage device on port 1) when none is attached; the "mega4_backend"
+ * context entry of the report says which. Results are compared between releases
+ * from the JSON report:
+ *
+ *   mega4_bench --benchmark_out=mega4_bench.json --benchmark_out_format=json
+ *
+ * Environment:
+ *   MEGA4_BENCH_SIMULATE=1          use the simulator even if a MEGA4 is attached
+ *   MEGA4_BENCH_SIM_LATENCY_US=<n>  latency of every simulated request (default 0)
+ *   MEGA4_BENCH_PORT=<1-4>          port toggled by BM_PowerToggle (default 4); on hardware
+ *                                   the benchmark is skipped if a device is attached to it
+ */
+
+using UUGear::Mega4::Mega4Hub;
+using UUGear::Mega4::PortConnectionInfo;
+
+static int envInt(const char* name, const int fallback)
+{
+    const char* value = std::getenv(name);
+    return value && *value ? std::atoi(value) : fallback;
+}
+
+static PortConnectionInfo storageDevice(const int port)
+{
+    PortConnectionInfo info{};
+    info.portNumber = port;
+    info.hasDevice = true;
+    info.vid = 0x13fe;
+    info.pid = 0x4300;
+    info.manufacturer = "Wilk";
+    info.product = "USB DISK 3.0";
+    return info;
+}
+
+static bool simulated = false;
+
+static const Mega4Hub& hub()
+{
+    static const std::unique_ptr<Mega4Hub> instance = []
+    {
+        if (!envInt("MEGA4_BENCH_SIMULATE", 0))
+        {
+            try
+            {
+                auto real = std::make_unique<Mega4Hub>();
+                if (!real->listDevices().empty())
+                    return real;
+            }
+            catch (const std::runtime_error&)
+            {
+                // No usable libusb: fall back to the simulator
+            }
+        }
+
+        simulated = true;
+        auto sim = std::make_shared<UUGear::Mega4::SimulatedMega4>();
+        sim->setLatency(std::chrono::microseconds(envInt("MEGA4_BENCH_SIM_LATENCY_US", 0)));
+        sim->attachDevice(storageDevice(1));
+
+        UUGear::Mega4::Mega4HubOptions options;
+        options.simulatedHubs.push_back(sim);
+        return std::make_unique<Mega4Hub>(options);
+    }();
+    return *instance;
+}
+
+// ------------------------------------------------------------------
+// Hub
+// ------------------------------------------------------------------
+static void BM_ListDevices(benchmark::State& state)
+{
+    const Mega4Hub& h = hub();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(h.listDevices());
+}
+BENCHMARK(BM_ListDevices);
+
+static void BM_GetPortStates(benchmark::State& state)
+{
+    const Mega4Hub& h = hub();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(h.getPortStates(0, true));
+}
+BENCHMARK(BM_GetPortStates);
+
+static void BM_IsPortOn(benchmark::State& state)
+{
+    const Mega4Hub& h = hub();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(h.isPortOn(1, 0, true));
+}
+BENCHMARK(BM_IsPortOn);
+
+static void BM_GetPortConnections(benchmark::State& state)
+{
+    const Mega4Hub& h = hub();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(h.getPortConnections());
+}
+BENCHMARK(BM_GetPortConnections);
+
+static void BM_PowerToggle(benchmark::State& state)
+{
+    const Mega4Hub& h = hub();
+    const int port = envInt("MEGA4_BENCH_PORT", 4);
+    if (port < 1 || port > 4)
+    {
+        state.SkipWithError("MEGA4_BENCH_PORT must be 1-4");
+        return;
+    }
+    if (!simulated && h.getPortConnections()[port - 1].hasDevice)
+    {
+        state.SkipWithError("a device is attached to the benchmark port");
+        return;
+    }
+
+    // One iteration is an OFF/ON pair, each including the power settle wait
+    for (auto _ : state)
+    {
+        h.powerOff(port);
+        h.powerOn(port);
+    }
+}
+BENCHMARK(BM_PowerToggle)->Unit(benchmark::kMillisecond);
+
+// ------------------------------------------------------------------
+// Plugins
+// ------------------------------------------------------------------
+#if defined(UUGEAR_PLUGIN_LINK_MODE_MODULE)
+namespace fs = std::filesystem;
+
+/**
+ * @brief Directory holding n links to the bundled plugin, so PluginManager loads n instances.
+ */
+static fs::path pluginDirectory(const int n)
+{
+    const fs::path dir = fs::temp_directory_path() /
+        ("mega4_bench_plugins_" + std::to_string(::getpid()) + "_" + std::to_string(n));
+    if (fs::exists(dir))
+        return dir;
+
+    fs::path plugin;
+    for (const auto& entry : fs::directory_iterator(UUGEAR_BENCH_PLUGIN_DIR))
+    {
+        if (entry.path().extension() == ".so")
+        {
+            plugin = entry.path();
+            break;
+        }
+    }
+    if (plugin.empty())
+        return {};
+
+    fs::create_directories(dir);
+    for (int i = 0; i < n; ++i)
+        fs::create_symlink(plugin, dir / ("plugin" + std::to_string(i) + ".so"));
+    return dir;
+}
+
+static void BM_PluginLoadAll(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        UUGear::Mega4::PluginManager manager(UUGEAR_BENCH_PLUGIN_DIR);
+        manager.loadAll();
+        benchmark::DoNotOptimize(manager.pluginCount());
+    }
+}
+BENCHMARK(BM_PluginLoadAll)->Unit(benchmark::kMicrosecond);
+
+static void BM_HandlePortChange(benchmark::State& state)
+{
+    const fs::path dir = pluginDirectory(static_cast<int>(state.range(0)));
+    if (dir.empty())
+    {
+        state.SkipWithError("no plugin built in " UUGEAR_BENCH_PLUGIN_DIR);
+        return;
+    }
+
+    UUGear::Mega4::PluginManager manager(dir.string());
+    manager.loadAll();
+
+    // A device no plugin claims: measures the dispatch, not mounting
+    PortConnectionInfo keyboard{};
+    keyboard.portNumber = 2;
+    keyboard.hasDevice = true;
+    keyboard.product = "Keyboard";
+
+    for (auto _ : state)
+        manager.handlePortChange(keyboard, true);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+
+    fs::remove_all(dir);
+}
+BENCHMARK(BM_HandlePortChange)->RangeMultiplier(4)->Range(1, 64);
+
+#elif defined(UUGEAR_HAS_STORAGE_PLUGIN)
+static void BM_HandlePortChange(benchmark::State& state)
+{
+    // Without PluginManager (static/shared link mode): the same canHandle dispatch over n plugins
+    std::vector<std::unique_ptr<UUGear::Mega4::DevicePlugin>> plugins;
+    for (int64_t i = 0; i < state.range(0); ++i)
+        plugins.push_back(std::make_unique<UUGear::Mega4::StoragePlugin>());
+
+    PortConnectionInfo keyboard{};
+    keyboard.portNumber = 2;
+    keyboard.hasDevice = true;
+    keyboard.product = "Keyboard";
+
+    for (auto _ : state)
+    {
+        for (const auto& plugin : plugins)
+        {
+            if (plugin->canHandle(keyboard))
+                plugin->onDeviceConnected(keyboard);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HandlePortChange)->RangeMultiplier(4)->Range(1, 64);
+
+static void BM_StorageWriteRead(benchmark::State& state)
+{
+    UUGear::Mega4::StoragePlugin plugin;
+    const PortConnectionInfo device = storageDevice(1);
+    std::string mountPoint;
+    try
+    {
+        mountPoint = plugin.getMountPoint(device);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    if (mountPoint.empty())
+    {
+        state.SkipWithError("no storage mount point for port 1");
+        return;
+    }
+
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state)
+    {
+        if (!plugin.writeToFile(device, "mega4_bench.tmp", payload))
+        {
+            state.SkipWithError("write failed");
+            break;
+        }
+        benchmark::DoNotOptimize(plugin.readFromFile(device, "mega4_bench.tmp"));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+
+    std::error_code ignored;
+    std::filesystem::remove(std::filesystem::path(mountPoint) / "mega4_bench.tmp", ignored);
+}
+BENCHMARK(BM_StorageWriteRead)->Arg(4 << 10)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+#endif
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    hub();
+    benchmark::AddCustomContext("mega4_backend", simulated ? "simulated" : "hardware");
+#if defined(UUGEAR_PLUGIN_LINK_MODE_MODULE)
+    benchmark::AddCustomContext("mega4_plugin_link_mode", "MODULE");
+#else
+    benchmark::AddCustomContext("mega4_plugin_link_mode", "built-in");
+#endif
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
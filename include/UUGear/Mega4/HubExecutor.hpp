@@ -0,0 +1,165 @@
+#ifndef UUGEAR_MEGA4_LIB_HUBEXECUTOR_HPP
+#define UUGEAR_MEGA4_LIB_HUBEXECUTOR_HPP
+
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    template <typename T>
+    struct HubResult;
+    class HubExecutor;
+    class ThreadPool;
+}
+
+/**
+ * @brief Outcome of one operation on one hub of a HubExecutor fan-out.
+ */
+template <typename T>
+struct UUGear::Mega4::HubResult
+{
+    std::string hubPath; ///< busPortPath the operation was addressed to
+    int deviceIndex = -1; ///< Index the hub had when the operation ran, -1 if it was not found
+    T value{}; ///< Only meaningful when ok()
+    std::exception_ptr error; ///< What the operation threw, null on success
+
+    [[nodiscard]] bool ok() const { return !error; }
+};
+
+template <>
+struct UUGear::Mega4::HubResult<void>
+{
+    std::string hubPath; ///< busPortPath the operation was addressed to
+    int deviceIndex = -1; ///< Index the hub had when the operation ran, -1 if it was not found
+    std::exception_ptr error; ///< What the operation threw, null on success
+
+    [[nodiscard]] bool ok() const { return !error; }
+};
+
+/**
+ * @brief Runs one Mega4Hub operation on many hubs at once.
+ *
+ * Hubs are addressed by busPortPath, which stays the same across rescans,
+ * instead of by deviceIndex. Each hub's operation runs on a small thread pool,
+ * so the wall time of a fan-out is that of the slowest hub, not the sum of all.
+ * Results come back in the order the hubs were given, one per hub; a failure on
+ * one hub is reported in its result and does not affect the others.
+ *
+ * The path is resolved to an index right before each hub's operation runs, so
+ * hubs whose index moved in an earlier rescan are still addressed correctly.
+ */
+class UUGear::Mega4::HubExecutor
+{
+public:
+    static constexpr size_t DEFAULT_THREADS = 8;
+
+    /**
+     * @param hub Hub to run operations on; must outlive the executor.
+     * @param threads Number of hubs talked to at the same time.
+     */
+    explicit HubExecutor(const Mega4Hub& hub, size_t threads = DEFAULT_THREADS);
+
+    ~HubExecutor();
+
+    HubExecutor(const HubExecutor&) = delete;
+    HubExecutor& operator=(const HubExecutor&) = delete;
+
+    /**
+     * @brief Calls fn(hub, deviceIndex) for every hub and waits for all of them.
+     *
+     * fn runs concurrently on the pool threads and must not use the executor itself.
+     * @param hubPaths Hubs to address; empty means every hub found by the last scan.
+     * @return One result per hub, holding what fn returned or threw.
+     */
+    template <typename Fn>
+    auto forEach(Fn fn, const std::vector<std::string>& hubPaths = {}) const
+    {
+        using T = std::invoke_result_t<Fn&, const Mega4Hub&, int>;
+        const std::vector<std::string> paths = targets(hubPaths);
+        std::vector<HubResult<T>> results(paths.size());
+        dispatch(paths.size(), [&](const size_t slot)
+        {
+            HubResult<T>& result = results[slot];
+            result.hubPath = paths[slot];
+            try
+            {
+                // Resolving can fail too, e.g. once the daemon of a Mega4Client is gone
+                const int deviceIndex = hub_.deviceIndexOf(paths[slot]);
+                result.deviceIndex = deviceIndex;
+                if (deviceIndex < 0)
+                    throw std::out_of_range("No MEGA4 hub at " + paths[slot]);
+                if constexpr (std::is_void_v<T>)
+                    fn(hub_, deviceIndex);
+                else
+                    result.value = fn(hub_, deviceIndex);
+            }
+            catch (...)
+            {
+                result.error = std::current_exception();
+            }
+        });
+        return results;
+    }
+
+    /**
+     * @brief Mega4Hub::getPortStates() on every addressed hub.
+     */
+    [[nodiscard]] std::vector<HubResult<std::array<bool, 4>>> getPortStates(
+        const std::vector<std::string>& hubPaths = {}, bool forceHardwareRead = false) const;
+
+    /**
+     * @brief Mega4Hub::getPortStatus() on every addressed hub.
+     */
+    [[nodiscard]] std::vector<HubResult<std::array<PortStatus, 4>>> getPortStatus(
+        const std::vector<std::string>& hubPaths = {}) const;
+
+    /**
+     * @brief Mega4Hub::getPortConnections() on every addressed hub.
+     */
+    [[nodiscard]] std::vector<HubResult<std::vector<PortConnectionInfo>>> getPortConnections(
+        const std::vector<std::string>& hubPaths = {}) const;
+
+    /**
+     * @brief Turns the same port ON on every addressed hub.
+     */
+    std::vector<HubResult<void>> powerOn(int port, const std::vector<std::string>& hubPaths = {}) const;
+
+    /**
+     * @brief Turns the same port OFF on every addressed hub.
+     */
+    std::vector<HubResult<void>> powerOff(int port, const std::vector<std::string>& hubPaths = {}) const;
+
+    /**
+     * @brief Mega4Hub::applyPowerMask() with the same masks on every addressed hub.
+     */
+    std::vector<HubResult<void>> applyPowerMask(uint8_t onMask, uint8_t offMask,
+                                                const std::vector<std::string>& hubPaths = {}) const;
+
+private:
+    /**
+     * @brief Returns hubPaths, or the paths of all known hubs if it is empty.
+     */
+    [[nodiscard]] std::vector<std::string> targets(const std::vector<std::string>& hubPaths) const;
+
+    /**
+     * @brief Runs task(slot) for every slot below count on the pool and waits for all.
+     *        task must not throw.
+     */
+    void dispatch(size_t count, const std::function<void(size_t slot)>& task) const;
+
+    const Mega4Hub& hub_;
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_HUBEXECUTOR_HPP
@@ -0,0 +1,129 @@
+#ifndef UUGEAR_MEGA4_LIB_LOGGER_HPP
+#define UUGEAR_MEGA4_LIB_LOGGER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    enum class LogLevel;
+    struct LogRecord;
+    class Logger;
+}
+
+/**
+ * Lowest level compiled into the library and into code using the UUGEAR_MEGA4_LOG_*
+ * macros (0 = Trace … 4 = Error, 5 = nothing). Set with the UUGEAR_LOG_LEVEL CMake option.
+ */
+#ifndef UUGEAR_MEGA4_MIN_LOG_LEVEL
+#define UUGEAR_MEGA4_MIN_LOG_LEVEL 0
+#endif
+
+enum class UUGear::Mega4::LogLevel
+{
+    Trace = 0,
+    Debug = 1,
+    Info = 2,
+    Warning = 3,
+    Error = 4,
+    Off = 5
+};
+
+struct UUGear::Mega4::LogRecord
+{
+    LogLevel level = LogLevel::Info;
+    std::chrono::system_clock::time_point time;
+    std::string message;
+};
+
+/**
+ * @brief Process-wide asynchronous logger of the library and its plugins (see setSink()).
+ *
+ * log() formats nothing and never blocks: the record is put in a fixed-size
+ * lock-free ring and written by a background thread, so a slow stdout or
+ * journald pipe cannot stall the caller. When the ring is full the record is
+ * dropped and counted instead. The default sink writes warnings and errors to
+ * std::cerr and the rest to std::cout; pending records are written at exit.
+ */
+class UUGear::Mega4::Logger
+{
+public:
+    /**
+     * @brief Receives every record on the logger thread, in the order they were logged.
+     */
+    using Sink = std::function<void(const LogRecord& record)>;
+
+    static Logger& instance();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * @brief Replaces the sink; an empty sink restores the default one.
+     *
+     * Only this copy of the library is affected. A plugin built in MODULE link mode
+     * links the library statically, so it has a Logger instance of its own that
+     * keeps the default sink and level: its messages still go to std::cout and
+     * std::cerr. Build plugins in SHARED or STATIC mode to route them through this sink.
+     */
+    void setSink(Sink sink);
+
+    /**
+     * @brief Records below this level are discarded when logged (default Info).
+     */
+    void setLevel(LogLevel level) noexcept;
+
+    [[nodiscard]] bool enabled(LogLevel level) const noexcept;
+
+    /**
+     * @brief Queues a record for the sink. Wait-free; drops the record if the ring is full.
+     */
+    void log(LogLevel level, std::string message) noexcept;
+
+    /**
+     * @brief Blocks until every record queued before the call has reached the sink.
+     */
+    void flush();
+
+    /**
+     * @brief Number of records dropped because the ring was full.
+     */
+    [[nodiscard]] uint64_t dropped() const noexcept;
+
+private:
+    Logger();
+    ~Logger();
+
+    struct Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+/**
+ * Logs `expr` (anything that can be streamed into a std::ostream) at a level.
+ * The expression is only evaluated when the level is compiled in and enabled.
+ */
+#define UUGEAR_MEGA4_LOG(level, expr) \
+    do \
+    { \
+        if constexpr (static_cast<int>(level) >= UUGEAR_MEGA4_MIN_LOG_LEVEL) \
+        { \
+            ::UUGear::Mega4::Logger& uugearLogger_ = ::UUGear::Mega4::Logger::instance(); \
+            if (uugearLogger_.enabled(level)) \
+            { \
+                std::ostringstream uugearLogStream_; \
+                uugearLogStream_ << expr; \
+                uugearLogger_.log(level, uugearLogStream_.str()); \
+            } \
+        } \
+    } while (false)
+
+#define UUGEAR_MEGA4_LOG_DEBUG(expr) UUGEAR_MEGA4_LOG(::UUGear::Mega4::LogLevel::Debug, expr)
+#define UUGEAR_MEGA4_LOG_INFO(expr) UUGEAR_MEGA4_LOG(::UUGear::Mega4::LogLevel::Info, expr)
+#define UUGEAR_MEGA4_LOG_WARNING(expr) UUGEAR_MEGA4_LOG(::UUGear::Mega4::LogLevel::Warning, expr)
+#define UUGEAR_MEGA4_LOG_ERROR(expr) UUGEAR_MEGA4_LOG(::UUGear::Mega4::LogLevel::Error, expr)
+
+#endif //UUGEAR_MEGA4_LIB_LOGGER_HPP
@@ -0,0 +1,91 @@
+#ifndef UUGEAR_MEGA4_LIB_MEGA4CLIENT_HPP
+#define UUGEAR_MEGA4_LIB_MEGA4CLIENT_HPP
+
+#include "UUGear/Mega4/Mega4Hub.hpp"
+
+#include <memory>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    class Mega4Client;
+}
+
+/**
+ * @brief Mega4Hub served by a mega4d daemon (Mega4Server) instead of opened in-process.
+ *
+ * Every method is forwarded over the daemon's Unix domain socket, so it works
+ * wherever a Mega4Hub is expected (HubExecutor, PowerScheduler, plugins) while
+ * the daemon keeps the only libusb context, open handles and port state cache.
+ * Calls from any number of threads share one connection: their requests are
+ * pipelined and written together, and each call waits only for its own response.
+ * Asynchronous calls never block. Exceptions thrown by the daemon's hub are
+ * rethrown with the same type and message; a lost connection makes every pending
+ * and later call fail with std::runtime_error.
+ *
+ * Port event and port status callbacks run on the client's receive thread: they
+ * must not block, nor call blocking methods of the client.
+ */
+class UUGear::Mega4::Mega4Client : public Mega4Hub
+{
+public:
+    static constexpr const char* DEFAULT_SOCKET = "/run/mega4d.sock";
+
+    /**
+     * @brief Connects to the daemon.
+     * @throws std::runtime_error if nothing listens at socketPath.
+     */
+    explicit Mega4Client(const std::string& socketPath = DEFAULT_SOCKET);
+
+    /**
+     * @brief Disconnects; calls still pending fail with std::runtime_error.
+     */
+    ~Mega4Client() override;
+
+    [[nodiscard]] std::vector<DeviceInfo> listDevices() const override;
+    HubChanges rescanDevices() const override;
+    [[nodiscard]] std::vector<DeviceInfo> knownDevices() const override;
+    [[nodiscard]] int deviceIndexOf(const std::string& busPortPath) const override;
+
+    std::chrono::microseconds powerOn(int port, int deviceIndex = 0) const override;
+    std::chrono::microseconds powerOff(int port, int deviceIndex = 0) const override;
+    void applyPowerMask(uint8_t onMask, uint8_t offMask, int deviceIndex = 0) const override;
+    void applyPowerMasks(const std::vector<PortPowerMask>& masks) const override;
+
+    [[nodiscard]] std::array<bool, 4> getPortStates(int deviceIndex = 0,
+                                                    bool forceHardwareRead = false) const override;
+    [[nodiscard]] bool isPortOn(int port, int deviceIndex = 0, bool forceHardwareRead = false) const override;
+    [[nodiscard]] PortStateSnapshot getPortStateSnapshot(int deviceIndex = 0,
+                                                         bool forceHardwareRead = false) const override;
+    [[nodiscard]] std::array<PortStatus, 4> getPortStatus(int deviceIndex = 0) const override;
+
+    using Mega4Hub::powerOnAsync;
+    using Mega4Hub::powerOffAsync;
+    using Mega4Hub::getPortStatesAsync;
+    void powerOnAsync(int port, int deviceIndex, PowerCallback done) const override;
+    void powerOffAsync(int port, int deviceIndex, PowerCallback done) const override;
+    void getPortStatesAsync(int deviceIndex, PortStatesCallback done) const override;
+
+    [[nodiscard]] std::future<void> powerCycle(int port, std::chrono::milliseconds offTime,
+                                               int deviceIndex = 0) const override;
+    [[nodiscard]] std::future<void> powerCycle(const std::vector<PortPowerCycle>& cycles) const override;
+    void powerCycle(const std::vector<PortPowerCycle>& cycles, PowerCallback done) const override;
+
+    [[nodiscard]] std::vector<PortConnectionInfo> getPortConnections(int deviceIndex = 0) const override;
+
+    int subscribePortEvents(PortEventCallback callback) const override;
+    void unsubscribePortEvents(int subscriptionId) const override;
+    int subscribePortStatus(PortStatusCallback callback) const override;
+    void unsubscribePortStatus(int subscriptionId) const override;
+
+    /**
+     * @brief Metrics of the daemon's hub, which sees the requests of every client.
+     */
+    [[nodiscard]] MetricsSnapshot metrics() const override;
+
+private:
+    struct Connection;
+    std::unique_ptr<Connection> connection_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_MEGA4CLIENT_HPP
@@ -3,71 +3,321 @@
 
 #include <vector>
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <string>
 
 namespace UUGear::Mega4
 {
     class Mega4Hub;
     struct DeviceInfo;
+    struct HubChanges;
     struct PortConnectionInfo;
+    struct PortStatus;
+    struct PortPowerMask;
+    struct PortPowerCycle;
+    struct PortEvent;
+    struct PortStatusChange;
+    struct PortStateSnapshot;
+    struct Mega4HubOptions;
+    struct MetricsSnapshot;
 }
 
 /**
  * @brief C++ interface for controlling the UUGear MEGA4 USB hub.
  *        It uses libusb to perform standard USB Hub Class requests.
+ *
+ * All methods may be called concurrently from any number of threads. Power
+ * requests to the same hub are serialized by a lock of that hub, held only
+ * while the requests are sent (not during the settle wait). State reads take
+ * no hub lock and look hubs up in an immutable registry snapshot, so they never
+ * wait for a power request or a rescan.
  */
 class UUGear::Mega4::Mega4Hub
 {
 public:
+    /**
+     * @brief Completion callback of an asynchronous power request.
+     *        error is null on success.
+     */
+    using PowerCallback = std::function<void(const std::exception_ptr& error)>;
+
+    /**
+     * @brief Completion callback of an asynchronous port state query.
+     *        states is only meaningful when error is null.
+     */
+    using PortStatesCallback = std::function<void(const std::array<bool, 4>& states,
+                                                  const std::exception_ptr& error)>;
+
+    /**
+     * @brief Callback receiving device connect/disconnect events on MEGA4 ports.
+     */
+    using PortEventCallback = std::function<void(const PortEvent& event)>;
+
+    /**
+     * @brief Callback receiving the status of a port after it changed.
+     */
+    using PortStatusCallback = std::function<void(const PortStatusChange& change)>;
+
     /**
      * @brief Initializes libusb. Does not open any device yet.
      * @throws std::runtime_error if libusb initialization fails.
      */
     Mega4Hub();
 
+    /**
+     * @brief Initializes libusb with the given options. Does not open any device yet.
+     * @throws std::runtime_error if libusb initialization fails.
+     */
+    explicit Mega4Hub(const Mega4HubOptions& options);
+
     /**
      * @brief Frees all resources used by libusb.
      */
-    ~Mega4Hub();
+    virtual ~Mega4Hub();
+
+    Mega4Hub(const Mega4Hub&) = delete;
+    Mega4Hub& operator=(const Mega4Hub&) = delete;
 
     /**
      * @brief Scans the USB bus for VIA Labs VL817 hubs (used in MEGA4).
+     *
+     * Hubs are kept in a registry keyed by bus/port path and ordered by it; the
+     * position in the returned list is the deviceIndex expected by the other methods.
+     * Each scan only adds new hubs and drops the ones that left, so it can be
+     * called periodically.
      * @return A list of detected hubs.
      */
     [[nodiscard]] virtual std::vector<DeviceInfo> listDevices() const;
 
+    /**
+     * @brief Scans the USB bus like listDevices() and reports what changed.
+     *        Hub indices after the scan follow listDevices() order.
+     * @return The hubs added and removed since the previous scan.
+     */
+    virtual HubChanges rescanDevices() const;
+
+    /**
+     * @brief Returns the hubs found by the last scan, in deviceIndex order, without scanning.
+     */
+    [[nodiscard]] virtual std::vector<DeviceInfo> knownDevices() const;
+
+    /**
+     * @brief Returns the current deviceIndex of the hub at a bus/port path
+     *        (DeviceInfo::busPortPath), or -1 if no hub is known there.
+     */
+    [[nodiscard]] virtual int deviceIndexOf(const std::string& busPortPath) const;
+
     /**
      * @brief Turns a port ON.
+     *
+     * Waits a fixed settle time after the request, or with
+     * Mega4HubOptions::powerConfirmTimeout set, until the port reports it is powered.
      * @param port Port number (1–4).
      * @param deviceIndex Index of the detected hub (default = 0).
+     * @return Time from the request until the port was seen switched (or the settle time ended).
+     * @throws std::runtime_error if the request fails or the port does not switch in time.
      */
-    virtual void powerOn(int port, int deviceIndex = 0) const;
+    virtual std::chrono::microseconds powerOn(int port, int deviceIndex = 0) const;
 
     /**
-     * @brief Turns a port OFF.
+     * @brief Turns a port OFF. Waits for the switch like powerOn().
      * @param port Port number (1–4).
      * @param deviceIndex Index of the detected hub (default = 0).
+     * @return Time from the request until the port was seen switched (or the settle time ended).
      */
-    virtual void powerOff(int port, int deviceIndex = 0) const;
+    virtual std::chrono::microseconds powerOff(int port, int deviceIndex = 0) const;
 
     /**
-     * @brief Queries the actual ON/OFF power state for all four ports
-     *        of a specific MEGA4 hub by reading from hardware.
+     * @brief Turns several ports of one hub ON/OFF at once, waiting for the
+     *        power switches to settle only once.
+     * @param onMask Ports to turn ON (bit 0 = port 1 … bit 3 = port 4).
+     * @param offMask Ports to turn OFF (same layout).
      * @param deviceIndex Index of the detected hub (default = 0).
+     * @throws std::out_of_range, std::invalid_argument or std::runtime_error on failure.
+     */
+    virtual void applyPowerMask(uint8_t onMask, uint8_t offMask, int deviceIndex = 0) const;
+
+    /**
+     * @brief Applies power masks across one or more hubs in one operation.
+     *        All requests are validated first, then sent back to back, and the
+     *        switches are waited for once for the whole batch (see powerOn()).
+     * @param masks One entry per hub to change.
+     * @throws std::out_of_range or std::invalid_argument if any entry is invalid (nothing is sent).
+     * @throws std::runtime_error if any request failed (the others are still applied).
+     */
+    virtual void applyPowerMasks(const std::vector<PortPowerMask>& masks) const;
+
+    /**
+     * @brief Queries the ON/OFF power state for all four ports of a specific MEGA4 hub.
+     *        The hardware is read unless Mega4HubOptions::stateCacheTtl is set and the
+     *        hub's snapshot is younger than it.
+     * @param deviceIndex Index of the detected hub (default = 0).
+     * @param forceHardwareRead Read the hardware even if the snapshot is fresh.
      * @return Array<bool,4> with true = ON, false = OFF.
+     * @throws std::out_of_range or std::runtime_error on failure, including a port that
+     *         could not be read (the snapshot is then left as it was).
+     */
+    [[nodiscard]] virtual std::array<bool, 4> getPortStates(int deviceIndex = 0, bool forceHardwareRead = false) const;
+
+    /**
+     * @brief Same as getPortStates() for a single port.
+     */
+    [[nodiscard]] virtual bool isPortOn(int port, int deviceIndex = 0, bool forceHardwareRead = false) const;
+
+    /**
+     * @brief Returns the port state snapshot of a hub with its generation and age,
+     *        refreshing it under the same rules as getPortStates().
+     */
+    [[nodiscard]] virtual PortStateSnapshot getPortStateSnapshot(int deviceIndex = 0,
+                                                                 bool forceHardwareRead = false) const;
+
+    /**
+     * @brief Reads and decodes the full status of all four ports of a hub in one pass:
+     *        power, connection, enable, suspend, over-current, reset, speed and change bits.
+     *        Always reads the hardware; the power bits also refresh the state snapshot.
+     * @param deviceIndex Index of the detected hub (default = 0).
+     * @return One entry per port; entries that could not be read have valid = false.
      * @throws std::out_of_range or std::runtime_error on failure.
      */
-    [[nodiscard]] virtual std::array<bool, 4> getPortStates(int deviceIndex = 0) const;
+    [[nodiscard]] virtual std::array<PortStatus, 4> getPortStatus(int deviceIndex = 0) const;
+
+    /**
+     * @brief Asynchronous variants of powerOn()/powerOff()/getPortStates().
+     *
+     * They submit the control transfers and return immediately; the transfers are
+     * completed by a single libusb event thread owned by the hub, started on first use,
+     * so many requests can be in flight across all hubs at once.
+     * Power requests complete when the hub acknowledges them; unlike powerOn()/powerOff()
+     * they do not wait for the power switch to settle.
+     *
+     * Callbacks run on the event thread and must not block or call synchronous
+     * Mega4Hub methods. If a request cannot be submitted at all, the callback is
+     * invoked on the calling thread before the method returns.
+     *
+     * @throws std::out_of_range immediately for an invalid port or hub index.
+     */
+    [[nodiscard]] virtual std::future<void> powerOnAsync(int port, int deviceIndex = 0) const;
+
+    [[nodiscard]] virtual std::future<void> powerOffAsync(int port, int deviceIndex = 0) const;
+
+    [[nodiscard]] virtual std::future<std::array<bool, 4>> getPortStatesAsync(int deviceIndex = 0) const;
+
+    virtual void powerOnAsync(int port, int deviceIndex, PowerCallback done) const;
+
+    virtual void powerOffAsync(int port, int deviceIndex, PowerCallback done) const;
+
+    virtual void getPortStatesAsync(int deviceIndex, PortStatesCallback done) const;
+
+    /**
+     * @brief Turns a port OFF and back ON after offTime without blocking the caller.
+     *
+     * The requests are sent asynchronously and the off-time is a timer on the hub's
+     * power scheduler thread (see PowerScheduler), started on first use, so any
+     * number of cycles can run at once. The port is turned ON again even if turning
+     * it OFF failed. Cycles still running when the hub is destroyed are cancelled,
+     * which can leave their port OFF.
+     *
+     * @return Future that becomes ready when the port is back ON, or holds a
+     *         std::runtime_error if a request failed or the cycle was cancelled.
+     * @throws std::out_of_range immediately for an invalid port or hub index.
+     */
+    [[nodiscard]] virtual std::future<void> powerCycle(int port, std::chrono::milliseconds offTime,
+                                                       int deviceIndex = 0) const;
 
-    [[nodiscard]] virtual bool isPortOn(int port, int deviceIndex = 0) const;
+    /**
+     * @brief Power cycles many ports at once, each with its own off-time.
+     * @return Future that becomes ready when every port is back ON; on failure it
+     *         holds a std::runtime_error naming the ports that failed.
+     * @throws std::out_of_range immediately if any entry is invalid (nothing is sent).
+     */
+    [[nodiscard]] virtual std::future<void> powerCycle(const std::vector<PortPowerCycle>& cycles) const;
+
+    /**
+     * @brief Same as powerCycle(cycles), reporting to done instead of a future.
+     *        done must not block; it runs on the thread completing the last cycle,
+     *        or on the calling thread if there is nothing to cycle.
+     */
+    virtual void powerCycle(const std::vector<PortPowerCycle>& cycles, PowerCallback done) const;
 
     /**
  * @brief Lists all devices connected to each of the 4 downstream ports
  *        of a MEGA4 hub.
+ *
+ * Devices are looked up in a topology index instead of scanning the bus. The first
+ * call starts the hotplug monitor (see subscribePortEvents()) which keeps the index
+ * current; where hotplug is not supported, the index is rebuilt on every call.
+ * Manufacturer/product strings are read once per connected device and cached
+ * until it disconnects, so repeated listings do not open the devices again.
  * @param deviceIndex Index of the detected hub (default = 0)
  * @return Vector of 4 entries, one per port.
  */
     [[nodiscard]] virtual std::vector<PortConnectionInfo> getPortConnections(int deviceIndex = 0) const;
 
+    /**
+     * @brief Subscribes to device connect/disconnect events on the ports of the detected hubs.
+     *
+     * The first subscription starts a libusb hotplug monitor, so changes are reported
+     * within milliseconds without polling getPortConnections(). Devices already present
+     * at that moment produce no connect event, but their removal is reported.
+     * Callbacks run on the monitor's dispatch thread, one event at a time.
+     *
+     * @return Id to pass to unsubscribePortEvents().
+     * @throws std::runtime_error if libusb hotplug is not supported on this platform.
+     */
+    virtual int subscribePortEvents(PortEventCallback callback) const;
+
+    /**
+     * @brief Removes a subscription created by subscribePortEvents().
+     *        Waits for callbacks already running, so once this returns the callback is not
+     *        called any more and what it uses may be destroyed. Called from a callback, it
+     *        does not wait, as the calling callback could not end before it returns.
+     */
+    virtual void unsubscribePortEvents(int subscriptionId) const;
+
+    /**
+     * @brief Subscribes to port status changes, read only for the port that changed.
+     *
+     * The first subscription keeps an interrupt transfer pending on each hub's
+     * status-change endpoint and issues GET_STATUS only for ports whose change bit
+     * is set, so no polling traffic is generated. When the kernel hub driver owns
+     * that endpoint (the usual case on Linux), a port is re-read instead when a
+     * device is plugged/unplugged on it or when this hub switches its power, as it
+     * is for a hub that cannot be opened a second time.
+     * Callbacks run on the libusb event thread and must not block.
+     *
+     * @return Id to pass to unsubscribePortStatus().
+     */
+    virtual int subscribePortStatus(PortStatusCallback callback) const;
+
+    /**
+     * @brief Removes a subscription created by subscribePortStatus().
+     *        Waits for callbacks already running, so once this returns the callback is not
+     *        called any more and what it uses may be destroyed. Called from a callback, it
+     *        does not wait, as the calling callback could not end before it returns.
+     */
+    virtual void unsubscribePortStatus(int subscriptionId) const;
+
+    /**
+     * @brief Returns the transfer counters and the latency histogram of every
+     *        operation since the hub was created (see MetricsSnapshot::toPrometheus()).
+     */
+    [[nodiscard]] virtual MetricsSnapshot metrics() const;
+
+protected:
+    struct NoBackend
+    {
+    };
+
+    /**
+     * @brief For subclasses that implement every method themselves (see Mega4Client):
+     *        neither libusb nor any other backend is set up.
+     */
+    explicit Mega4Hub(NoBackend);
+
 private:
     struct Impl;
     Impl* pImpl; ///< PIMPL pattern to hide implementation details.
@@ -0,0 +1,60 @@
+#ifndef UUGEAR_MEGA4_LIB_MEGA4SERVER_HPP
+#define UUGEAR_MEGA4_LIB_MEGA4SERVER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    class Mega4Hub;
+    class Mega4Server;
+}
+
+/**
+ * @brief Serves a Mega4Hub to Mega4Client instances over a Unix domain socket.
+ *
+ * This is the core of the mega4d daemon: one process owns the libusb context,
+ * the open handles and the port state cache, and every other process talks to
+ * it instead of opening the hubs itself. Requests of one connection may be
+ * pipelined; blocking ones run on a pool of worker threads, asynchronous power
+ * requests, state queries and power cycles use the hub's asynchronous API and
+ * take no worker, so responses come back as soon as each is done. Port events
+ * and port status changes are pushed to the clients that subscribed to them.
+ *
+ * Each client has a writer thread of its own; responses and pushes are queued for
+ * it, so a client that stops reading holds up nobody else. Once more than
+ * MAX_PENDING_BYTES are queued for it, the client is disconnected.
+ */
+class UUGear::Mega4::Mega4Server
+{
+public:
+    static constexpr size_t DEFAULT_WORKERS = 8;
+    static constexpr size_t MAX_PENDING_BYTES = 4u << 20;
+
+    /**
+     * @brief Binds the socket (replacing a stale socket file) and starts accepting clients.
+     * @param hub Hub to serve; must outlive the server. Give it a stateCacheTtl so that
+     *        state queries are answered from the cache.
+     * @param socketPath Filesystem path of the socket.
+     * @param workers Blocking requests served at the same time.
+     * @throws std::runtime_error if the socket cannot be created.
+     */
+    Mega4Server(const Mega4Hub& hub, std::string socketPath, size_t workers = DEFAULT_WORKERS);
+
+    /**
+     * @brief Disconnects every client, waits for the requests in progress and removes the socket file.
+     */
+    ~Mega4Server();
+
+    Mega4Server(const Mega4Server&) = delete;
+    Mega4Server& operator=(const Mega4Server&) = delete;
+
+    [[nodiscard]] const std::string& socketPath() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+#endif //UUGEAR_MEGA4_LIB_MEGA4SERVER_HPP
@@ -3,11 +3,25 @@
 
 #include <string>
 #include <cstdint>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
 
 namespace UUGear::Mega4
 {
     struct DeviceInfo;
+    struct HubChanges;
     struct PortConnectionInfo;
+    enum class PortSpeed;
+    struct PortStatus;
+    struct PortPowerMask;
+    struct PortPowerCycle;
+    struct PortEvent;
+    struct PortStatusChange;
+    struct PortStateSnapshot;
+    struct Mega4HubOptions;
+    class SimulatedMega4;
 }
 
 struct UUGear::Mega4::DeviceInfo
@@ -18,14 +32,176 @@ struct UUGear::Mega4::DeviceInfo
     std::string description; ///< Human-readable description
 };
 
+/**
+ * @brief Hubs that appeared or disappeared since the previous scan.
+ */
+struct UUGear::Mega4::HubChanges
+{
+    std::vector<DeviceInfo> added; ///< New hubs (including hubs replugged at a known path)
+    std::vector<DeviceInfo> removed; ///< Hubs no longer on the bus
+};
+
 struct UUGear::Mega4::PortConnectionInfo
 {
     int portNumber; ///< 1–4 for MEGA4
     bool hasDevice; ///< True if a device is connected
     uint16_t vid = 0; ///< Vendor ID (if any)
     uint16_t pid = 0; ///< Product ID (if any)
+    uint8_t deviceClass = 0; ///< bDeviceClass, or bInterfaceClass of the first interface when that is 0 (0 = unknown)
     std::string manufacturer; ///< Optional string from descriptor
     std::string product; ///< Optional string from descriptor
 };
 
+/**
+ * @brief Speed of the device attached to a port, as reported by the hub.
+ */
+enum class UUGear::Mega4::PortSpeed
+{
+    Unknown, ///< Nothing connected or not reported
+    Low, ///< 1.5 Mbit/s
+    Full, ///< 12 Mbit/s
+    High, ///< 480 Mbit/s
+    Super ///< 5 Gbit/s (USB3 hub)
+};
+
+/**
+ * @brief Decoded GET_STATUS response of one port (USB 2.0 spec 11.24.2.7,
+ *        USB 3.x spec 10.16.2.6 for the USB3 hub of the MEGA4).
+ */
+struct UUGear::Mega4::PortStatus
+{
+    int portNumber = 0; ///< 1–4 for MEGA4
+    bool valid = false; ///< False if the port could not be read; all other fields are then zero
+    uint16_t wPortStatus = 0; ///< Raw port status word
+    uint16_t wPortChange = 0; ///< Raw port change word
+
+    bool connected = false; ///< PORT_CONNECTION: a device is present
+    bool enabled = false; ///< PORT_ENABLE
+    bool suspended = false; ///< PORT_SUSPEND (USB2), link in U3 (USB3)
+    bool overCurrent = false; ///< PORT_OVER_CURRENT
+    bool reset = false; ///< PORT_RESET: reset signalling in progress
+    bool powered = false; ///< PORT_POWER
+    PortSpeed speed = PortSpeed::Unknown; ///< Speed of the connected device
+    uint8_t linkState = 0; ///< PORT_LINK_STATE (USB3 hub only, 0 = U0)
+
+    bool connectionChanged = false; ///< C_PORT_CONNECTION
+    bool enableChanged = false; ///< C_PORT_ENABLE (USB2 hub only)
+    bool suspendChanged = false; ///< C_PORT_SUSPEND (USB2 hub only)
+    bool overCurrentChanged = false; ///< C_PORT_OVER_CURRENT
+    bool resetChanged = false; ///< C_PORT_RESET
+    bool linkStateChanged = false; ///< C_PORT_LINK_STATE (USB3 hub only)
+};
+
+/**
+ * @brief Power changes to apply to one MEGA4 hub in a single batch.
+ *        Bit n-1 of each mask selects port n (e.g. 0x05 = ports 1 and 3).
+ */
+struct UUGear::Mega4::PortPowerMask
+{
+    int deviceIndex = 0; ///< Index of the detected hub
+    uint8_t on = 0; ///< Ports to turn ON
+    uint8_t off = 0; ///< Ports to turn OFF
+};
+
+/**
+ * @brief A port to turn OFF and back ON after offTime.
+ */
+struct UUGear::Mega4::PortPowerCycle
+{
+    int deviceIndex = 0; ///< Index of the detected hub
+    int port = 1; ///< Port number (1–4)
+    std::chrono::milliseconds offTime{1000}; ///< How long the port stays OFF
+};
+
+/**
+ * @brief A device was connected to or disconnected from a MEGA4 downstream port.
+ */
+struct UUGear::Mega4::PortEvent
+{
+    int deviceIndex = -1; ///< Index of the hub the port belongs to
+    std::string hubPath; ///< busPortPath of that hub
+    PortConnectionInfo port{}; ///< Device on the port (as seen when it was connected)
+    bool connected = false; ///< True on connect, false on disconnect
+};
+
+/**
+ * @brief Port status read after the hub signalled a change on that port.
+ */
+struct UUGear::Mega4::PortStatusChange
+{
+    int deviceIndex = -1; ///< Index of the hub the port belongs to
+    int portNumber = 0; ///< 1–4 for MEGA4
+    bool powered = false; ///< PORT_POWER bit of wPortStatus
+    uint16_t wPortStatus = 0; ///< Raw port status word
+    uint16_t wPortChange = 0; ///< Raw port change word
+    PortStatus status{}; ///< Fully decoded status and change bits
+};
+
+/**
+ * @brief Last known ON/OFF state of the ports of one hub.
+ */
+struct UUGear::Mega4::PortStateSnapshot
+{
+    std::array<bool, 4> states{false, false, false, false}; ///< true = ON, one entry per port
+    uint64_t generation = 0; ///< Incremented every time the snapshot changes
+    std::chrono::steady_clock::time_point timestamp{}; ///< Time of the last full hardware read
+    bool valid = false; ///< False until the hub has been read once
+};
+
+/**
+ * @brief Construction-time settings of a Mega4Hub.
+ */
+struct UUGear::Mega4::Mega4HubOptions
+{
+    /**
+     * How long a port state snapshot may serve getPortStates()/isPortOn() before
+     * the hardware is read again. Zero (default) always reads the hardware.
+     * Successful power requests issued through the hub keep the snapshot up to date.
+     */
+    std::chrono::milliseconds stateCacheTtl{0};
+
+    /**
+     * Longest a power request waits for the port to actually switch. Zero (default)
+     * waits a fixed 50 ms settle time instead. Otherwise the port's PORT_POWER bit is
+     * polled, at growing intervals (0.25 ms up to 16 ms), until it shows the requested
+     * state, and the request fails with std::runtime_error if it does not in time.
+     */
+    std::chrono::milliseconds powerConfirmTimeout{0};
+
+    /**
+     * Root of the Linux USB sysfs tree ("/sys/bus/usb/devices") to list hubs, read
+     * port power and connections, and switch port power through, without opening
+     * usbfs. Empty (default) uses libusb only. Any request sysfs cannot serve (path
+     * missing, attribute not writable) falls back to libusb.
+     */
+    std::string sysfsRoot;
+
+    /**
+     * In-process hub models to drive instead of real hardware. When non-empty,
+     * libusb is not used at all: these are the only hubs listed, and port event
+     * subscriptions are not available (port status subscriptions are).
+     */
+    std::vector<std::shared_ptr<SimulatedMega4>> simulatedHubs;
+
+    /**
+     * File to capture every hub enumeration and control transfer to (setup packet,
+     * data, result and timing), in a compact binary format. Empty (default) captures
+     * nothing. Hubs listed through sysfs are not captured.
+     */
+    std::string captureFile;
+
+    /**
+     * Capture to answer enumerations and control transfers from instead of the USB
+     * bus. Requests are matched by hub and setup packet; those the capture has no
+     * answer for fail. Takes precedence over simulatedHubs.
+     */
+    std::string replayFile;
+
+    /**
+     * Whether replayed answers take as long as they did when captured (default)
+     * or come back immediately.
+     */
+    bool replayWithTiming = true;
+};
+
 #endif //UUGEAR_MEGA4_LIB_MEGA4TYPES_HPP
@@ -0,0 +1,132 @@
+#ifndef UUGEAR_MEGA4_LIB_METRICS_HPP
+#define UUGEAR_MEGA4_LIB_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class LatencyHistogram;
+    struct LatencySnapshot;
+    struct MetricsSnapshot;
+}
+
+/**
+ * @brief Copy of a LatencyHistogram at one point in time.
+ */
+struct UUGear::Mega4::LatencySnapshot
+{
+    static constexpr size_t BUCKET_COUNT = 40;
+
+    std::string operation; ///< Hub operation, or plugin callback name
+    std::string plugin; ///< Plugin name for plugin callbacks, empty for hub operations
+
+    /**
+     * Bucket i counts durations below 2^i ns that did not fit bucket i - 1;
+     * the last bucket also holds everything longer (about 9 minutes and up).
+     */
+    std::array<uint64_t, BUCKET_COUNT> buckets{};
+    uint64_t count = 0; ///< Number of recorded durations
+    uint64_t sumNanoseconds = 0; ///< Sum of the recorded durations
+    uint64_t failures = 0; ///< Recordings that ended with an exception
+};
+
+/**
+ * @brief Log-bucketed (powers of two nanoseconds) latency histogram.
+ *
+ * Recording is wait-free: two relaxed atomic additions, no locks and no
+ * allocation, so it can be left on in the hot paths.
+ */
+class UUGear::Mega4::LatencyHistogram
+{
+public:
+    /**
+     * @brief Measures a scope and records it on exit; a scope left by an
+     *        exception is also counted as a failure.
+     */
+    class Timer
+    {
+    public:
+        explicit Timer(LatencyHistogram& histogram) noexcept
+            : histogram_(histogram), exceptions_(std::uncaught_exceptions()),
+              start_(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Timer()
+        {
+            histogram_.record(std::chrono::steady_clock::now() - start_,
+                              std::uncaught_exceptions() > exceptions_);
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        LatencyHistogram& histogram_;
+        int exceptions_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    void record(const std::chrono::nanoseconds elapsed, const bool failed = false) noexcept
+    {
+        const auto ns = static_cast<uint64_t>(elapsed.count() > 0 ? elapsed.count() : 0);
+        buckets_[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        sumNanoseconds_.fetch_add(ns, std::memory_order_relaxed);
+        if (failed)
+            failures_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the bucket of a duration: the number of significant bits of ns.
+     */
+    static size_t bucketFor(const uint64_t ns) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        const size_t bits = ns ? 64 - static_cast<size_t>(__builtin_clzll(ns)) : 0;
+#else
+        size_t bits = 0;
+        for (uint64_t v = ns; v; v >>= 1)
+            ++bits;
+#endif
+        return bits < LatencySnapshot::BUCKET_COUNT ? bits : LatencySnapshot::BUCKET_COUNT - 1;
+    }
+
+    /**
+     * @brief Copies the counts. Concurrent recordings may be partially included.
+     */
+    [[nodiscard]] LatencySnapshot snapshot(std::string operation, std::string plugin = {}) const;
+
+private:
+    std::array<std::atomic<uint64_t>, LatencySnapshot::BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> sumNanoseconds_{0};
+    std::atomic<uint64_t> failures_{0};
+};
+
+/**
+ * @brief Counters and latency histograms of a Mega4Hub or PluginManager.
+ */
+struct UUGear::Mega4::MetricsSnapshot
+{
+    uint64_t transfers = 0; ///< Control transfers sent to hubs (synchronous and asynchronous)
+    uint64_t transferErrors = 0; ///< Transfers that failed, timeouts included
+    uint64_t timeouts = 0; ///< Transfers that failed with LIBUSB_ERROR_TIMEOUT
+    uint64_t retries = 0; ///< Transfers retried after the hub had to be reopened
+
+    std::vector<LatencySnapshot> operations; ///< One per hub operation
+    std::vector<LatencySnapshot> pluginCallbacks; ///< One per plugin and callback
+
+    /**
+     * @brief Renders the snapshot in the Prometheus text exposition format
+     *        (counters as mega4_*_total, histograms in seconds).
+     */
+    [[nodiscard]] std::string toPrometheus() const;
+};
+
+#endif //UUGEAR_MEGA4_LIB_METRICS_HPP
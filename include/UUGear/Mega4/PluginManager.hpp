@@ -6,18 +6,37 @@
 #else
 
 #include "UUGear/Mega4/DevicePlugin.hpp"
+#include "UUGear/Mega4/Metrics.hpp"
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <optional>
 
 namespace UUGear::Mega4
 {
     class PluginManager;
+    class Mega4Hub;
     struct PortConnectionInfo;
 }
 
 /**
  * @brief Loads and manages dynamically linked plugins (.so/.dll) at runtime.
+ *
+ * A plugin may ship a manifest next to it, with the same name and the
+ * .manifest extension (StoragePlugin.so -> StoragePlugin.manifest):
+ *
+ *     # Lines starting with '#' are comments
+ *     name = StoragePlugin
+ *     match = class:08
+ *     match = vid:0781 pid:5581
+ *
+ * Each match line is a rule whose vid/pid/class fields (hexadecimal) must all
+ * equal those of the device; the plugin matches a device when any rule does.
+ * A plugin with a valid manifest is only indexed by loadAll() and is dlopen()ed
+ * when handlePortChange() first sees a matching device connect. Plugins without
+ * a manifest, or with one that cannot be parsed, are loaded right away.
  */
 class UUGear::Mega4::PluginManager
 {
@@ -26,17 +45,33 @@ public:
     ~PluginManager();
 
     /**
-    * @brief Loads all plugins from the specified directory.
+    * @brief Loads all plugins from the specified directory, and indexes those with a manifest.
     */
     void loadAll();
 
     /**
      * @brief Notifies all loaded plugins about a port connection change.
+     *        On connect, first loads the indexed plugins whose manifest matches the device.
+     *        Plugin callbacks run without the manager locked and may call back into it.
      * @param info Information about the port connection change.
      * @param connected True if a device was connected, false if disconnected.
     */
     void handlePortChange(const PortConnectionInfo& info, bool connected) const;
 
+    /**
+     * @brief Forwards the hotplug port events of a hub to handlePortChange(), so plugins
+     *        are notified without polling. Replaces any previously attached hub.
+     *        The hub must outlive this manager or be detached first.
+     * @throws std::runtime_error if libusb hotplug is not supported on this platform.
+     */
+    void attachTo(const Mega4Hub& hub);
+
+    /**
+     * @brief Stops forwarding events from the attached hub (no-op if none).
+     *        Returns once the plugin callbacks of an event being forwarded have returned.
+     */
+    void detach();
+
     /**
     * @brief Returns all currently loaded plugin instances.
     *        The returned pointers are owned by PluginManager — do not delete them.
@@ -48,12 +83,30 @@ public:
      */
     [[nodiscard]] size_t pluginCount() const noexcept;
 
+    /**
+     * @brief Returns the number of plugins indexed from a manifest and not loaded yet.
+     */
+    [[nodiscard]] size_t deferredCount() const noexcept;
+
+    /**
+     * @brief Returns the latency histograms of the callbacks of every loaded plugin
+     *        (MetricsSnapshot::pluginCallbacks; the transfer counters stay zero).
+     */
+    [[nodiscard]] MetricsSnapshot metrics() const;
+
     // ----------------------------- Template Specializations ----------------------------
+    /**
+     * @brief Returns the plugin with this name, loading it first if its manifest declares that name.
+     */
     DevicePlugin* getPluginByName(const std::string& name) const;
 
+    /**
+     * @brief Returns the first loaded plugin of type T; plugins not loaded yet are not considered.
+     */
     template <typename T>
     T* getPluginAs() const
     {
+        std::lock_guard lock(mutex_);
         for (auto& plugin : plugins_)
         {
             if (auto* casted = dynamic_cast<T*>(plugin.instance))
@@ -63,15 +116,49 @@ public:
     }
 
 private:
+    struct CallbackLatency
+    {
+        LatencyHistogram canHandle;
+        LatencyHistogram connected;
+        LatencyHistogram disconnected;
+    };
+
     struct LoadedPlugin
     {
         void* handle;
         DevicePlugin* instance;
         void (*destroy)(DevicePlugin*);
+        std::unique_ptr<CallbackLatency> latency;
+    };
+
+    /**
+     * @brief One match line of a manifest; unset fields match any device.
+     */
+    struct MatchRule
+    {
+        std::optional<uint16_t> vid;
+        std::optional<uint16_t> pid;
+        std::optional<uint8_t> deviceClass;
+
+        [[nodiscard]] bool matches(const PortConnectionInfo& info) const;
     };
 
-    std::vector<LoadedPlugin> plugins_;
+    struct DeferredPlugin
+    {
+        std::string path; ///< The .so to dlopen()
+        std::string name; ///< Declared by the manifest
+        std::vector<MatchRule> rules;
+    };
+
+    static std::optional<DeferredPlugin> readManifest(const std::string& manifestPath, const std::string& pluginPath);
+    bool load(const std::string& path) const;
+
+    mutable std::mutex mutex_; ///< Guards plugins_ and deferred_, which grow as devices appear
+    mutable std::vector<LoadedPlugin> plugins_;
+    mutable std::vector<DeferredPlugin> deferred_;
     std::string directory_;
+    const Mega4Hub* hub_ = nullptr;
+    int subscriptionId_ = 0;
 };
 
 #endif // UUGEAR_PLUGIN_LINK_MODE_MODULE
@@ -0,0 +1,131 @@
+#ifndef UUGEAR_MEGA4_LIB_POWERSCHEDULER_HPP
+#define UUGEAR_MEGA4_LIB_POWERSCHEDULER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class Mega4Hub;
+    class PowerScheduler;
+    struct PowerStep;
+    struct PowerPlan;
+    enum class PowerStepState;
+    struct PowerStepOutcome;
+    struct PowerPlanResult;
+}
+
+/**
+ * @brief One port to switch as part of a PowerPlan.
+ */
+struct UUGear::Mega4::PowerStep
+{
+    std::string hubPath; ///< busPortPath of the hub
+    int port = 1; ///< Port number (1–4)
+    bool on = true; ///< Turn the port ON (true) or OFF (false)
+};
+
+/**
+ * @brief Ports to switch in order, spread out so that their inrush currents do not add up.
+ *
+ * A step occupies one of maxConcurrent slots from the moment its request is
+ * sent until settleTime after the hub acknowledged it; consecutive steps also
+ * start at least spacing apart.
+ */
+struct UUGear::Mega4::PowerPlan
+{
+    std::vector<PowerStep> steps;
+    std::chrono::milliseconds spacing{200}; ///< Minimum time between the starts of two steps
+    size_t maxConcurrent = 1; ///< Steps allowed to draw inrush current at the same time
+    std::chrono::milliseconds settleTime{100}; ///< How long a switched port keeps its slot
+};
+
+enum class UUGear::Mega4::PowerStepState
+{
+    Pending, ///< Not run yet
+    Done, ///< The hub acknowledged the request
+    Failed, ///< The request failed, see PowerStepOutcome::error
+    Skipped ///< Not run because the plan was cancelled
+};
+
+struct UUGear::Mega4::PowerStepOutcome
+{
+    PowerStepState state = PowerStepState::Pending;
+    std::exception_ptr error; ///< Set when state is Failed
+};
+
+/**
+ * @brief How a PowerPlan ended, one outcome per step in plan order.
+ */
+struct UUGear::Mega4::PowerPlanResult
+{
+    uint64_t planId = 0;
+    bool cancelled = false;
+    std::vector<PowerStepOutcome> steps;
+
+    /**
+     * @brief True if every step is Done.
+     */
+    [[nodiscard]] bool ok() const;
+};
+
+/**
+ * @brief Runs power plans on a timer wheel inside one thread.
+ *
+ * Steps are sent with the asynchronous Mega4Hub power requests and timed on a
+ * timer wheel driven by the scheduler's own thread, so any number of plans run
+ * concurrently without blocking callers or holding a thread per plan or per
+ * wait. Plans are independent: the limits of one do not account for the others.
+ * Completion callbacks run on the scheduler thread and must not block.
+ */
+class UUGear::Mega4::PowerScheduler
+{
+public:
+    using PlanCallback = std::function<void(const PowerPlanResult& result)>;
+
+    /**
+     * @param hub Hub to send the requests through; must outlive the scheduler.
+     */
+    explicit PowerScheduler(const Mega4Hub& hub);
+
+    /**
+     * @brief Cancels the plans still running, waits for their in-flight requests
+     *        and reports them as cancelled.
+     */
+    ~PowerScheduler();
+
+    PowerScheduler(const PowerScheduler&) = delete;
+    PowerScheduler& operator=(const PowerScheduler&) = delete;
+
+    /**
+     * @brief Queues a plan; its first step starts right away.
+     * @param done Called once with the result when the plan has ended.
+     * @return Id to pass to cancel().
+     */
+    uint64_t submit(PowerPlan plan, PlanCallback done);
+
+    /**
+     * @brief Same as submit(plan, done) with the result delivered through a future.
+     */
+    [[nodiscard]] std::future<PowerPlanResult> submit(PowerPlan plan);
+
+    /**
+     * @brief Stops starting steps of a plan. Steps in flight still complete, the
+     *        others are Skipped, then the plan ends as cancelled.
+     *        Does nothing if the plan already ended.
+     */
+    void cancel(uint64_t planId);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+#endif //UUGEAR_MEGA4_LIB_POWERSCHEDULER_HPP
@@ -0,0 +1,282 @@
+#ifndef UUGEAR_MEGA4_LIB_SHAREDSTATE_HPP
+#define UUGEAR_MEGA4_LIB_SHAREDSTATE_HPP
+
+#include "UUGear/Mega4/Mega4Types.hpp"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace UUGear::Mega4
+{
+    struct SharedPortRecord;
+    struct SharedHubRecord;
+    struct SharedHubSlot;
+    struct SharedStateLayout;
+    struct SharedHubState;
+    class SharedStateReader;
+}
+
+/**
+ * @brief One port of a SharedHubRecord: PortConnectionInfo in fixed-size form.
+ */
+struct UUGear::Mega4::SharedPortRecord
+{
+    static constexpr size_t STRING_SIZE = 64; ///< Longer strings are cut, always NUL-terminated
+
+    uint8_t portNumber;
+    uint8_t hasDevice;
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t deviceClass;
+    uint8_t reserved;
+    char manufacturer[STRING_SIZE];
+    char product[STRING_SIZE];
+};
+
+/**
+ * @brief Published state of one hub, as last read by the publisher.
+ */
+struct UUGear::Mega4::SharedHubRecord
+{
+    static constexpr size_t PATH_SIZE = 32;
+
+    char busPortPath[PATH_SIZE];
+    uint64_t generation; ///< Incremented every time this record changes
+    int64_t changedNs; ///< steady_clock time (ns since its epoch) of the last change
+    uint8_t inUse; ///< 0 for a free slot; the other fields are then meaningless
+    uint8_t powered; ///< Bit n-1 set when port n is ON (getPortStates())
+    uint8_t connectionsValid; ///< 0 if getPortConnections() failed; ports[] then holds port numbers only
+    uint8_t reserved[5];
+    SharedPortRecord ports[4];
+};
+
+/**
+ * @brief A hub record behind a seqlock.
+ *
+ * The single writer makes sequence odd, stores the record, then makes it even
+ * again; a reader copies the record between two loads of sequence and retries
+ * if they differ or are odd. The record is kept as relaxed atomic words so the
+ * racing copy is well-defined.
+ */
+struct alignas(64) UUGear::Mega4::SharedHubSlot
+{
+    static constexpr size_t WORDS = sizeof(SharedHubRecord) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> words[WORDS];
+};
+
+/**
+ * @brief Layout of the shared-memory segment written by SharedStatePublisher.
+ */
+struct UUGear::Mega4::SharedStateLayout
+{
+    static constexpr uint32_t MAGIC = 0x3447454d; ///< "MEG4"
+    static constexpr uint16_t VERSION = 1;
+    static constexpr size_t MAX_HUBS = 32;
+    static constexpr const char* DEFAULT_NAME = "/uugear_mega4";
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t capacity; ///< Number of slots
+    std::atomic<uint64_t> generation; ///< Incremented after every change of any slot
+    std::atomic<int64_t> heartbeatNs; ///< steady_clock time of the publisher's last pass, 0 once it stopped
+    SharedHubSlot slots[MAX_HUBS];
+};
+
+static_assert(std::is_trivially_copyable_v<UUGear::Mega4::SharedHubRecord>);
+static_assert(sizeof(UUGear::Mega4::SharedHubRecord) % sizeof(uint64_t) == 0);
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory atomics must be lock-free");
+
+/**
+ * @brief Decoded copy of a SharedHubRecord.
+ */
+struct UUGear::Mega4::SharedHubState
+{
+    std::string busPortPath;
+    std::array<bool, 4> states{false, false, false, false}; ///< true = ON, one entry per port
+    std::vector<PortConnectionInfo> connections; ///< Empty if the publisher could not read them
+    uint64_t generation = 0; ///< Incremented every time the hub's record changes
+    std::chrono::steady_clock::time_point changed{}; ///< When the record last changed
+};
+
+/**
+ * @brief Reads the hub states published by a SharedStatePublisher, in this or any other process.
+ *
+ * Header-only; only the constructor and destructor make system calls. Reads
+ * copy from the mapped segment and never block the publisher, nor each other.
+ * Link with -lrt on glibc older than 2.34.
+ */
+class UUGear::Mega4::SharedStateReader
+{
+public:
+    /**
+     * @brief Copies tried by read() before it gives up on a slot that keeps changing or stays
+     *        mid-write, as a slot does when its publisher died while writing it.
+     */
+    static constexpr int MAX_READ_ATTEMPTS = 10000;
+
+    /**
+     * @brief Maps the segment read-only.
+     * @throws std::runtime_error if it does not exist or was not written by a compatible publisher.
+     */
+    explicit SharedStateReader(const std::string& name = SharedStateLayout::DEFAULT_NAME)
+    {
+        const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open shared MEGA4 state " + name + ": " + std::strerror(errno));
+        void* mapped = ::mmap(nullptr, sizeof(SharedStateLayout), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("Failed to map shared MEGA4 state " + name + ": " + std::strerror(errno));
+
+        layout_ = static_cast<const SharedStateLayout*>(mapped);
+        if (layout_->magic != SharedStateLayout::MAGIC || layout_->version != SharedStateLayout::VERSION)
+        {
+            ::munmap(mapped, sizeof(SharedStateLayout));
+            throw std::runtime_error("Incompatible shared MEGA4 state " + name);
+        }
+    }
+
+    ~SharedStateReader()
+    {
+        ::munmap(const_cast<SharedStateLayout*>(layout_), sizeof(SharedStateLayout));
+    }
+
+    SharedStateReader(const SharedStateReader&) = delete;
+    SharedStateReader& operator=(const SharedStateReader&) = delete;
+
+    /**
+     * @brief Changes whenever any hub record changes: poll it to skip unchanged reads.
+     */
+    [[nodiscard]] uint64_t generation() const
+    {
+        return layout_->generation.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief True if the publisher made a pass within maxAge (and has not stopped).
+     */
+    [[nodiscard]] bool isAlive(const std::chrono::steady_clock::duration maxAge) const
+    {
+        const int64_t heartbeat = layout_->heartbeatNs.load(std::memory_order_relaxed);
+        const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch());
+        return heartbeat != 0 && now.count() - heartbeat <= std::chrono::nanoseconds(maxAge).count();
+    }
+
+    [[nodiscard]] size_t capacity() const { return layout_->capacity; }
+
+    /**
+     * @brief Copies a consistent record of one slot, without allocating.
+     * @return False if the slot is free or past capacity(), or no consistent copy was made in
+     *         MAX_READ_ATTEMPTS tries.
+     */
+    bool read(const size_t slot, SharedHubRecord& record) const
+    {
+        if (slot >= capacity())
+            return false;
+
+        const SharedHubSlot& source = layout_->slots[slot];
+        uint64_t words[SharedHubSlot::WORDS];
+        for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt)
+        {
+            const uint64_t before = source.sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                std::this_thread::yield(); // being written; let a preempted publisher finish
+                continue;
+            }
+            for (size_t i = 0; i < SharedHubSlot::WORDS; ++i)
+                words[i] = source.words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (source.sequence.load(std::memory_order_relaxed) == before)
+            {
+                std::memcpy(&record, words, sizeof(record));
+                return record.inUse != 0;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Decoded state of every published hub, in slot order; slots read() gives up on are skipped.
+     */
+    [[nodiscard]] std::vector<SharedHubState> hubs() const
+    {
+        std::vector<SharedHubState> states;
+        SharedHubRecord record;
+        for (size_t slot = 0; slot < capacity(); ++slot)
+        {
+            if (read(slot, record))
+                states.push_back(decode(record));
+        }
+        return states;
+    }
+
+    /**
+     * @brief Decoded state of the hub at busPortPath, if it is published.
+     */
+    [[nodiscard]] std::optional<SharedHubState> hub(const std::string& busPortPath) const
+    {
+        SharedHubRecord record;
+        for (size_t slot = 0; slot < capacity(); ++slot)
+        {
+            if (read(slot, record) && busPortPath == text(record.busPortPath, sizeof(record.busPortPath)))
+                return decode(record);
+        }
+        return std::nullopt;
+    }
+
+    static SharedHubState decode(const SharedHubRecord& record)
+    {
+        SharedHubState state;
+        state.busPortPath = text(record.busPortPath, sizeof(record.busPortPath));
+        for (size_t i = 0; i < state.states.size(); ++i)
+            state.states[i] = (record.powered >> i) & 1u;
+        if (record.connectionsValid)
+        {
+            for (const auto& port : record.ports)
+            {
+                PortConnectionInfo connection{};
+                connection.portNumber = port.portNumber;
+                connection.hasDevice = port.hasDevice != 0;
+                connection.vid = port.vid;
+                connection.pid = port.pid;
+                connection.deviceClass = port.deviceClass;
+                connection.manufacturer = text(port.manufacturer, sizeof(port.manufacturer));
+                connection.product = text(port.product, sizeof(port.product));
+                state.connections.push_back(std::move(connection));
+            }
+        }
+        state.generation = record.generation;
+        const std::chrono::nanoseconds changed(record.changedNs);
+        state.changed = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(changed));
+        return state;
+    }
+
+private:
+    static std::string text(const char* field, const size_t size)
+    {
+        return {field, ::strnlen(field, size)};
+    }
+
+    const SharedStateLayout* layout_ = nullptr;
+};
+
+#endif //UUGEAR_MEGA4_LIB_SHAREDSTATE_HPP
@@ -0,0 +1,61 @@
+#ifndef UUGEAR_MEGA4_LIB_SHAREDSTATEPUBLISHER_HPP
+#define UUGEAR_MEGA4_LIB_SHAREDSTATEPUBLISHER_HPP
+
+#include "UUGear/Mega4/SharedState.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    class Mega4Hub;
+    class SharedStatePublisher;
+}
+
+/**
+ * @brief Publishes the state of every hub to a POSIX shared-memory segment for SharedStateReader.
+ *
+ * A background thread reads getPortStates() and getPortConnections() of each hub
+ * found by the hub's last scan, every interval and right after a port status
+ * change, and writes the records that changed behind a per-hub seqlock (see
+ * SharedHubSlot). With a stateCacheTtl on the hub the passes cost no USB traffic
+ * as long as the cache is fresh. Up to SharedStateLayout::MAX_HUBS hubs are published.
+ */
+class UUGear::Mega4::SharedStatePublisher
+{
+public:
+    static constexpr auto DEFAULT_INTERVAL = std::chrono::milliseconds(1000);
+
+    /**
+     * @brief Creates the segment and publishes a first time. A segment of the same name
+     *        left by a publisher that died is replaced; one still published is not touched.
+     * @param hub Hub to publish; must outlive the publisher.
+     * @param name Segment name for shm_open(), starting with '/'.
+     * @throws std::runtime_error if the segment cannot be created, or another publisher,
+     *         in this or any other process, publishes it.
+     */
+    explicit SharedStatePublisher(const Mega4Hub& hub, std::string name = SharedStateLayout::DEFAULT_NAME,
+                                  std::chrono::milliseconds interval = DEFAULT_INTERVAL);
+
+    /**
+     * @brief Stops publishing and removes the segment name; mapped readers keep the last state.
+     */
+    ~SharedStatePublisher();
+
+    SharedStatePublisher(const SharedStatePublisher&) = delete;
+    SharedStatePublisher& operator=(const SharedStatePublisher&) = delete;
+
+    /**
+     * @brief Publishes right away, on the calling thread.
+     */
+    void publish() const;
+
+    [[nodiscard]] const std::string& name() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+#endif //UUGEAR_MEGA4_LIB_SHAREDSTATEPUBLISHER_HPP
@@ -0,0 +1,198 @@
+#ifndef UUGEAR_MEGA4_LIB_SIMULATEDMEGA4_HPP
+#define UUGEAR_MEGA4_LIB_SIMULATEDMEGA4_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "UUGear/Mega4/Mega4Types.hpp"
+
+namespace UUGear::Mega4
+{
+    class SimulatedMega4;
+}
+
+/**
+ * @brief In-process model of the VL817 hub inside a MEGA4, answering the USB hub
+ *        class requests Mega4Hub sends (GET_STATUS, SET/CLEAR_FEATURE).
+ *
+ * Pass instances in Mega4HubOptions::simulatedHubs to run a Mega4Hub without
+ * hardware. The model keeps the port power bits, the devices plugged into each
+ * port and the resulting connection/change bits, and can add latency to every
+ * request and fail requests on demand. All methods are thread-safe.
+ *
+ * Error codes are the negative libusb ones (LIBUSB_ERROR_IO = -1,
+ * LIBUSB_ERROR_NO_DEVICE = -4, LIBUSB_ERROR_PIPE = -9, LIBUSB_ERROR_TIMEOUT = -7).
+ */
+class UUGear::Mega4::SimulatedMega4
+{
+public:
+    /**
+     * @param busPortPath Path the hub is reported at (DeviceInfo::busPortPath).
+     * @param usb3 Model the USB3 hub (PID 0x0817, USB 3.x port status layout)
+     *        instead of the USB2 one (PID 0x2817).
+     */
+    explicit SimulatedMega4(std::string busPortPath = "1-1", bool usb3 = false);
+
+    /**
+     * @brief Delay applied to every control request before it is answered.
+     */
+    void setLatency(std::chrono::microseconds latency);
+
+    /**
+     * @brief Time a port takes to actually switch after a power request; until then
+     *        PORT_POWER (and isPortPowered()) still shows the previous state.
+     */
+    void setSwitchDelay(std::chrono::microseconds delay);
+
+    /**
+     * @brief Fails each request with the given probability (0–1) and error code.
+     *        The request then has no effect on the hub state.
+     */
+    void setFailureRate(double probability, int errorCode = -1);
+
+    /**
+     * @brief Fails the next count requests with the given error code.
+     */
+    void failNextTransfers(int count, int errorCode = -1);
+
+    /**
+     * @brief While paused, requests wait before they are answered, as if the hub
+     *        stopped responding; resuming answers them. Resume before destroying the model.
+     */
+    void setPaused(bool paused);
+
+    /**
+     * @brief Returns the number of requests waiting on the paused hub.
+     */
+    [[nodiscard]] int pausedTransfers() const;
+
+    /**
+     * @brief Seeds the generator behind setFailureRate() for reproducible runs.
+     */
+    void setSeed(uint32_t seed);
+
+    /**
+     * @brief Plugs the hub in or out. While unplugged it is not enumerated and every
+     *        request fails with LIBUSB_ERROR_NO_DEVICE; plugging it back in gives it a
+     *        new address, as a re-enumerated hub would get.
+     */
+    void setConnected(bool connected);
+
+    /**
+     * @brief Plugs a device into port device.portNumber (1–4), replacing any device there.
+     * @param speed Speed the device is reported at by the USB2 hub; the USB3 hub reports
+     *        every device at 5 Gbit/s.
+     * @throws std::out_of_range for an invalid port or a speed the USB2 hub cannot report.
+     */
+    void attachDevice(const PortConnectionInfo& device, PortSpeed speed = PortSpeed::High);
+
+    /**
+     * @brief Unplugs the device from a port (no-op if the port is empty).
+     * @throws std::out_of_range for an invalid port.
+     */
+    void detachDevice(int port);
+
+    /**
+     * @brief Raises or clears the over-current condition of a port (1–4). The hub reports
+     *        it in PORT_OVER_CURRENT and flags the transition in C_PORT_OVER_CURRENT;
+     *        the port keeps its power.
+     * @throws std::out_of_range for an invalid port.
+     */
+    void setOverCurrent(int port, bool overCurrent);
+
+    [[nodiscard]] DeviceInfo info() const;
+    [[nodiscard]] uint8_t address() const;
+    [[nodiscard]] bool connected() const;
+
+    /**
+     * @brief Returns the PORT_POWER state of a port (1–4).
+     */
+    [[nodiscard]] bool isPortPowered(int port) const;
+
+    /**
+     * @brief Returns what the host sees on each port: devices on unpowered ports
+     *        are not enumerated and therefore reported as absent.
+     */
+    [[nodiscard]] std::vector<PortConnectionInfo> ports() const;
+
+    /**
+     * @brief Returns the number of control requests received, failed ones included.
+     */
+    [[nodiscard]] uint64_t transferCount() const;
+
+    /**
+     * @brief Returns the address the host gave the device on a port (1–4), 0 if none is
+     *        enumerated. A device gets a new address every time it is enumerated again:
+     *        plugged in, its port powered back on, or the hub plugged back in.
+     */
+    [[nodiscard]] uint8_t deviceAddress(int port) const;
+
+    /**
+     * @brief Reads the manufacturer and product strings of the device on a port, as the host
+     *        does with GET_DESCRIPTOR requests to the device, after the configured latency.
+     * @return False if no device is enumerated on the port or the hub is unplugged.
+     */
+    bool readDeviceStrings(int port, std::string& manufacturer, std::string& product);
+
+    /**
+     * @brief Returns the number of successful readDeviceStrings() calls.
+     */
+    [[nodiscard]] uint64_t stringReadCount() const;
+
+    /**
+     * @brief Answers one control request as the hub would, after the configured latency.
+     * @param data Data stage of wLength bytes (filled for GET_STATUS).
+     * @return Bytes transferred or a negative libusb error code.
+     */
+    int controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                        unsigned char* data, uint16_t wLength);
+
+private:
+    struct Port
+    {
+        bool powered = true; ///< The VL817 powers its ports on reset
+        std::optional<PortConnectionInfo> device;
+        PortSpeed speed = PortSpeed::High; ///< Of the device, as reported by the USB2 hub
+        bool overCurrent = false;
+        uint8_t deviceAddress = 0; ///< Given when the device is enumerated
+        uint16_t change = 0; ///< wPortChange bits not acknowledged yet
+        std::optional<bool> switchingTo; ///< Power state requested but not reached yet
+        std::chrono::steady_clock::time_point switchAt{}; ///< When switchingTo takes effect
+    };
+
+    [[nodiscard]] uint16_t portStatus(const Port& port) const;
+    void setPower(Port& port, bool on) const;
+    uint8_t nextDeviceAddress() const;
+    void requestPower(Port& port, bool on);
+    void completeSwitches() const;
+
+    mutable std::mutex mutex_;
+    DeviceInfo info_;
+    bool usb3_;
+    bool connected_ = true;
+    uint8_t address_ = 2;
+    mutable std::array<Port, 4> ports_{}; ///< Delayed power switches complete lazily, from const readers too
+
+    std::chrono::microseconds latency_{0};
+    std::chrono::microseconds switchDelay_{0};
+    double failureRate_ = 0.0;
+    int failureError_ = -1;
+    int failNext_ = 0;
+    int failNextError_ = -1;
+    bool paused_ = false;
+    int pausedTransfers_ = 0;
+    std::condition_variable resumed_;
+    std::mt19937 random_{0x4D454741};
+    uint64_t transferCount_ = 0;
+    uint64_t stringReadCount_ = 0;
+    mutable uint8_t lastDeviceAddress_ = 9; ///< Devices can be enumerated from const readers, see ports_
+};
+
+#endif //UUGEAR_MEGA4_LIB_SIMULATEDMEGA4_HPP
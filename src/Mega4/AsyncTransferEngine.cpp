@@ -0,0 +1,130 @@
+#include "AsyncTransferEngine.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace UUGear::Mega4
+{
+    struct AsyncTransferEngine::PendingTransfer
+    {
+        Completion done;
+        AsyncTransferEngine* engine;
+    };
+
+    AsyncTransferEngine::AsyncTransferEngine(libusb_context* ctx) : ctx_(ctx)
+    {
+    }
+
+    AsyncTransferEngine::~AsyncTransferEngine()
+    {
+        // Transfers hold pointers into this object, so let every one of them finish first
+        {
+            std::unique_lock lock(mutex_);
+            idle_.wait(lock, [this] { return inFlight_.load() == 0; });
+        }
+
+        if (eventThread_.joinable())
+        {
+            running_ = false;
+            libusb_interrupt_event_handler(ctx_);
+            eventThread_.join();
+        }
+    }
+
+    int AsyncTransferEngine::submitControl(libusb_device_handle* handle, const uint8_t bmRequestType,
+                                           const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                           const uint16_t wLength, const uint8_t* outData,
+                                           const unsigned int timeoutMs, Completion done)
+    {
+        libusb_transfer* transfer = libusb_alloc_transfer(0);
+        if (!transfer)
+            return LIBUSB_ERROR_NO_MEM;
+
+        auto* buffer = static_cast<unsigned char*>(std::malloc(LIBUSB_CONTROL_SETUP_SIZE + wLength));
+        if (!buffer)
+        {
+            libusb_free_transfer(transfer);
+            return LIBUSB_ERROR_NO_MEM;
+        }
+
+        libusb_fill_control_setup(buffer, bmRequestType, bRequest, wValue, wIndex, wLength);
+        if (wLength && !(bmRequestType & LIBUSB_ENDPOINT_IN) && outData)
+            std::memcpy(buffer + LIBUSB_CONTROL_SETUP_SIZE, outData, wLength);
+
+        auto* pending = new PendingTransfer{std::move(done), this};
+        libusb_fill_control_transfer(transfer, handle, buffer, onTransferComplete, pending, timeoutMs);
+        transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+
+        startEventThread();
+
+        ++inFlight_;
+        if (const int ret = libusb_submit_transfer(transfer); ret != 0)
+        {
+            --inFlight_;
+            delete pending;
+            libusb_free_transfer(transfer);
+            return ret;
+        }
+        return 0;
+    }
+
+    void AsyncTransferEngine::onTransferComplete(libusb_transfer* transfer)
+    {
+        auto* pending = static_cast<PendingTransfer*>(transfer->user_data);
+
+        try
+        {
+            if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+                pending->done(transfer->actual_length, libusb_control_transfer_get_data(transfer),
+                              transfer->actual_length);
+            else
+                pending->done(toErrorCode(transfer->status), nullptr, 0);
+        }
+        catch (...)
+        {
+            // A throwing callback must not unwind through libusb and kill the event thread
+        }
+
+        libusb_free_transfer(transfer);
+
+        AsyncTransferEngine* engine = pending->engine;
+        delete pending;
+        engine->transferFinished();
+    }
+
+    void AsyncTransferEngine::transferFinished()
+    {
+        std::lock_guard lock(mutex_);
+        if (--inFlight_ == 0)
+            idle_.notify_all();
+    }
+
+    int AsyncTransferEngine::toErrorCode(const libusb_transfer_status status)
+    {
+        switch (status)
+        {
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_INTERRUPTED;
+        default: return LIBUSB_ERROR_IO;
+        }
+    }
+
+    void AsyncTransferEngine::startEventThread()
+    {
+        std::lock_guard lock(mutex_);
+        if (eventThread_.joinable())
+            return;
+
+        running_ = true;
+        eventThread_ = std::thread([this] { eventLoop(); });
+    }
+
+    void AsyncTransferEngine::eventLoop() const
+    {
+        while (running_)
+            libusb_handle_events(ctx_);
+    }
+} // namespace UUGear::Mega4
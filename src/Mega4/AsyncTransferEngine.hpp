@@ -0,0 +1,79 @@
+#ifndef UUGEAR_MEGA4_LIB_ASYNCTRANSFERENGINE_HPP
+#define UUGEAR_MEGA4_LIB_ASYNCTRANSFERENGINE_HPP
+
+#include <libusb.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace UUGear::Mega4
+{
+    class AsyncTransferEngine;
+}
+
+/**
+ * @brief Submits control transfers with libusb_submit_transfer and completes them
+ *        on a single event thread running libusb_handle_events.
+ *
+ * The event thread is started with the first submission (or explicitly, for
+ * other users of libusb events such as hotplug callbacks) and stopped by the
+ * destructor once every in-flight transfer has completed.
+ */
+class UUGear::Mega4::AsyncTransferEngine
+{
+public:
+    /**
+     * @brief Completion callback, invoked on the event thread.
+     * @param result Number of bytes transferred, or a negative libusb error code.
+     * @param data Data stage of the transfer (IN transfers only, nullptr on error).
+     * @param length Number of valid bytes in data.
+     */
+    using Completion = std::function<void(int result, const uint8_t* data, int length)>;
+
+    explicit AsyncTransferEngine(libusb_context* ctx);
+    ~AsyncTransferEngine();
+
+    AsyncTransferEngine(const AsyncTransferEngine&) = delete;
+    AsyncTransferEngine& operator=(const AsyncTransferEngine&) = delete;
+
+    /**
+     * @brief Queues a control transfer. Does not block.
+     * @param outData Data stage for OUT transfers (wLength bytes), ignored for IN transfers.
+     * @param done Called exactly once when the transfer finishes, only if submission succeeded.
+     * @return 0 if the transfer was submitted, or the libusb error code otherwise.
+     */
+    int submitControl(libusb_device_handle* handle, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                      uint16_t wIndex, uint16_t wLength, const uint8_t* outData, unsigned int timeoutMs,
+                      Completion done);
+
+    /**
+     * @brief Starts the event thread if it is not running yet.
+     */
+    void startEventThread();
+
+    /**
+     * @brief Returns the number of submitted transfers that have not completed yet.
+     */
+    [[nodiscard]] size_t inFlight() const noexcept { return inFlight_.load(); }
+
+private:
+    struct PendingTransfer;
+
+    static void LIBUSB_CALL onTransferComplete(libusb_transfer* transfer);
+    static int toErrorCode(libusb_transfer_status status);
+
+    void transferFinished();
+    void eventLoop() const;
+
+    libusb_context* ctx_;
+    std::thread eventThread_;
+    std::atomic<bool> running_{false};
+    std::atomic<size_t> inFlight_{0};
+    std::mutex mutex_;
+    std::condition_variable idle_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_ASYNCTRANSFERENGINE_HPP
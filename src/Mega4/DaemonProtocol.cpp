@@ -0,0 +1,503 @@
+#include "DaemonProtocol.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace UUGear::Mega4
+{
+    // Largest frame accepted from a peer; anything bigger is a protocol error
+    constexpr uint32_t MAX_FRAME_SIZE = 16u << 20;
+
+    // Bytes asked for per recv(), so pipelined frames are read in one call
+    constexpr size_t RECEIVE_CHUNK = 64 * 1024;
+
+    namespace
+    {
+        // Bit order of the PortStatus flags on the wire
+        uint16_t statusFlags(const PortStatus& status)
+        {
+            const bool flags[] = {
+                status.connected, status.enabled, status.suspended, status.overCurrent, status.reset,
+                status.powered, status.connectionChanged, status.enableChanged, status.suspendChanged,
+                status.overCurrentChanged, status.resetChanged, status.linkStateChanged
+            };
+            uint16_t bits = 0;
+            for (size_t i = 0; i < std::size(flags); ++i)
+            {
+                if (flags[i])
+                    bits |= static_cast<uint16_t>(1u << i);
+            }
+            return bits;
+        }
+
+        void setStatusFlags(PortStatus& status, const uint16_t bits)
+        {
+            bool* flags[] = {
+                &status.connected, &status.enabled, &status.suspended, &status.overCurrent, &status.reset,
+                &status.powered, &status.connectionChanged, &status.enableChanged, &status.suspendChanged,
+                &status.overCurrentChanged, &status.resetChanged, &status.linkStateChanged
+            };
+            for (size_t i = 0; i < std::size(flags); ++i)
+                *flags[i] = (bits >> i) & 1u;
+        }
+    }
+
+    FrameEncoder::FrameEncoder(const uint32_t id, const uint8_t code)
+    {
+        u32(0); // length, set by finish()
+        u32(id);
+        u8(code);
+    }
+
+    void FrameEncoder::u16(const uint16_t v)
+    {
+        u8(static_cast<uint8_t>(v));
+        u8(static_cast<uint8_t>(v >> 8));
+    }
+
+    void FrameEncoder::u32(const uint32_t v)
+    {
+        u16(static_cast<uint16_t>(v));
+        u16(static_cast<uint16_t>(v >> 16));
+    }
+
+    void FrameEncoder::u64(const uint64_t v)
+    {
+        u32(static_cast<uint32_t>(v));
+        u32(static_cast<uint32_t>(v >> 32));
+    }
+
+    void FrameEncoder::str(const std::string& s)
+    {
+        const size_t length = std::min<size_t>(s.size(), UINT16_MAX);
+        u16(static_cast<uint16_t>(length));
+        bytes_.insert(bytes_.end(), s.begin(), s.begin() + static_cast<std::ptrdiff_t>(length));
+    }
+
+    void FrameEncoder::put(const DeviceInfo& device)
+    {
+        str(device.busPortPath);
+        u16(device.vid);
+        u16(device.pid);
+        str(device.description);
+    }
+
+    void FrameEncoder::put(const std::vector<DeviceInfo>& devices)
+    {
+        u16(static_cast<uint16_t>(devices.size()));
+        for (const auto& device : devices)
+            put(device);
+    }
+
+    void FrameEncoder::put(const HubChanges& changes)
+    {
+        put(changes.added);
+        put(changes.removed);
+    }
+
+    void FrameEncoder::put(const PortStatus& status)
+    {
+        u8(static_cast<uint8_t>(status.portNumber));
+        u8(status.valid ? 1 : 0);
+        u16(status.wPortStatus);
+        u16(status.wPortChange);
+        u16(statusFlags(status));
+        u8(static_cast<uint8_t>(status.speed));
+        u8(status.linkState);
+    }
+
+    void FrameEncoder::put(const std::array<PortStatus, 4>& statuses)
+    {
+        for (const auto& status : statuses)
+            put(status);
+    }
+
+    void FrameEncoder::put(const PortConnectionInfo& connection)
+    {
+        u8(static_cast<uint8_t>(connection.portNumber));
+        u8(connection.hasDevice ? 1 : 0);
+        u16(connection.vid);
+        u16(connection.pid);
+        u8(connection.deviceClass);
+        str(connection.manufacturer);
+        str(connection.product);
+    }
+
+    void FrameEncoder::put(const std::vector<PortConnectionInfo>& connections)
+    {
+        u16(static_cast<uint16_t>(connections.size()));
+        for (const auto& connection : connections)
+            put(connection);
+    }
+
+    void FrameEncoder::put(const std::array<bool, 4>& states)
+    {
+        uint8_t bits = 0;
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            if (states[i])
+                bits |= static_cast<uint8_t>(1u << i);
+        }
+        u8(bits);
+    }
+
+    void FrameEncoder::put(const PortStateSnapshot& snapshot)
+    {
+        put(snapshot.states);
+        u64(snapshot.generation);
+        // steady_clock is CLOCK_MONOTONIC, shared by every process on the machine
+        u64(static_cast<uint64_t>(snapshot.timestamp.time_since_epoch().count()));
+        u8(snapshot.valid ? 1 : 0);
+    }
+
+    void FrameEncoder::put(const PortEvent& event)
+    {
+        i32(event.deviceIndex);
+        str(event.hubPath);
+        put(event.port);
+        u8(event.connected ? 1 : 0);
+    }
+
+    void FrameEncoder::put(const PortStatusChange& change)
+    {
+        i32(change.deviceIndex);
+        put(change.status); // portNumber, powered and the raw words are part of it
+    }
+
+    void FrameEncoder::put(const LatencySnapshot& latency)
+    {
+        str(latency.operation);
+        str(latency.plugin);
+        for (const uint64_t bucket : latency.buckets)
+            u64(bucket);
+        u64(latency.count);
+        u64(latency.sumNanoseconds);
+        u64(latency.failures);
+    }
+
+    void FrameEncoder::put(const MetricsSnapshot& metrics)
+    {
+        u64(metrics.transfers);
+        u64(metrics.transferErrors);
+        u64(metrics.timeouts);
+        u64(metrics.retries);
+        u16(static_cast<uint16_t>(metrics.operations.size()));
+        for (const auto& latency : metrics.operations)
+            put(latency);
+        u16(static_cast<uint16_t>(metrics.pluginCallbacks.size()));
+        for (const auto& latency : metrics.pluginCallbacks)
+            put(latency);
+    }
+
+    std::vector<uint8_t> FrameEncoder::finish()
+    {
+        const auto length = static_cast<uint32_t>(bytes_.size() - 4);
+        for (size_t i = 0; i < 4; ++i)
+            bytes_[i] = static_cast<uint8_t>(length >> (8 * i));
+        return std::move(bytes_);
+    }
+
+    FrameDecoder::FrameDecoder(std::vector<uint8_t> frame) : frame_(std::move(frame))
+    {
+        id_ = u32();
+        code_ = u8();
+    }
+
+    uint8_t FrameDecoder::u8()
+    {
+        if (pos_ >= frame_.size())
+            throw std::runtime_error("Truncated mega4d frame");
+        return frame_[pos_++];
+    }
+
+    uint16_t FrameDecoder::u16()
+    {
+        const uint16_t lo = u8();
+        return static_cast<uint16_t>(lo | (u8() << 8));
+    }
+
+    uint32_t FrameDecoder::u32()
+    {
+        const uint32_t lo = u16();
+        return lo | (static_cast<uint32_t>(u16()) << 16);
+    }
+
+    uint64_t FrameDecoder::u64()
+    {
+        const uint64_t lo = u32();
+        return lo | (static_cast<uint64_t>(u32()) << 32);
+    }
+
+    std::string FrameDecoder::str()
+    {
+        const size_t length = u16();
+        if (frame_.size() - pos_ < length)
+            throw std::runtime_error("Truncated mega4d frame");
+        std::string s(frame_.begin() + static_cast<std::ptrdiff_t>(pos_),
+                      frame_.begin() + static_cast<std::ptrdiff_t>(pos_ + length));
+        pos_ += length;
+        return s;
+    }
+
+    DeviceInfo FrameDecoder::deviceInfo()
+    {
+        DeviceInfo device;
+        device.busPortPath = str();
+        device.vid = u16();
+        device.pid = u16();
+        device.description = str();
+        return device;
+    }
+
+    std::vector<DeviceInfo> FrameDecoder::deviceInfos()
+    {
+        std::vector<DeviceInfo> devices(u16());
+        for (auto& device : devices)
+            device = deviceInfo();
+        return devices;
+    }
+
+    HubChanges FrameDecoder::hubChanges()
+    {
+        HubChanges changes;
+        changes.added = deviceInfos();
+        changes.removed = deviceInfos();
+        return changes;
+    }
+
+    PortStatus FrameDecoder::portStatus()
+    {
+        PortStatus status;
+        status.portNumber = u8();
+        status.valid = u8() != 0;
+        status.wPortStatus = u16();
+        status.wPortChange = u16();
+        setStatusFlags(status, u16());
+        status.speed = static_cast<PortSpeed>(u8());
+        status.linkState = u8();
+        return status;
+    }
+
+    std::array<PortStatus, 4> FrameDecoder::portStatuses()
+    {
+        std::array<PortStatus, 4> statuses;
+        for (auto& status : statuses)
+            status = portStatus();
+        return statuses;
+    }
+
+    PortConnectionInfo FrameDecoder::portConnection()
+    {
+        PortConnectionInfo connection{};
+        connection.portNumber = u8();
+        connection.hasDevice = u8() != 0;
+        connection.vid = u16();
+        connection.pid = u16();
+        connection.deviceClass = u8();
+        connection.manufacturer = str();
+        connection.product = str();
+        return connection;
+    }
+
+    std::vector<PortConnectionInfo> FrameDecoder::portConnections()
+    {
+        std::vector<PortConnectionInfo> connections(u16());
+        for (auto& connection : connections)
+            connection = portConnection();
+        return connections;
+    }
+
+    std::array<bool, 4> FrameDecoder::portStates()
+    {
+        const uint8_t bits = u8();
+        std::array<bool, 4> states{};
+        for (size_t i = 0; i < states.size(); ++i)
+            states[i] = (bits >> i) & 1u;
+        return states;
+    }
+
+    PortStateSnapshot FrameDecoder::portStateSnapshot()
+    {
+        PortStateSnapshot snapshot;
+        snapshot.states = portStates();
+        snapshot.generation = u64();
+        snapshot.timestamp = std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(static_cast<std::chrono::steady_clock::rep>(u64())));
+        snapshot.valid = u8() != 0;
+        return snapshot;
+    }
+
+    PortEvent FrameDecoder::portEvent()
+    {
+        PortEvent event;
+        event.deviceIndex = i32();
+        event.hubPath = str();
+        event.port = portConnection();
+        event.connected = u8() != 0;
+        return event;
+    }
+
+    PortStatusChange FrameDecoder::portStatusChange()
+    {
+        PortStatusChange change;
+        change.deviceIndex = i32();
+        change.status = portStatus();
+        change.portNumber = change.status.portNumber;
+        change.powered = change.status.powered;
+        change.wPortStatus = change.status.wPortStatus;
+        change.wPortChange = change.status.wPortChange;
+        return change;
+    }
+
+    LatencySnapshot FrameDecoder::latency()
+    {
+        LatencySnapshot latency;
+        latency.operation = str();
+        latency.plugin = str();
+        for (uint64_t& bucket : latency.buckets)
+            bucket = u64();
+        latency.count = u64();
+        latency.sumNanoseconds = u64();
+        latency.failures = u64();
+        return latency;
+    }
+
+    MetricsSnapshot FrameDecoder::metrics()
+    {
+        MetricsSnapshot metrics;
+        metrics.transfers = u64();
+        metrics.transferErrors = u64();
+        metrics.timeouts = u64();
+        metrics.retries = u64();
+        metrics.operations.resize(u16());
+        for (auto& latency : metrics.operations)
+            latency = this->latency();
+        metrics.pluginCallbacks.resize(u16());
+        for (auto& latency : metrics.pluginCallbacks)
+            latency = this->latency();
+        return metrics;
+    }
+
+    std::exception_ptr FrameDecoder::error()
+    {
+        const std::string message = str();
+        switch (static_cast<DaemonStatus>(code_))
+        {
+        case DaemonStatus::OutOfRange:
+            return std::make_exception_ptr(std::out_of_range(message));
+        case DaemonStatus::InvalidArgument:
+            return std::make_exception_ptr(std::invalid_argument(message));
+        default:
+            return std::make_exception_ptr(std::runtime_error(message));
+        }
+    }
+
+    FrameSocket::FrameSocket(const int fd) : fd_(fd)
+    {
+    }
+
+    FrameSocket::~FrameSocket()
+    {
+        ::close(fd_);
+    }
+
+    bool FrameSocket::receive(std::vector<uint8_t>& frame)
+    {
+        while (true)
+        {
+            const size_t available = in_.size() - inPos_;
+            if (available >= 4)
+            {
+                uint32_t length = 0;
+                for (size_t i = 0; i < 4; ++i)
+                    length |= static_cast<uint32_t>(in_[inPos_ + i]) << (8 * i);
+                if (length < 5 || length > MAX_FRAME_SIZE)
+                    return false;
+                if (available >= 4 + length)
+                {
+                    const auto begin = in_.begin() + static_cast<std::ptrdiff_t>(inPos_ + 4);
+                    frame.assign(begin, begin + length);
+                    inPos_ += 4 + length;
+                    return true;
+                }
+            }
+
+            // Drop what was consumed before reading more
+            in_.erase(in_.begin(), in_.begin() + static_cast<std::ptrdiff_t>(inPos_));
+            inPos_ = 0;
+            const size_t used = in_.size();
+            in_.resize(used + RECEIVE_CHUNK);
+            ssize_t n;
+            do
+            {
+                n = ::recv(fd_, in_.data() + used, RECEIVE_CHUNK, 0);
+            }
+            while (n < 0 && errno == EINTR);
+            in_.resize(used + static_cast<size_t>(n > 0 ? n : 0));
+            if (n <= 0)
+                return false;
+        }
+    }
+
+    bool FrameSocket::send(std::vector<uint8_t> frame)
+    {
+        {
+            std::lock_guard lock(sendMutex_);
+            if (broken_)
+                return false;
+            if (outbox_.empty())
+                outbox_ = std::move(frame);
+            else
+                outbox_.insert(outbox_.end(), frame.begin(), frame.end());
+            if (flushing_)
+                return true; // the flushing thread picks it up
+            flushing_ = true;
+        }
+
+        std::vector<uint8_t> batch;
+        while (true)
+        {
+            {
+                std::lock_guard lock(sendMutex_);
+                if (outbox_.empty())
+                {
+                    flushing_ = false;
+                    return true;
+                }
+                batch.swap(outbox_);
+                outbox_.clear();
+            }
+            if (!writeAll(batch))
+            {
+                std::lock_guard lock(sendMutex_);
+                broken_ = true;
+                flushing_ = false;
+                outbox_.clear();
+                return false;
+            }
+        }
+    }
+
+    void FrameSocket::shutdown()
+    {
+        ::shutdown(fd_, SHUT_RDWR);
+    }
+
+    bool FrameSocket::writeAll(const std::vector<uint8_t>& bytes) const
+    {
+        size_t sent = 0;
+        while (sent < bytes.size())
+        {
+            const ssize_t n = ::send(fd_, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+} // namespace UUGear::Mega4
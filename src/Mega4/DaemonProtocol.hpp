@@ -0,0 +1,216 @@
+#ifndef UUGEAR_MEGA4_LIB_DAEMONPROTOCOL_HPP
+#define UUGEAR_MEGA4_LIB_DAEMONPROTOCOL_HPP
+
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Metrics.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    enum class DaemonOp : uint8_t;
+    enum class DaemonStatus : uint8_t;
+    enum class DaemonEvent : uint8_t;
+    class FrameEncoder;
+    class FrameDecoder;
+    class FrameSocket;
+}
+
+/**
+ * @brief Request opcodes of the mega4d protocol, one per Mega4Hub method.
+ *
+ * Frames (little-endian) are a uint32 length of the rest of the frame, a uint32
+ * request id and a uint8 code, followed by the payload. A request's code is its
+ * DaemonOp; the response carries the same id and a DaemonStatus as code, with the
+ * result as payload or, on failure, the error message. Id 0 is never used by
+ * requests: frames with id 0 are pushed events, with a DaemonEvent as code.
+ * Clients may send any number of requests without waiting for the responses,
+ * which can come back in any order. Strings and vectors are a uint16 length
+ * followed by the bytes or elements.
+ */
+enum class UUGear::Mega4::DaemonOp : uint8_t
+{
+    ListDevices = 1,
+    RescanDevices = 2,
+    KnownDevices = 3,
+    DeviceIndexOf = 4, ///< str path
+    PowerOn = 5, ///< i32 port, i32 deviceIndex
+    PowerOff = 6, ///< i32 port, i32 deviceIndex
+    ApplyPowerMasks = 7, ///< Vector of (i32 deviceIndex, u8 on, u8 off)
+    GetPortStates = 8, ///< i32 deviceIndex, u8 forceHardwareRead
+    GetPortStateSnapshot = 9, ///< i32 deviceIndex, u8 forceHardwareRead
+    GetPortStatus = 10, ///< i32 deviceIndex
+    GetPortConnections = 11, ///< i32 deviceIndex
+    PowerOnAsync = 12, ///< i32 port, i32 deviceIndex
+    PowerOffAsync = 13, ///< i32 port, i32 deviceIndex
+    GetPortStatesAsync = 14, ///< i32 deviceIndex
+    PowerCycle = 15, ///< Vector of (i32 deviceIndex, i32 port, u32 offTime ms)
+    SubscribePortEvents = 16,
+    UnsubscribePortEvents = 17,
+    SubscribePortStatus = 18,
+    UnsubscribePortStatus = 19,
+    Metrics = 20
+};
+
+/**
+ * @brief Response codes; every one but Ok carries a message and is rethrown by
+ *        the client as the exception type the daemon's hub threw.
+ */
+enum class UUGear::Mega4::DaemonStatus : uint8_t
+{
+    Ok = 0,
+    OutOfRange = 1, ///< std::out_of_range
+    InvalidArgument = 2, ///< std::invalid_argument
+    RuntimeError = 3 ///< std::runtime_error and anything else
+};
+
+enum class UUGear::Mega4::DaemonEvent : uint8_t
+{
+    Port = 1, ///< PortEvent
+    PortStatus = 2 ///< PortStatusChange
+};
+
+/**
+ * @brief Builds one frame: header first, payload appended with the typed writers.
+ */
+class UUGear::Mega4::FrameEncoder
+{
+public:
+    FrameEncoder(uint32_t id, uint8_t code);
+
+    void u8(uint8_t v) { bytes_.push_back(v); }
+    void u16(uint16_t v);
+    void u32(uint32_t v);
+    void u64(uint64_t v);
+    void i32(const int32_t v) { u32(static_cast<uint32_t>(v)); }
+    void str(const std::string& s);
+
+    void put(const DeviceInfo& device);
+    void put(const std::vector<DeviceInfo>& devices);
+    void put(const HubChanges& changes);
+    void put(const PortStatus& status);
+    void put(const std::array<PortStatus, 4>& statuses);
+    void put(const PortConnectionInfo& connection);
+    void put(const std::vector<PortConnectionInfo>& connections);
+    void put(const std::array<bool, 4>& states);
+    void put(const PortStateSnapshot& snapshot);
+    void put(const PortEvent& event);
+    void put(const PortStatusChange& change);
+    void put(const LatencySnapshot& latency);
+    void put(const MetricsSnapshot& metrics);
+
+    /**
+     * @brief Fills in the length and returns the frame, ready to send.
+     */
+    std::vector<uint8_t> finish();
+
+private:
+    std::vector<uint8_t> bytes_;
+};
+
+/**
+ * @brief Reads one received frame; every read past its end throws std::runtime_error.
+ */
+class UUGear::Mega4::FrameDecoder
+{
+public:
+    /**
+     * @param frame A frame as returned by FrameSocket::receive(), length excluded.
+     */
+    explicit FrameDecoder(std::vector<uint8_t> frame);
+
+    [[nodiscard]] uint32_t id() const { return id_; }
+    [[nodiscard]] uint8_t code() const { return code_; }
+
+    uint8_t u8();
+    uint16_t u16();
+    uint32_t u32();
+    uint64_t u64();
+    int32_t i32() { return static_cast<int32_t>(u32()); }
+    std::string str();
+
+    DeviceInfo deviceInfo();
+    std::vector<DeviceInfo> deviceInfos();
+    HubChanges hubChanges();
+    PortStatus portStatus();
+    std::array<PortStatus, 4> portStatuses();
+    PortConnectionInfo portConnection();
+    std::vector<PortConnectionInfo> portConnections();
+    std::array<bool, 4> portStates();
+    PortStateSnapshot portStateSnapshot();
+    PortEvent portEvent();
+    PortStatusChange portStatusChange();
+    LatencySnapshot latency();
+    MetricsSnapshot metrics();
+
+    /**
+     * @brief The failure of an error response, as the matching exception type.
+     */
+    std::exception_ptr error();
+
+private:
+    std::vector<uint8_t> frame_;
+    size_t pos_ = 0;
+    uint32_t id_ = 0;
+    uint8_t code_ = 0;
+};
+
+/**
+ * @brief Frame transport over a connected stream socket, which it owns.
+ *
+ * One thread receives; any number send. Concurrent senders are coalesced: the
+ * thread that finds the socket idle writes every frame queued until then, its
+ * own and those other threads queued meanwhile, so pipelined requests and
+ * responses leave in as few system calls as possible.
+ */
+class UUGear::Mega4::FrameSocket
+{
+public:
+    explicit FrameSocket(int fd);
+
+    /**
+     * @brief Closes the socket.
+     */
+    ~FrameSocket();
+
+    FrameSocket(const FrameSocket&) = delete;
+    FrameSocket& operator=(const FrameSocket&) = delete;
+
+    /**
+     * @brief Blocks until a whole frame arrived.
+     * @return False once the peer closed the connection, the socket was shut down,
+     *         or a frame was malformed.
+     */
+    bool receive(std::vector<uint8_t>& frame);
+
+    /**
+     * @brief Queues a frame and writes the queue unless another thread is already doing so.
+     * @return False if the connection is broken; the frame is then dropped.
+     */
+    bool send(std::vector<uint8_t> frame);
+
+    /**
+     * @brief Shuts both directions down, waking up the receiving thread.
+     */
+    void shutdown();
+
+private:
+    bool writeAll(const std::vector<uint8_t>& bytes) const;
+
+    int fd_;
+    std::vector<uint8_t> in_; ///< Received bytes not consumed yet
+    size_t inPos_ = 0;
+
+    std::mutex sendMutex_;
+    std::vector<uint8_t> outbox_;
+    bool flushing_ = false;
+    bool broken_ = false;
+};
+
+#endif //UUGEAR_MEGA4_LIB_DAEMONPROTOCOL_HPP
@@ -0,0 +1,86 @@
+#include "DescriptorCache.hpp"
+
+#include <tuple>
+
+namespace UUGear::Mega4
+{
+    bool DescriptorCache::Key::operator<(const Key& other) const
+    {
+        return std::tie(bus, address, portPath) < std::tie(other.bus, other.address, other.portPath);
+    }
+
+    DescriptorCache::Key DescriptorCache::keyOf(libusb_device* dev)
+    {
+        uint8_t ports[8];
+        const int len = libusb_get_port_numbers(dev, ports, sizeof(ports));
+
+        Key key{libusb_get_bus_number(dev), libusb_get_device_address(dev), {}};
+        for (int i = 0; i < len; ++i)
+            key.portPath += (i ? "." : "") + std::to_string(ports[i]);
+        return key;
+    }
+
+    bool DescriptorCache::lookup(libusb_device* dev, Strings& strings) const
+    {
+        return lookup(keyOf(dev), strings);
+    }
+
+    bool DescriptorCache::lookup(const Key& key, Strings& strings) const
+    {
+        std::lock_guard lock(mutex_);
+
+        const auto it = entries_.find(key);
+        if (it == entries_.end())
+            return false;
+        strings = it->second;
+        return true;
+    }
+
+    void DescriptorCache::store(libusb_device* dev, const Strings& strings)
+    {
+        store(keyOf(dev), strings);
+    }
+
+    void DescriptorCache::store(const Key& key, const Strings& strings)
+    {
+        std::lock_guard lock(mutex_);
+        entries_[key] = strings;
+    }
+
+    void DescriptorCache::invalidate(libusb_device* dev)
+    {
+        invalidate(keyOf(dev));
+    }
+
+    void DescriptorCache::invalidate(const Key& key)
+    {
+        std::lock_guard lock(mutex_);
+        entries_.erase(key);
+    }
+
+    void DescriptorCache::retain(libusb_device* const* list, const ssize_t count)
+    {
+        std::set<Key> present;
+        for (ssize_t i = 0; i < count; ++i)
+            present.insert(keyOf(list[i]));
+        retain(present);
+    }
+
+    void DescriptorCache::retain(const std::set<Key>& present)
+    {
+        std::lock_guard lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();)
+        {
+            if (present.count(it->first))
+                ++it;
+            else
+                it = entries_.erase(it);
+        }
+    }
+
+    size_t DescriptorCache::size() const
+    {
+        std::lock_guard lock(mutex_);
+        return entries_.size();
+    }
+} // namespace UUGear::Mega4
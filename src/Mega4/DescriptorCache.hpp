@@ -0,0 +1,77 @@
+#ifndef UUGEAR_MEGA4_LIB_DESCRIPTORCACHE_HPP
+#define UUGEAR_MEGA4_LIB_DESCRIPTORCACHE_HPP
+
+#include <libusb.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    class DescriptorCache;
+}
+
+/**
+ * @brief Remembers the manufacturer/product strings of devices already read,
+ *        keyed by bus number, device address and port path.
+ *
+ * Reading the strings opens the device and costs two control transfers, which
+ * can also wake it from suspend. A device keeps its address for as long as it
+ * stays connected, so an entry is valid until the device disconnects; a device
+ * re-enumerated on the same port gets a new address and therefore a new entry.
+ */
+class UUGear::Mega4::DescriptorCache
+{
+public:
+    struct Strings
+    {
+        std::string manufacturer;
+        std::string product;
+    };
+
+    /**
+     * @brief Identity of a connected device; the libusb overloads derive it with keyOf().
+     */
+    struct Key
+    {
+        uint8_t bus;
+        uint8_t address;
+        std::string portPath;
+
+        bool operator<(const Key& other) const;
+    };
+
+    static Key keyOf(libusb_device* dev);
+
+    /**
+     * @brief Looks up the strings of a device.
+     * @return True if the device was cached.
+     */
+    bool lookup(libusb_device* dev, Strings& strings) const;
+    bool lookup(const Key& key, Strings& strings) const;
+
+    void store(libusb_device* dev, const Strings& strings);
+    void store(const Key& key, const Strings& strings);
+
+    /**
+     * @brief Forgets a device (call when it disconnects).
+     */
+    void invalidate(libusb_device* dev);
+    void invalidate(const Key& key);
+
+    /**
+     * @brief Keeps only the entries of the given devices, e.g. after a full enumeration.
+     */
+    void retain(libusb_device* const* list, ssize_t count);
+    void retain(const std::set<Key>& present);
+
+    [[nodiscard]] size_t size() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<Key, Strings> entries_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_DESCRIPTORCACHE_HPP
@@ -0,0 +1,49 @@
+#include "DeviceHandlePool.hpp"
+
+namespace UUGear::Mega4
+{
+    DeviceHandlePool::~DeviceHandlePool() { clear(); }
+
+    int DeviceHandlePool::acquire(libusb_device* dev, Handle& handle)
+    {
+        handle.reset();
+        if (!dev)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        std::lock_guard lock(mutex_);
+
+        if (const auto it = handles_.find(dev); it != handles_.end())
+        {
+            handle = it->second;
+            return 0;
+        }
+
+        libusb_device_handle* opened = nullptr;
+        if (const int ret = libusb_open(dev, &opened); ret != 0)
+            return ret;
+
+        handle = Handle(opened, libusb_close);
+        handles_.emplace(dev, handle);
+        return 0;
+    }
+
+    void DeviceHandlePool::invalidate(libusb_device* dev)
+    {
+        std::lock_guard lock(mutex_);
+
+        handles_.erase(dev);
+    }
+
+    void DeviceHandlePool::clear()
+    {
+        std::lock_guard lock(mutex_);
+
+        handles_.clear();
+    }
+
+    size_t DeviceHandlePool::size() const
+    {
+        std::lock_guard lock(mutex_);
+        return handles_.size();
+    }
+} // namespace UUGear::Mega4
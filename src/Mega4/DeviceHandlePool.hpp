@@ -0,0 +1,63 @@
+#ifndef UUGEAR_MEGA4_LIB_DEVICEHANDLEPOOL_HPP
+#define UUGEAR_MEGA4_LIB_DEVICEHANDLEPOOL_HPP
+
+#include <libusb.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace UUGear::Mega4
+{
+    class DeviceHandlePool;
+}
+
+/**
+ * @brief Keeps one open libusb handle per device so repeated requests
+ *        do not pay for a libusb_open/libusb_close round trip every time.
+ *
+ * Handles are opened lazily on first use and stay open until they are
+ * invalidated (e.g. after LIBUSB_ERROR_NO_DEVICE) or the pool is destroyed.
+ * Requests share a handle: one invalidated while another thread still uses it
+ * is closed when that request releases it.
+ */
+class UUGear::Mega4::DeviceHandlePool
+{
+public:
+    using Handle = std::shared_ptr<libusb_device_handle>;
+
+    DeviceHandlePool() = default;
+    ~DeviceHandlePool();
+
+    DeviceHandlePool(const DeviceHandlePool&) = delete;
+    DeviceHandlePool& operator=(const DeviceHandlePool&) = delete;
+
+    /**
+     * @brief Returns the cached handle for a device, opening it if needed.
+     * @param dev Device to open.
+     * @param handle Receives the open handle on success; keep it for the whole request.
+     * @return 0 on success or the libusb error code returned by libusb_open.
+     */
+    int acquire(libusb_device* dev, Handle& handle);
+
+    /**
+     * @brief Forgets the handle of a device (no-op if not open); it is closed
+     *        once no request uses it any more.
+     */
+    void invalidate(libusb_device* dev);
+
+    /**
+     * @brief Forgets every cached handle.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of currently open handles.
+     */
+    [[nodiscard]] size_t size() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<libusb_device*, Handle> handles_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_DEVICEHANDLEPOOL_HPP
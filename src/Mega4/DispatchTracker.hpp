@@ -0,0 +1,80 @@
+#ifndef UUGEAR_MEGA4_LIB_DISPATCHTRACKER_HPP
+#define UUGEAR_MEGA4_LIB_DISPATCHTRACKER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace UUGear::Mega4
+{
+    class DispatchTracker;
+}
+
+/**
+ * @brief Lets an unsubscribe wait for the callbacks already being run.
+ *
+ * Subscribers are copied under a lock and called without it, so erasing a
+ * subscription does not stop a dispatch that copied it first. Each dispatch
+ * holds a Scope from the copy until its callbacks returned; waitForEarlier()
+ * waits for the dispatches begun before it was called. Called from a thread
+ * that is dispatching (a callback unsubscribing), it returns at once, since
+ * that dispatch cannot end before it does.
+ *
+ * Every member is used with the same mutex held, the one guarding the subscribers.
+ */
+class UUGear::Mega4::DispatchTracker
+{
+public:
+    /**
+     * @brief One dispatch. Constructed with the mutex held; the destructor takes it.
+     */
+    class Scope
+    {
+    public:
+        Scope(DispatchTracker& tracker, std::mutex& mutex)
+            : tracker_(tracker), mutex_(mutex), ticket_(++tracker.started_)
+        {
+            tracker_.running_.emplace(ticket_, std::this_thread::get_id());
+        }
+
+        ~Scope()
+        {
+            std::lock_guard lock(mutex_);
+            tracker_.running_.erase(ticket_);
+            tracker_.ended_.notify_all();
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        DispatchTracker& tracker_;
+        std::mutex& mutex_;
+        uint64_t ticket_;
+    };
+
+    /**
+     * @brief Waits until the dispatches begun so far have ended. lock holds the mutex.
+     */
+    void waitForEarlier(std::unique_lock<std::mutex>& lock)
+    {
+        const auto self = std::this_thread::get_id();
+        for (const auto& [ticket, thread] : running_)
+        {
+            if (thread == self)
+                return;
+        }
+
+        const uint64_t last = started_;
+        ended_.wait(lock, [&] { return running_.empty() || running_.begin()->first > last; });
+    }
+
+private:
+    uint64_t started_ = 0;
+    std::map<uint64_t, std::thread::id> running_; ///< By ticket, in start order
+    std::condition_variable ended_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_DISPATCHTRACKER_HPP
@@ -0,0 +1,86 @@
+#include "HotplugMonitor.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    HotplugMonitor::HotplugMonitor(libusb_context* ctx, Handler handler)
+        : ctx_(ctx), handler_(std::move(handler))
+    {
+        if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+            throw std::runtime_error("libusb hotplug notifications are not supported on this platform");
+
+        const int ret = libusb_hotplug_register_callback(
+            ctx_,
+            LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+            LIBUSB_HOTPLUG_NO_FLAGS,
+            LIBUSB_HOTPLUG_MATCH_ANY,
+            LIBUSB_HOTPLUG_MATCH_ANY,
+            LIBUSB_HOTPLUG_MATCH_ANY,
+            onHotplug,
+            this,
+            &callbackHandle_);
+
+        if (ret != LIBUSB_SUCCESS)
+            throw std::runtime_error(std::string("Failed to register hotplug callback (") +
+                libusb_error_name(ret) + ")");
+
+        dispatchThread_ = std::thread([this] { dispatchLoop(); });
+    }
+
+    HotplugMonitor::~HotplugMonitor()
+    {
+        libusb_hotplug_deregister_callback(ctx_, callbackHandle_);
+
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        dispatchThread_.join();
+
+        for (const auto& event : queue_)
+            libusb_unref_device(event.dev);
+    }
+
+    int HotplugMonitor::onHotplug(libusb_context*, libusb_device* dev, const libusb_hotplug_event event,
+                                  void* userData)
+    {
+        auto* self = static_cast<HotplugMonitor*>(userData);
+        {
+            std::lock_guard lock(self->mutex_);
+            if (self->stopping_)
+                return 0;
+            self->queue_.push_back({libusb_ref_device(dev), event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED});
+        }
+        self->wake_.notify_one();
+        return 0; // keep the callback registered
+    }
+
+    void HotplugMonitor::dispatchLoop()
+    {
+        std::unique_lock lock(mutex_);
+        while (true)
+        {
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+                return;
+
+            const Event event = queue_.front();
+            queue_.pop_front();
+
+            lock.unlock();
+            try
+            {
+                handler_(event.dev, event.arrived);
+            }
+            catch (...)
+            {
+                // One failing event (e.g. a device gone before it could be opened) must not stop the monitor
+            }
+            libusb_unref_device(event.dev);
+            lock.lock();
+        }
+    }
+} // namespace UUGear::Mega4
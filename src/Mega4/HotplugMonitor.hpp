@@ -0,0 +1,72 @@
+#ifndef UUGEAR_MEGA4_LIB_HOTPLUGMONITOR_HPP
+#define UUGEAR_MEGA4_LIB_HOTPLUGMONITOR_HPP
+
+#include <libusb.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace UUGear::Mega4
+{
+    class HotplugMonitor;
+}
+
+/**
+ * @brief Receives libusb hotplug notifications and hands them to a handler on a
+ *        dedicated dispatch thread.
+ *
+ * libusb invokes hotplug callbacks from inside libusb_handle_events, where
+ * synchronous transfers are not allowed. The callback therefore only queues the
+ * device; the handler runs later on the dispatch thread and may open the device
+ * or read its descriptors. libusb events must be handled by another thread
+ * (see AsyncTransferEngine::startEventThread()).
+ */
+class UUGear::Mega4::HotplugMonitor
+{
+public:
+    /**
+     * @brief Called on the dispatch thread for every arrival/departure.
+     *        The device stays referenced for the duration of the call.
+     */
+    using Handler = std::function<void(libusb_device* dev, bool arrived)>;
+
+    /**
+     * @brief Registers the hotplug callback and starts the dispatch thread.
+     * @throws std::runtime_error if libusb does not support hotplug on this platform
+     *         or the callback cannot be registered.
+     */
+    HotplugMonitor(libusb_context* ctx, Handler handler);
+
+    /**
+     * @brief Deregisters the callback, drops queued events and joins the dispatch thread.
+     */
+    ~HotplugMonitor();
+
+    HotplugMonitor(const HotplugMonitor&) = delete;
+    HotplugMonitor& operator=(const HotplugMonitor&) = delete;
+
+private:
+    struct Event
+    {
+        libusb_device* dev;
+        bool arrived;
+    };
+
+    static int LIBUSB_CALL onHotplug(libusb_context* ctx, libusb_device* dev, libusb_hotplug_event event,
+                                     void* userData);
+    void dispatchLoop();
+
+    libusb_context* ctx_;
+    Handler handler_;
+    libusb_hotplug_callback_handle callbackHandle_{};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Event> queue_;
+    bool stopping_ = false;
+    std::thread dispatchThread_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_HOTPLUGMONITOR_HPP
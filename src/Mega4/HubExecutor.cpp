@@ -0,0 +1,107 @@
+#include "UUGear/Mega4/HubExecutor.hpp"
+#include "ThreadPool.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace UUGear::Mega4
+{
+    HubExecutor::HubExecutor(const Mega4Hub& hub, const size_t threads)
+        : hub_(hub), pool_(std::make_unique<ThreadPool>(threads))
+    {
+    }
+
+    HubExecutor::~HubExecutor() = default;
+
+    std::vector<std::string> HubExecutor::targets(const std::vector<std::string>& hubPaths) const
+    {
+        if (!hubPaths.empty())
+            return hubPaths;
+
+        std::vector<std::string> paths;
+        for (const auto& device : hub_.knownDevices())
+            paths.push_back(device.busPortPath);
+        return paths;
+    }
+
+    void HubExecutor::dispatch(const size_t count, const std::function<void(size_t slot)>& task) const
+    {
+        // A single hub gains nothing from a thread hop
+        if (count == 1)
+        {
+            task(0);
+            return;
+        }
+
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = count;
+
+        for (size_t slot = 0; slot < count; ++slot)
+        {
+            pool_->post([&, slot]
+            {
+                task(slot);
+
+                std::lock_guard lock(mutex);
+                if (--remaining == 0)
+                    done.notify_one();
+            });
+        }
+
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return remaining == 0; });
+    }
+
+    std::vector<HubResult<std::array<bool, 4>>> HubExecutor::getPortStates(
+        const std::vector<std::string>& hubPaths, const bool forceHardwareRead) const
+    {
+        return forEach([forceHardwareRead](const Mega4Hub& hub, const int deviceIndex)
+        {
+            return hub.getPortStates(deviceIndex, forceHardwareRead);
+        }, hubPaths);
+    }
+
+    std::vector<HubResult<std::array<PortStatus, 4>>> HubExecutor::getPortStatus(
+        const std::vector<std::string>& hubPaths) const
+    {
+        return forEach([](const Mega4Hub& hub, const int deviceIndex)
+        {
+            return hub.getPortStatus(deviceIndex);
+        }, hubPaths);
+    }
+
+    std::vector<HubResult<std::vector<PortConnectionInfo>>> HubExecutor::getPortConnections(
+        const std::vector<std::string>& hubPaths) const
+    {
+        return forEach([](const Mega4Hub& hub, const int deviceIndex)
+        {
+            return hub.getPortConnections(deviceIndex);
+        }, hubPaths);
+    }
+
+    std::vector<HubResult<void>> HubExecutor::powerOn(const int port, const std::vector<std::string>& hubPaths) const
+    {
+        return forEach([port](const Mega4Hub& hub, const int deviceIndex)
+        {
+            hub.powerOn(port, deviceIndex);
+        }, hubPaths);
+    }
+
+    std::vector<HubResult<void>> HubExecutor::powerOff(const int port, const std::vector<std::string>& hubPaths) const
+    {
+        return forEach([port](const Mega4Hub& hub, const int deviceIndex)
+        {
+            hub.powerOff(port, deviceIndex);
+        }, hubPaths);
+    }
+
+    std::vector<HubResult<void>> HubExecutor::applyPowerMask(const uint8_t onMask, const uint8_t offMask,
+                                                             const std::vector<std::string>& hubPaths) const
+    {
+        return forEach([onMask, offMask](const Mega4Hub& hub, const int deviceIndex)
+        {
+            hub.applyPowerMask(onMask, offMask, deviceIndex);
+        }, hubPaths);
+    }
+} // namespace UUGear::Mega4
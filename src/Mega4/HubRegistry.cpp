@@ -0,0 +1,118 @@
+#include "HubRegistry.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace UUGear::Mega4
+{
+    std::vector<uint8_t> HubRegistry::sortKey(const std::string& busPortPath)
+    {
+        // "1-1-2" → {1, 1, 2}
+        std::vector<uint8_t> key;
+        size_t start = 0;
+        while (start <= busPortPath.size())
+        {
+            size_t end = busPortPath.find('-', start);
+            if (end == std::string::npos) end = busPortPath.size();
+            key.push_back(static_cast<uint8_t>(std::atoi(busPortPath.substr(start, end - start).c_str())));
+            start = end + 1;
+        }
+        return key;
+    }
+
+    HubChanges HubRegistry::update(const std::vector<UsbTransport::HubEntry>& found)
+    {
+        HubChanges changes;
+        std::vector<UsbTransport::HubEntry> fresh = found;
+
+        std::lock_guard lock(updateMutex_);
+        auto next = std::make_shared<Entries>();
+
+        // Entries still enumerated at the same path and address are kept as they are
+        for (const auto& entry : *entries())
+        {
+            const auto match = std::find_if(fresh.begin(), fresh.end(), [&](const UsbTransport::HubEntry& e)
+            {
+                return e.info.busPortPath == entry.hub.info.busPortPath && e.address == entry.hub.address;
+            });
+            if (match != fresh.end())
+            {
+                fresh.erase(match);
+                next->push_back(entry);
+                continue;
+            }
+
+            changes.removed.push_back(entry.hub.info);
+        }
+
+        for (auto& hub : fresh)
+        {
+            changes.added.push_back(hub.info);
+            next->push_back({sortKey(hub.info.busPortPath), std::move(hub), std::make_shared<std::mutex>()});
+        }
+
+        std::sort(next->begin(), next->end(),
+                  [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        std::atomic_store(&entries_, std::shared_ptr<const Entries>(std::move(next)));
+        return changes;
+    }
+
+    size_t HubRegistry::size() const
+    {
+        return entries()->size();
+    }
+
+    DeviceInfo HubRegistry::info(const size_t index) const
+    {
+        const auto current = entries();
+        if (index >= current->size())
+            throw std::out_of_range("Invalid hub index.");
+        return (*current)[index].hub.info;
+    }
+
+    std::vector<DeviceInfo> HubRegistry::devices() const
+    {
+        const auto current = entries();
+        std::vector<DeviceInfo> infos;
+        infos.reserve(current->size());
+        for (const auto& entry : *current)
+            infos.push_back(entry.hub.info);
+        return infos;
+    }
+
+    int HubRegistry::indexOf(const std::string& busPortPath) const
+    {
+        const auto current = entries();
+        for (size_t i = 0; i < current->size(); ++i)
+        {
+            if ((*current)[i].hub.info.busPortPath == busPortPath)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    int HubRegistry::find(const std::string& busPortPath, DeviceInfo& info) const
+    {
+        const auto current = entries();
+        for (size_t i = 0; i < current->size(); ++i)
+        {
+            if ((*current)[i].hub.info.busPortPath == busPortPath)
+            {
+                info = (*current)[i].hub.info;
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    std::shared_ptr<std::mutex> HubRegistry::writeLock(const std::string& busPortPath) const
+    {
+        for (const auto& entry : *entries())
+        {
+            if (entry.hub.info.busPortPath == busPortPath)
+                return entry.writeLock;
+        }
+        throw std::out_of_range("No MEGA4 hub at " + busPortPath);
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,99 @@
+#ifndef UUGEAR_MEGA4_LIB_HUBREGISTRY_HPP
+#define UUGEAR_MEGA4_LIB_HUBREGISTRY_HPP
+
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UsbTransport.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class HubRegistry;
+
+    // Known IDs for VIA Labs VL817 controller used by MEGA4
+    constexpr uint16_t MEGA4_VENDOR_ID = 0x2109;
+    constexpr uint16_t MEGA4_PID_USB2 = 0x2817;
+    constexpr uint16_t MEGA4_PID_USB3 = 0x0817;
+
+    inline bool isMega4(const uint16_t vid, const uint16_t pid)
+    {
+        return vid == MEGA4_VENDOR_ID && (pid == MEGA4_PID_USB2 || pid == MEGA4_PID_USB3);
+    }
+}
+
+/**
+ * @brief The MEGA4 hubs currently on the bus, keyed by bus/port path.
+ *
+ * Entries are ordered by bus and port numbers, and the position of an entry is
+ * the deviceIndex used by Mega4Hub, so indices only move when hubs are added or
+ * removed. update() diffs one enumeration against the registry: hubs still present
+ * at the same path and address keep their entry, the others are added or removed.
+ *
+ * The entries are published as an immutable snapshot that update() replaces
+ * atomically (read-copy-update), so readers never wait for a scan; each call
+ * sees one consistent version of the registry.
+ */
+class UUGear::Mega4::HubRegistry
+{
+public:
+    /**
+     * @brief Brings the registry up to date with one enumeration.
+     *        A hub replugged at the same path (new address) is reported both
+     *        as removed and as added.
+     * @return The hubs added and removed.
+     */
+    HubChanges update(const std::vector<UsbTransport::HubEntry>& found);
+
+    [[nodiscard]] size_t size() const;
+
+    /**
+     * @brief Returns the description of the hub at an index.
+     * @throws std::out_of_range if the index is not registered.
+     */
+    [[nodiscard]] DeviceInfo info(size_t index) const;
+
+    /**
+     * @brief Returns the descriptions of all hubs, in deviceIndex order.
+     */
+    [[nodiscard]] std::vector<DeviceInfo> devices() const;
+
+    /**
+     * @brief Returns the index of a hub, or -1 if it is not registered.
+     */
+    [[nodiscard]] int indexOf(const std::string& busPortPath) const;
+
+    /**
+     * @brief Returns the index and description of a hub from the same version of the registry,
+     *        or -1 (info left unchanged) if it is not registered.
+     */
+    [[nodiscard]] int find(const std::string& busPortPath, DeviceInfo& info) const;
+
+    /**
+     * @brief Returns the lock serializing requests that change the state of a hub.
+     *        It is kept for as long as the hub stays registered at the same address.
+     * @throws std::out_of_range if no hub is registered at that path.
+     */
+    [[nodiscard]] std::shared_ptr<std::mutex> writeLock(const std::string& busPortPath) const;
+
+private:
+    struct Entry
+    {
+        std::vector<uint8_t> key; ///< Bus number followed by the port numbers, for ordering
+        UsbTransport::HubEntry hub;
+        std::shared_ptr<std::mutex> writeLock;
+    };
+    using Entries = std::vector<Entry>;
+
+    static std::vector<uint8_t> sortKey(const std::string& busPortPath);
+
+    [[nodiscard]] std::shared_ptr<const Entries> entries() const { return std::atomic_load(&entries_); }
+
+    std::mutex updateMutex_; ///< Serializes writers; readers only load entries_
+    std::shared_ptr<const Entries> entries_ = std::make_shared<const Entries>(); ///< Sorted by key
+};
+
+#endif //UUGEAR_MEGA4_LIB_HUBREGISTRY_HPP
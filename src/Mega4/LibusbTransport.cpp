@@ -0,0 +1,243 @@
+#include "LibusbTransport.hpp"
+#include "AsyncTransferEngine.hpp"
+#include "HubRegistry.hpp"
+
+#include <stdexcept>
+
+namespace UUGear::Mega4
+{
+    LibusbTransport::LibusbTransport()
+    {
+        if (libusb_init(&ctx_) != 0)
+        {
+            throw std::runtime_error("Failed to initialize libusb");
+        }
+    }
+
+    LibusbTransport::~LibusbTransport()
+    {
+        engine_.reset(); // waits for in-flight transfers before handles are closed
+        handlePool_.clear();
+        for (const auto& [path, dev] : devices_) libusb_unref_device(dev);
+        libusb_exit(ctx_);
+    }
+
+    std::string LibusbTransport::busPortPath(libusb_device* dev)
+    {
+        const uint8_t bus = libusb_get_bus_number(dev);
+        uint8_t portPath[8];
+        const int pathLen = libusb_get_port_numbers(dev, portPath, sizeof(portPath));
+
+        std::string path = std::to_string(bus);
+        for (int j = 0; j < pathLen; ++j)
+            path += "-" + std::to_string(portPath[j]);
+        return path;
+    }
+
+    bool LibusbTransport::enumerateHubs(std::vector<HubEntry>& hubs)
+    {
+        libusb_device** list = nullptr;
+        const ssize_t devCount = libusb_get_device_list(ctx_, &list);
+        if (devCount < 0) return false;
+
+        std::map<std::string, libusb_device*> found;
+        for (ssize_t i = 0; i < devCount; ++i)
+        {
+            libusb_device* dev = list[i];
+            libusb_device_descriptor desc{};
+
+            if (libusb_get_device_descriptor(dev, &desc) != 0 || !isMega4(desc.idVendor, desc.idProduct))
+                continue;
+
+            HubEntry entry;
+            entry.address = libusb_get_device_address(dev);
+            entry.info.busPortPath = busPortPath(dev);
+            entry.info.vid = desc.idVendor;
+            entry.info.pid = desc.idProduct;
+            entry.info.description = "VIA Labs VL817 Hub (" + std::string(
+                    desc.idProduct == MEGA4_PID_USB3 ? "USB3" : "USB2")
+                + ")";
+            found.emplace(entry.info.busPortPath, dev);
+            hubs.push_back(std::move(entry));
+        }
+
+        {
+            // Keep one reference per hub; hubs that left or were replaced lose their handle
+            std::lock_guard lock(mutex_);
+            for (auto it = devices_.begin(); it != devices_.end();)
+            {
+                const auto match = found.find(it->first);
+                if (match != found.end() && match->second == it->second)
+                {
+                    ++it;
+                    continue;
+                }
+                handlePool_.invalidate(it->second);
+                libusb_unref_device(it->second);
+                it = devices_.erase(it);
+            }
+            for (const auto& [path, dev] : found)
+            {
+                if (!devices_.count(path))
+                    devices_.emplace(path, libusb_ref_device(dev));
+            }
+        }
+
+        libusb_free_device_list(list, 1);
+        return true;
+    }
+
+    libusb_device* LibusbTransport::findByPath(const std::string& hubPath, const libusb_device* exclude) const
+    {
+        libusb_device* result = nullptr;
+
+        libusb_device** list = nullptr;
+        const ssize_t devCount = libusb_get_device_list(ctx_, &list);
+        if (devCount < 0) return nullptr;
+
+        for (ssize_t i = 0; i < devCount; ++i)
+        {
+            libusb_device* dev = list[i];
+            libusb_device_descriptor desc{};
+            if (dev == exclude || libusb_get_device_descriptor(dev, &desc) != 0 ||
+                !isMega4(desc.idVendor, desc.idProduct))
+                continue;
+
+            if (busPortPath(dev) == hubPath)
+            {
+                result = libusb_ref_device(dev);
+                break;
+            }
+        }
+        libusb_free_device_list(list, 1);
+        return result;
+    }
+
+    libusb_device* LibusbTransport::device(const std::string& hubPath)
+    {
+        libusb_device* dev = referencedDevice(hubPath);
+        if (dev) libusb_unref_device(dev); // devices_ still holds its own reference
+        return dev;
+    }
+
+    libusb_device* LibusbTransport::referencedDevice(const std::string& hubPath)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            if (const auto it = devices_.find(hubPath); it != devices_.end())
+                return libusb_ref_device(it->second);
+        }
+
+        // Hubs listed from sysfs are only looked up when a libusb request needs them
+        libusb_device* dev = findByPath(hubPath, nullptr);
+        if (!dev) return nullptr;
+
+        std::lock_guard lock(mutex_);
+        const auto [it, inserted] = devices_.emplace(hubPath, dev);
+        if (!inserted) libusb_unref_device(dev);
+        return libusb_ref_device(it->second);
+    }
+
+    int LibusbTransport::openHub(const std::string& hubPath, DeviceHandlePool::Handle& handle)
+    {
+        libusb_device* dev = referencedDevice(hubPath);
+        const int ret = handlePool_.acquire(dev, handle); // an open handle keeps its device referenced
+        if (dev) libusb_unref_device(dev);
+        return ret;
+    }
+
+    bool LibusbTransport::reattach(const std::string& hubPath)
+    {
+        libusb_device* stale = nullptr;
+        {
+            std::lock_guard lock(mutex_);
+            if (const auto it = devices_.find(hubPath); it != devices_.end())
+                stale = it->second;
+        }
+        if (stale) handlePool_.invalidate(stale);
+
+        libusb_device* replacement = findByPath(hubPath, stale);
+        if (!replacement) return false;
+
+        {
+            std::lock_guard lock(mutex_);
+            libusb_device*& slot = devices_[hubPath];
+            if (slot != stale)
+            {
+                // Replaced meanwhile by another thread; keep that one
+                libusb_unref_device(replacement);
+                return true;
+            }
+            slot = replacement;
+        }
+        if (stale) libusb_unref_device(stale);
+
+        notifyReattached(hubPath); // the hub was power-cycled or replugged
+        return true;
+    }
+
+    void LibusbTransport::invalidate(libusb_device* dev)
+    {
+        handlePool_.invalidate(dev);
+    }
+
+    int LibusbTransport::controlTransfer(const std::string& hubPath, const uint8_t bmRequestType,
+                                         const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                         unsigned char* data, const uint16_t wLength, const unsigned int timeoutMs)
+    {
+        int ret = LIBUSB_ERROR_NO_DEVICE;
+        bool opened = false;
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            DeviceHandlePool::Handle handle;
+            ret = openHub(hubPath, handle);
+            opened = ret == 0;
+            if (opened)
+            {
+                ret = libusb_control_transfer(handle.get(), bmRequestType, bRequest, wValue, wIndex, data, wLength,
+                                              timeoutMs);
+            }
+
+            if (ret != LIBUSB_ERROR_NO_DEVICE || !reattach(hubPath))
+                break;
+        }
+
+        if (!opened)
+            throw std::runtime_error("Failed to open USB device");
+        return ret;
+    }
+
+    int LibusbTransport::submitControl(const std::string& hubPath, const uint8_t bmRequestType,
+                                       const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                       const uint16_t wLength, const unsigned int timeoutMs, Completion done)
+    {
+        int ret = LIBUSB_ERROR_NO_DEVICE;
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            DeviceHandlePool::Handle handle;
+            ret = openHub(hubPath, handle);
+            if (ret == 0)
+            {
+                // The completion holds the handle until the transfer is over
+                ret = engine().submitControl(handle.get(), bmRequestType, bRequest, wValue, wIndex, wLength, nullptr,
+                                             timeoutMs, [handle, done](const int result, const uint8_t* data,
+                                                                       const int length)
+                                             {
+                                                 done(result, data, length);
+                                             });
+            }
+
+            if (ret != LIBUSB_ERROR_NO_DEVICE || !reattach(hubPath))
+                break;
+        }
+        return ret;
+    }
+
+    AsyncTransferEngine& LibusbTransport::engine()
+    {
+        std::lock_guard lock(mutex_);
+        if (!engine_)
+            engine_ = std::make_unique<AsyncTransferEngine>(ctx_);
+        return *engine_;
+    }
+} // namespace UUGear::Mega4
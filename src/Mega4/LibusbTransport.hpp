@@ -0,0 +1,95 @@
+#ifndef UUGEAR_MEGA4_LIB_LIBUSBTRANSPORT_HPP
+#define UUGEAR_MEGA4_LIB_LIBUSBTRANSPORT_HPP
+
+#include "UsbTransport.hpp"
+#include "DeviceHandlePool.hpp"
+
+#include <libusb.h>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace UUGear::Mega4
+{
+    class AsyncTransferEngine;
+    class LibusbTransport;
+}
+
+/**
+ * @brief UsbTransport on top of libusb.
+ *
+ * Owns the libusb context, one referenced libusb_device per known hub path and a
+ * pool of open handles. A hub that answers LIBUSB_ERROR_NO_DEVICE is looked up again
+ * at the same path and the request retried once on a fresh handle.
+ *
+ * The context, the devices and the event engine are also exposed to the parts of
+ * Mega4Hub that only exist on libusb (hotplug, status-change endpoint, topology).
+ */
+class UUGear::Mega4::LibusbTransport final : public UsbTransport
+{
+public:
+    /**
+     * @throws std::runtime_error if libusb initialization fails.
+     */
+    LibusbTransport();
+
+    /**
+     * @brief Waits for in-flight asynchronous transfers, closes every handle and exits libusb.
+     */
+    ~LibusbTransport() override;
+
+    LibusbTransport(const LibusbTransport&) = delete;
+    LibusbTransport& operator=(const LibusbTransport&) = delete;
+
+    bool enumerateHubs(std::vector<HubEntry>& hubs) override;
+
+    int controlTransfer(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                        uint16_t wIndex, unsigned char* data, uint16_t wLength, unsigned int timeoutMs) override;
+
+    int submitControl(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                      uint16_t wIndex, uint16_t wLength, unsigned int timeoutMs, Completion done) override;
+
+    [[nodiscard]] libusb_context* context() const noexcept { return ctx_; }
+
+    /**
+     * @brief Returns the device of a hub, looking it up by path if it is not known yet.
+     * @return nullptr if libusb does not see a MEGA4 at that path.
+     */
+    libusb_device* device(const std::string& hubPath);
+
+    /**
+     * @brief Closes the pooled handle of a device that left the bus.
+     */
+    void invalidate(libusb_device* dev);
+
+    /**
+     * @brief Returns the event engine, creating it on first use.
+     */
+    AsyncTransferEngine& engine();
+
+    static std::string busPortPath(libusb_device* dev);
+
+private:
+    [[nodiscard]] libusb_device* findByPath(const std::string& hubPath, const libusb_device* exclude) const;
+
+    /**
+     * @brief Same as device() with a reference added for the caller, so a concurrent
+     *        enumeration dropping the hub cannot free it; release with libusb_unref_device.
+     */
+    libusb_device* referencedDevice(const std::string& hubPath);
+
+    /**
+     * @brief Returns the pooled handle of a hub, opening it if needed.
+     */
+    int openHub(const std::string& hubPath, DeviceHandlePool::Handle& handle);
+    bool reattach(const std::string& hubPath);
+
+    libusb_context* ctx_ = nullptr;
+    DeviceHandlePool handlePool_; ///< Hub handles reused across requests
+
+    std::mutex mutex_;
+    std::map<std::string, libusb_device*> devices_; ///< Referenced hub devices by busPortPath
+    std::unique_ptr<AsyncTransferEngine> engine_; ///< Created on the first asynchronous request
+};
+
+#endif //UUGEAR_MEGA4_LIB_LIBUSBTRANSPORT_HPP
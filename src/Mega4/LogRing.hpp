@@ -0,0 +1,108 @@
+#ifndef UUGEAR_MEGA4_LIB_LOGRING_HPP
+#define UUGEAR_MEGA4_LIB_LOGRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace UUGear::Mega4
+{
+    template <typename T>
+    class LogRing;
+}
+
+/**
+ * @brief Bounded lock-free queue for many producers and one consumer.
+ *
+ * Each slot carries a sequence number telling whose turn it is (D. Vyukov's
+ * bounded queue): a producer claims a position with one CAS and publishes the
+ * value with a release store, the consumer takes it with an acquire load.
+ * Neither side ever waits for the other; push() fails when the ring is full.
+ */
+template <typename T>
+class UUGear::Mega4::LogRing
+{
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two.
+     */
+    explicit LogRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        slots_ = std::make_unique<Slot[]>(size);
+        for (size_t i = 0; i < size; ++i)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    /**
+     * @return False (value untouched) if the ring is full.
+     */
+    bool push(T& value) noexcept
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot& slot = slots_[pos & mask_];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // the consumer has not freed this slot yet
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Takes the oldest value. Single consumer only.
+     * @return False if the ring is empty.
+     */
+    bool pop(T& value) noexcept
+    {
+        Slot& slot = slots_[head_ & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != head_ + 1)
+            return false;
+
+        value = std::move(slot.value);
+        slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    /**
+     * @brief Number of values pushed so far (positions claimed by producers).
+     */
+    [[nodiscard]] size_t pushed() const noexcept { return tail_.load(std::memory_order_acquire); }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0; ///< Consumer only
+};
+
+#endif //UUGEAR_MEGA4_LIB_LOGRING_HPP
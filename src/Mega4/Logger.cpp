@@ -0,0 +1,156 @@
+#include "UUGear/Mega4/Logger.hpp"
+#include "LogRing.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace UUGear::Mega4
+{
+    // Records that can wait for the logger thread before new ones are dropped
+    constexpr size_t LOG_RING_CAPACITY = 4096;
+
+    // Longest the logger thread sleeps before looking at the ring again
+    constexpr auto LOG_IDLE_WAIT = std::chrono::milliseconds(50);
+
+    static void writeToStandardStreams(const LogRecord& record)
+    {
+        switch (record.level)
+        {
+        case LogLevel::Error:
+            std::cerr << "Error: " << record.message << '\n';
+            break;
+        case LogLevel::Warning:
+            std::cerr << "Warning: " << record.message << '\n';
+            break;
+        default:
+            std::cout << record.message << '\n';
+            break;
+        }
+    }
+
+    struct Logger::Impl
+    {
+        LogRing<LogRecord> ring{LOG_RING_CAPACITY};
+        std::atomic<int> level{static_cast<int>(LogLevel::Info)};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<size_t> consumed{0};
+        std::atomic<bool> sleeping{false};
+
+        std::mutex mutex; ///< Guards the waits below, never taken by log()
+        std::condition_variable wake;
+        std::condition_variable drained;
+
+        std::mutex sinkMutex;
+        Sink sink = writeToStandardStreams;
+
+        std::thread thread;
+
+        void run()
+        {
+            LogRecord record;
+            while (true)
+            {
+                bool any = false;
+                while (ring.pop(record))
+                {
+                    {
+                        std::lock_guard lock(sinkMutex);
+                        try
+                        {
+                            sink(record);
+                        }
+                        catch (...)
+                        {
+                            // A failing sink loses the record, not the logger
+                        }
+                    }
+                    consumed.fetch_add(1, std::memory_order_release);
+                    any = true;
+                }
+
+                std::unique_lock lock(mutex);
+                if (any)
+                    drained.notify_all();
+
+                sleeping.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (ring.pushed() == consumed.load(std::memory_order_acquire))
+                    wake.wait_for(lock, LOG_IDLE_WAIT);
+                sleeping.store(false, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    Logger::Logger() : pImpl(std::make_unique<Impl>())
+    {
+        pImpl->thread = std::thread([impl = pImpl.get()] { impl->run(); });
+        pImpl->thread.detach();
+    }
+
+    Logger::~Logger() = default;
+
+    Logger& Logger::instance()
+    {
+        // Never destroyed, so threads and static destructors may log until the very end;
+        // what is still queued at exit is written by the atexit handler
+        static Logger* logger = []
+        {
+            auto* created = new Logger();
+            std::atexit([] { instance().flush(); });
+            return created;
+        }();
+        return *logger;
+    }
+
+    void Logger::setSink(Sink sink)
+    {
+        std::lock_guard lock(pImpl->sinkMutex);
+        pImpl->sink = sink ? std::move(sink) : Sink(writeToStandardStreams);
+    }
+
+    void Logger::setLevel(const LogLevel level) noexcept
+    {
+        pImpl->level.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    bool Logger::enabled(const LogLevel level) const noexcept
+    {
+        return static_cast<int>(level) >= pImpl->level.load(std::memory_order_relaxed) && level != LogLevel::Off;
+    }
+
+    void Logger::log(const LogLevel level, std::string message) noexcept
+    {
+        LogRecord record{level, std::chrono::system_clock::now(), std::move(message)};
+        if (!pImpl->ring.push(record))
+        {
+            pImpl->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (pImpl->sleeping.load(std::memory_order_relaxed))
+            pImpl->wake.notify_one();
+    }
+
+    void Logger::flush()
+    {
+        const size_t target = pImpl->ring.pushed();
+        pImpl->wake.notify_one();
+
+        std::unique_lock lock(pImpl->mutex);
+        while (pImpl->consumed.load(std::memory_order_acquire) < target)
+        {
+            pImpl->wake.notify_one();
+            pImpl->drained.wait_for(lock, LOG_IDLE_WAIT);
+        }
+    }
+
+    uint64_t Logger::dropped() const noexcept
+    {
+        return pImpl->dropped.load(std::memory_order_relaxed);
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,477 @@
+#include "UUGear/Mega4/Mega4Client.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Metrics.hpp"
+#include "DaemonProtocol.hpp"
+#include "DispatchTracker.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace UUGear::Mega4
+{
+    namespace
+    {
+        int connectTo(const std::string& path)
+        {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(address.sun_path))
+                throw std::runtime_error("Invalid mega4d socket path: " + path);
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+            const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+                throw std::runtime_error(std::string("Failed to create socket: ") + std::strerror(errno));
+            if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+            {
+                const std::string reason = std::strerror(errno);
+                ::close(fd);
+                throw std::runtime_error("Failed to connect to mega4d at " + path + ": " + reason);
+            }
+            return fd;
+        }
+
+        /**
+         * @brief Response handed to the calls still pending when the connection is lost.
+         */
+        FrameDecoder lostResponse(const uint32_t id)
+        {
+            FrameEncoder frame(id, static_cast<uint8_t>(DaemonStatus::RuntimeError));
+            frame.str("Lost connection to mega4d");
+            std::vector<uint8_t> bytes = frame.finish();
+            bytes.erase(bytes.begin(), bytes.begin() + 4); // FrameSocket::receive() strips the length
+            return FrameDecoder(std::move(bytes));
+        }
+
+        std::exception_ptr errorOf(FrameDecoder& response)
+        {
+            return response.code() == static_cast<uint8_t>(DaemonStatus::Ok) ? nullptr : response.error();
+        }
+    }
+
+    struct Mega4Client::Connection
+    {
+        using Payload = std::function<void(FrameEncoder& frame)>;
+        using ResponseHandler = std::function<void(FrameDecoder& response)>;
+
+        FrameSocket socket;
+        std::thread reader;
+
+        std::mutex mutex;
+        std::unordered_map<uint32_t, ResponseHandler> pending;
+        uint32_t nextId = 1;
+        bool lost = false;
+
+        // Also held while (un)subscribe requests are sent, so they reach the daemon in map order
+        std::mutex subscriptionMutex;
+        std::map<int, PortEventCallback> eventCallbacks;
+        std::map<int, PortStatusCallback> statusCallbacks;
+        int nextSubscription = 1;
+        DispatchTracker dispatches; ///< Pushes being dispatched, waited for by unsubscribe()
+
+        explicit Connection(const std::string& path) : socket(connectTo(path))
+        {
+            reader = std::thread([this] { receive(); });
+        }
+
+        ~Connection()
+        {
+            socket.shutdown();
+            reader.join();
+        }
+
+        /**
+         * @brief Sends a request; handler runs exactly once, on the receive thread,
+         *        with the response or with a lost-connection error.
+         * @throws std::runtime_error if the connection is already lost.
+         */
+        void send(const DaemonOp op, const Payload& payload, ResponseHandler handler)
+        {
+            uint32_t id;
+            {
+                std::lock_guard lock(mutex);
+                if (lost)
+                    throw std::runtime_error("Lost connection to mega4d");
+                id = nextId++;
+                if (nextId == 0)
+                    nextId = 1; // 0 marks pushed events
+                pending.emplace(id, std::move(handler));
+            }
+
+            FrameEncoder frame(id, static_cast<uint8_t>(op));
+            if (payload)
+                payload(frame);
+            if (socket.send(frame.finish()))
+                return;
+
+            ResponseHandler orphan;
+            {
+                std::lock_guard lock(mutex);
+                const auto it = pending.find(id);
+                if (it == pending.end())
+                    return; // already failed by the receive thread
+                orphan = std::move(it->second);
+                pending.erase(it);
+            }
+            FrameDecoder response = lostResponse(id);
+            orphan(response);
+        }
+
+        std::future<FrameDecoder> request(const DaemonOp op, const Payload& payload = {})
+        {
+            auto promise = std::make_shared<std::promise<FrameDecoder>>();
+            auto future = promise->get_future();
+            send(op, payload, [promise](FrameDecoder& response) { promise->set_value(std::move(response)); });
+            return future;
+        }
+
+        /**
+         * @brief Sends a request and waits for its response.
+         * @throws What the daemon's hub threw, or std::runtime_error if the connection is lost.
+         */
+        FrameDecoder call(const DaemonOp op, const Payload& payload = {})
+        {
+            FrameDecoder response = request(op, payload).get();
+            if (const auto error = errorOf(response))
+                std::rethrow_exception(error);
+            return response;
+        }
+
+        void receive()
+        {
+            std::vector<uint8_t> frame;
+            while (socket.receive(frame))
+            {
+                FrameDecoder message(std::move(frame));
+                if (message.id() == 0)
+                {
+                    dispatchEvent(message);
+                    continue;
+                }
+
+                ResponseHandler handler;
+                {
+                    std::lock_guard lock(mutex);
+                    const auto it = pending.find(message.id());
+                    if (it == pending.end())
+                        continue;
+                    handler = std::move(it->second);
+                    pending.erase(it);
+                }
+                run(handler, message);
+            }
+
+            std::unordered_map<uint32_t, ResponseHandler> orphans;
+            {
+                std::lock_guard lock(mutex);
+                lost = true;
+                orphans.swap(pending);
+            }
+            for (auto& [id, handler] : orphans)
+            {
+                FrameDecoder response = lostResponse(id);
+                run(handler, response);
+            }
+        }
+
+        static void run(const ResponseHandler& handler, FrameDecoder& response)
+        {
+            try
+            {
+                handler(response);
+            }
+            catch (...)
+            {
+                // A throwing user callback must not take the receive thread down
+            }
+        }
+
+        void dispatchEvent(FrameDecoder& message)
+        {
+            try
+            {
+                if (message.code() == static_cast<uint8_t>(DaemonEvent::Port))
+                {
+                    const PortEvent event = message.portEvent();
+                    std::vector<PortEventCallback> callbacks;
+                    std::optional<DispatchTracker::Scope> dispatch;
+                    {
+                        std::lock_guard lock(subscriptionMutex);
+                        for (const auto& [id, callback] : eventCallbacks)
+                            callbacks.push_back(callback);
+                        dispatch.emplace(dispatches, subscriptionMutex);
+                    }
+                    for (const auto& callback : callbacks)
+                        callback(event);
+                }
+                else if (message.code() == static_cast<uint8_t>(DaemonEvent::PortStatus))
+                {
+                    const PortStatusChange change = message.portStatusChange();
+                    std::vector<PortStatusCallback> callbacks;
+                    std::optional<DispatchTracker::Scope> dispatch;
+                    {
+                        std::lock_guard lock(subscriptionMutex);
+                        for (const auto& [id, callback] : statusCallbacks)
+                            callbacks.push_back(callback);
+                        dispatch.emplace(dispatches, subscriptionMutex);
+                    }
+                    for (const auto& callback : callbacks)
+                        callback(change);
+                }
+            }
+            catch (...)
+            {
+                // Malformed event or throwing callback: drop it
+            }
+        }
+
+        template <typename Callback>
+        int subscribe(std::map<int, Callback>& callbacks, Callback callback, const DaemonOp op)
+        {
+            int id;
+            std::future<FrameDecoder> reply;
+            {
+                std::lock_guard lock(subscriptionMutex);
+                id = nextSubscription++;
+                const bool first = callbacks.empty();
+                callbacks.emplace(id, std::move(callback));
+                if (!first)
+                    return id;
+                try
+                {
+                    reply = request(op);
+                }
+                catch (...)
+                {
+                    callbacks.erase(id);
+                    throw;
+                }
+            }
+
+            FrameDecoder response = reply.get();
+            if (const auto error = errorOf(response))
+            {
+                std::lock_guard lock(subscriptionMutex);
+                callbacks.erase(id);
+                std::rethrow_exception(error);
+            }
+            return id;
+        }
+
+        template <typename Callback>
+        void unsubscribe(std::map<int, Callback>& callbacks, const int id, const DaemonOp op)
+        {
+            std::unique_lock lock(subscriptionMutex);
+            if (callbacks.erase(id) == 0)
+                return;
+            if (callbacks.empty())
+            {
+                try
+                {
+                    // Not waited for, so that callbacks may unsubscribe
+                    send(op, {}, [](FrameDecoder&) {});
+                }
+                catch (const std::runtime_error&)
+                {
+                    // Connection lost: nothing is pushed any more anyway
+                }
+            }
+            dispatches.waitForEarlier(lock);
+        }
+    };
+
+    namespace
+    {
+        void putPortRequest(FrameEncoder& frame, const int port, const int deviceIndex)
+        {
+            frame.i32(port);
+            frame.i32(deviceIndex);
+        }
+    }
+
+    Mega4Client::Mega4Client(const std::string& socketPath)
+        : Mega4Hub(NoBackend{}), connection_(std::make_unique<Connection>(socketPath))
+    {
+    }
+
+    Mega4Client::~Mega4Client() = default;
+
+    std::vector<DeviceInfo> Mega4Client::listDevices() const
+    {
+        return connection_->call(DaemonOp::ListDevices).deviceInfos();
+    }
+
+    HubChanges Mega4Client::rescanDevices() const
+    {
+        return connection_->call(DaemonOp::RescanDevices).hubChanges();
+    }
+
+    std::vector<DeviceInfo> Mega4Client::knownDevices() const
+    {
+        return connection_->call(DaemonOp::KnownDevices).deviceInfos();
+    }
+
+    int Mega4Client::deviceIndexOf(const std::string& busPortPath) const
+    {
+        return connection_->call(DaemonOp::DeviceIndexOf, [&](FrameEncoder& f) { f.str(busPortPath); }).i32();
+    }
+
+    std::chrono::microseconds Mega4Client::powerOn(const int port, const int deviceIndex) const
+    {
+        auto response = connection_->call(DaemonOp::PowerOn, [&](FrameEncoder& f)
+        {
+            putPortRequest(f, port, deviceIndex);
+        });
+        return std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(response.u64()));
+    }
+
+    std::chrono::microseconds Mega4Client::powerOff(const int port, const int deviceIndex) const
+    {
+        auto response = connection_->call(DaemonOp::PowerOff, [&](FrameEncoder& f)
+        {
+            putPortRequest(f, port, deviceIndex);
+        });
+        return std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(response.u64()));
+    }
+
+    void Mega4Client::applyPowerMask(const uint8_t onMask, const uint8_t offMask, const int deviceIndex) const
+    {
+        applyPowerMasks({PortPowerMask{deviceIndex, onMask, offMask}});
+    }
+
+    void Mega4Client::applyPowerMasks(const std::vector<PortPowerMask>& masks) const
+    {
+        connection_->call(DaemonOp::ApplyPowerMasks, [&](FrameEncoder& f)
+        {
+            f.u16(static_cast<uint16_t>(masks.size()));
+            for (const auto& mask : masks)
+            {
+                f.i32(mask.deviceIndex);
+                f.u8(mask.on);
+                f.u8(mask.off);
+            }
+        });
+    }
+
+    std::array<bool, 4> Mega4Client::getPortStates(const int deviceIndex, const bool forceHardwareRead) const
+    {
+        return connection_->call(DaemonOp::GetPortStates, [&](FrameEncoder& f)
+        {
+            f.i32(deviceIndex);
+            f.u8(forceHardwareRead ? 1 : 0);
+        }).portStates();
+    }
+
+    bool Mega4Client::isPortOn(const int port, const int deviceIndex, const bool forceHardwareRead) const
+    {
+        if (port < 1 || port > 4)
+            throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
+        return getPortStates(deviceIndex, forceHardwareRead)[port - 1];
+    }
+
+    PortStateSnapshot Mega4Client::getPortStateSnapshot(const int deviceIndex, const bool forceHardwareRead) const
+    {
+        return connection_->call(DaemonOp::GetPortStateSnapshot, [&](FrameEncoder& f)
+        {
+            f.i32(deviceIndex);
+            f.u8(forceHardwareRead ? 1 : 0);
+        }).portStateSnapshot();
+    }
+
+    std::array<PortStatus, 4> Mega4Client::getPortStatus(const int deviceIndex) const
+    {
+        return connection_->call(DaemonOp::GetPortStatus, [&](FrameEncoder& f) { f.i32(deviceIndex); })
+            .portStatuses();
+    }
+
+    void Mega4Client::powerOnAsync(const int port, const int deviceIndex, PowerCallback done) const
+    {
+        connection_->send(DaemonOp::PowerOnAsync, [&](FrameEncoder& f) { putPortRequest(f, port, deviceIndex); },
+                          [done = std::move(done)](FrameDecoder& response) { done(errorOf(response)); });
+    }
+
+    void Mega4Client::powerOffAsync(const int port, const int deviceIndex, PowerCallback done) const
+    {
+        connection_->send(DaemonOp::PowerOffAsync, [&](FrameEncoder& f) { putPortRequest(f, port, deviceIndex); },
+                          [done = std::move(done)](FrameDecoder& response) { done(errorOf(response)); });
+    }
+
+    void Mega4Client::getPortStatesAsync(const int deviceIndex, PortStatesCallback done) const
+    {
+        connection_->send(DaemonOp::GetPortStatesAsync, [&](FrameEncoder& f) { f.i32(deviceIndex); },
+                          [done = std::move(done)](FrameDecoder& response)
+                          {
+                              if (const auto error = errorOf(response))
+                                  done({}, error);
+                              else
+                                  done(response.portStates(), nullptr);
+                          });
+    }
+
+    std::future<void> Mega4Client::powerCycle(const int port, const std::chrono::milliseconds offTime,
+                                              const int deviceIndex) const
+    {
+        return powerCycle({PortPowerCycle{deviceIndex, port, offTime}});
+    }
+
+    std::future<void> Mega4Client::powerCycle(const std::vector<PortPowerCycle>& cycles) const
+    {
+        return Mega4Hub::powerCycle(cycles);
+    }
+
+    void Mega4Client::powerCycle(const std::vector<PortPowerCycle>& cycles, PowerCallback done) const
+    {
+        connection_->send(DaemonOp::PowerCycle, [&](FrameEncoder& f)
+        {
+            f.u16(static_cast<uint16_t>(cycles.size()));
+            for (const auto& cycle : cycles)
+            {
+                f.i32(cycle.deviceIndex);
+                f.i32(cycle.port);
+                f.u32(static_cast<uint32_t>(cycle.offTime.count()));
+            }
+        }, [done = std::move(done)](FrameDecoder& response) { done(errorOf(response)); });
+    }
+
+    std::vector<PortConnectionInfo> Mega4Client::getPortConnections(const int deviceIndex) const
+    {
+        return connection_->call(DaemonOp::GetPortConnections, [&](FrameEncoder& f) { f.i32(deviceIndex); })
+            .portConnections();
+    }
+
+    int Mega4Client::subscribePortEvents(PortEventCallback callback) const
+    {
+        return connection_->subscribe(connection_->eventCallbacks, std::move(callback),
+                                      DaemonOp::SubscribePortEvents);
+    }
+
+    void Mega4Client::unsubscribePortEvents(const int subscriptionId) const
+    {
+        connection_->unsubscribe(connection_->eventCallbacks, subscriptionId, DaemonOp::UnsubscribePortEvents);
+    }
+
+    int Mega4Client::subscribePortStatus(PortStatusCallback callback) const
+    {
+        return connection_->subscribe(connection_->statusCallbacks, std::move(callback),
+                                      DaemonOp::SubscribePortStatus);
+    }
+
+    void Mega4Client::unsubscribePortStatus(const int subscriptionId) const
+    {
+        connection_->unsubscribe(connection_->statusCallbacks, subscriptionId, DaemonOp::UnsubscribePortStatus);
+    }
+
+    MetricsSnapshot Mega4Client::metrics() const
+    {
+        return connection_->call(DaemonOp::Metrics).metrics();
+    }
+} // namespace UUGear::Mega4
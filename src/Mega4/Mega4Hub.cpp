@@ -1,259 +1,1432 @@
 #include "UUGear/Mega4/Mega4Hub.hpp"
 #include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Logger.hpp"
+#include "UUGear/Mega4/Metrics.hpp"
+#include "UUGear/Mega4/PowerScheduler.hpp"
+#include "DescriptorCache.hpp"
+#include "DispatchTracker.hpp"
+#include "HubRegistry.hpp"
+#include "AsyncTransferEngine.hpp"
+#include "HotplugMonitor.hpp"
+#include "LibusbTransport.hpp"
+#include "RecordingTransport.hpp"
+#include "ReplayTransport.hpp"
+#include "SimulatedTransport.hpp"
+#include "StatusChangeListener.hpp"
+#include "SysfsBackend.hpp"
+#include "TopologyIndex.hpp"
 
 #include <libusb.h>
-#include <iostream>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <stdexcept>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
 
 namespace UUGear::Mega4
 {
-    // Known IDs for VIA Labs VL817 controller used by MEGA4
-    constexpr uint16_t MEGA4_VENDOR_ID = 0x2109;
-    constexpr uint16_t MEGA4_PID_USB2 = 0x2817;
-    constexpr uint16_t MEGA4_PID_USB3 = 0x0817;
-
     // USB hub feature selector for port power
     constexpr uint16_t PORT_POWER = 8; // USB_PORT_FEAT_POWER
 
+    // Timeout applied to every control transfer sent to a hub
+    constexpr unsigned int CONTROL_TIMEOUT_MS = 1000;
+
+    // Time given to the port power switches to settle after a power request
+    constexpr auto POWER_SETTLE_TIME = std::chrono::milliseconds(50);
+
+    // Polling interval bounds while waiting for PORT_POWER to confirm a switch (doubled after each poll)
+    constexpr auto POWER_POLL_FIRST_INTERVAL = std::chrono::microseconds(250);
+    constexpr auto POWER_POLL_MAX_INTERVAL = std::chrono::microseconds(16000);
+
+    // Port mask bits that map to MEGA4 ports 1–4
+    constexpr uint8_t PORT_MASK_ALL = 0x0F;
+
+    // Request type of the hub class GET_STATUS(port) request
+    constexpr uint8_t GET_PORT_STATUS_REQUEST_TYPE =
+        LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER;
+
+    /**
+     * @brief Decodes a 4-byte GET_STATUS(port) response.
+     * @param superSpeedHub True for the USB3 hub, whose wPortStatus layout differs from USB2
+     *        (PORT_POWER is bit 9 instead of bit 8, bits 5–8 hold the link state).
+     */
+    static PortStatus decodePortStatus(const int port, const uint8_t* data, const bool superSpeedHub)
+    {
+        PortStatus status;
+        status.portNumber = port;
+        status.valid = true;
+        status.wPortStatus = static_cast<uint16_t>(data[0] | (data[1] << 8));
+        status.wPortChange = static_cast<uint16_t>(data[2] | (data[3] << 8));
+
+        const uint16_t s = status.wPortStatus;
+        const uint16_t c = status.wPortChange;
+
+        status.connected = s & 0x0001;
+        status.enabled = s & 0x0002;
+        status.overCurrent = s & 0x0008;
+        status.reset = s & 0x0010;
+        status.connectionChanged = c & 0x0001;
+        status.overCurrentChanged = c & 0x0008;
+        status.resetChanged = c & 0x0010;
+
+        if (superSpeedHub)
+        {
+            status.linkState = static_cast<uint8_t>((s >> 5) & 0x0F);
+            status.suspended = status.linkState == 3; // U3
+            status.powered = s & 0x0200;
+            if (status.connected && ((s >> 10) & 0x07) == 0)
+                status.speed = PortSpeed::Super;
+            status.linkStateChanged = c & 0x0040;
+        }
+        else
+        {
+            status.suspended = s & 0x0004;
+            status.powered = s & 0x0100;
+            if (status.connected)
+                status.speed = (s & 0x0200) ? PortSpeed::Low : (s & 0x0400) ? PortSpeed::High : PortSpeed::Full;
+            status.enableChanged = c & 0x0002;
+            status.suspendChanged = c & 0x0004;
+        }
+        return status;
+    }
+
+    // Hub operations with a latency histogram, in MetricsSnapshot::operations order
+    enum class Operation : size_t
+    {
+        ListDevices,
+        RescanDevices,
+        PowerOn,
+        PowerOff,
+        ApplyPowerMasks,
+        GetPortStates,
+        IsPortOn,
+        GetPortStatus,
+        GetPortConnections,
+        PowerAsync, ///< Submission to completion
+        GetPortStatesAsync, ///< Submission to completion
+        PowerCycle, ///< Submission to completion
+        ControlTransfer,
+        AsyncControlTransfer, ///< Submission to completion
+        Count
+    };
+
+    constexpr const char* OPERATION_NAMES[] = {
+        "listDevices", "rescanDevices", "powerOn", "powerOff", "applyPowerMasks", "getPortStates", "isPortOn",
+        "getPortStatus", "getPortConnections", "powerAsync", "getPortStatesAsync", "powerCycle", "controlTransfer",
+        "asyncControlTransfer"
+    };
+    static_assert(std::size(OPERATION_NAMES) == static_cast<size_t>(Operation::Count));
+
+    static std::exception_ptr transferError(const std::string& what, const int ret)
+    {
+        return std::make_exception_ptr(std::runtime_error(what + " (" + libusb_error_name(ret) + ")"));
+    }
+
+    /**
+     * @brief Fills the descriptor fields of a device connected to a hub port.
+     *        The manufacturer/product strings come from the cache when the device was
+     *        seen before; otherwise the device is opened briefly to read them.
+     */
+    static void describePortDevice(libusb_device* dev, const libusb_device_descriptor& desc, PortConnectionInfo& info,
+                                   DescriptorCache& cache)
+    {
+        info.hasDevice = true;
+        info.vid = desc.idVendor;
+        info.pid = desc.idProduct;
+        info.deviceClass = desc.bDeviceClass;
+
+        // Composite devices declare their class per interface; the cached config descriptor costs no USB I/O
+        libusb_config_descriptor* config = nullptr;
+        if (info.deviceClass == LIBUSB_CLASS_PER_INTERFACE && libusb_get_active_config_descriptor(dev, &config) == 0)
+        {
+            if (config->bNumInterfaces > 0 && config->interface[0].num_altsetting > 0)
+                info.deviceClass = config->interface[0].altsetting[0].bInterfaceClass;
+            libusb_free_config_descriptor(config);
+        }
+
+        DescriptorCache::Strings strings;
+        if (cache.lookup(dev, strings))
+        {
+            info.manufacturer = strings.manufacturer;
+            info.product = strings.product;
+            return;
+        }
+
+        libusb_device_handle* handle = nullptr;
+
+        if (libusb_open(dev, &handle) != 0) return;
+
+        unsigned char buf[256];
+        if (desc.iManufacturer &&
+            libusb_get_string_descriptor_ascii(handle, desc.iManufacturer, buf, sizeof(buf)) > 0)
+            info.manufacturer = reinterpret_cast<char*>(buf);
+
+        if (desc.iProduct &&
+            libusb_get_string_descriptor_ascii(handle, desc.iProduct, buf, sizeof(buf)) > 0)
+            info.product = reinterpret_cast<char*>(buf);
+
+        libusb_close(handle);
+        cache.store(dev, {info.manufacturer, info.product});
+    }
+
     struct Mega4Hub::Impl
     {
-        libusb_context* ctx = nullptr;
-        std::vector<libusb_device*> mega4Devices;
+        std::unique_ptr<UsbTransport> transport; ///< Enumeration and control transfers
+        LibusbTransport* libusb = nullptr; ///< transport when it is libusb; hotplug/topology/listeners need it
+        HubRegistry hubs; ///< Detected hubs; the position is the deviceIndex
+        std::unique_ptr<SysfsBackend> sysfs; ///< Set when Mega4HubOptions::sysfsRoot is given
+
+        std::unique_ptr<HotplugMonitor> hotplugMonitor; ///< Started with the first port event subscriber
+        std::mutex subscribersMutex;
+        std::map<int, Mega4Hub::PortEventCallback> subscribers;
+        DispatchTracker dispatches; ///< Port event and status callbacks running, see unsubscribePortEvents()
+        int nextSubscriptionId = 1;
+        std::map<libusb_device*, PortEvent> connectedPorts; ///< Last arrival seen per device (dispatch thread only)
+        TopologyIndex topology; ///< Kept current by the hotplug monitor while it runs
+        DescriptorCache descriptorCache; ///< Strings of port devices, dropped when they disconnect
+        bool hotplugUnavailable = false; ///< Set once starting the hotplug monitor failed
+
+        bool statusListening = false; ///< Set by the first port status subscriber
+        std::map<std::string, std::unique_ptr<StatusChangeListener>> statusListeners; ///< By hub busPortPath
+        std::map<int, Mega4Hub::PortStatusCallback> statusSubscribers;
+
+        std::chrono::steady_clock::duration stateCacheTtl; ///< Zero disables serving reads from snapshots
+        std::chrono::steady_clock::duration powerConfirmTimeout; ///< Zero waits POWER_SETTLE_TIME instead
+        std::mutex snapshotMutex;
+        std::map<std::string, PortStateSnapshot> snapshots; ///< By hub busPortPath
+
+        std::array<LatencyHistogram, static_cast<size_t>(Operation::Count)> latency;
+        std::atomic<uint64_t> transfers{0};
+        std::atomic<uint64_t> transferErrors{0};
+        std::atomic<uint64_t> timeouts{0};
+        std::atomic<uint64_t> retries{0};
+
+        std::once_flag schedulerStarted;
+        std::unique_ptr<PowerScheduler> scheduler; ///< Runs power cycles, started with the first one
 
-        Impl()
+        explicit Impl(const Mega4HubOptions& options)
+            : stateCacheTtl(options.stateCacheTtl), powerConfirmTimeout(options.powerConfirmTimeout)
         {
-            if (libusb_init(&ctx) != 0)
+            if (!options.replayFile.empty())
             {
-                throw std::runtime_error("Failed to initialize libusb");
+                transport = std::make_unique<ReplayTransport>(options.replayFile, options.replayWithTiming);
             }
+            else if (!options.simulatedHubs.empty())
+            {
+                transport = std::make_unique<SimulatedTransport>(options.simulatedHubs);
+            }
+            else
+            {
+                auto usb = std::make_unique<LibusbTransport>();
+                libusb = usb.get();
+                transport = std::move(usb);
+            }
+            if (!options.captureFile.empty())
+                transport = std::make_unique<RecordingTransport>(std::move(transport), options.captureFile);
+            transport->setReattachHandler([this](const std::string& hubPath)
+            {
+                // The transport retries the transfer that found the hub gone
+                retries.fetch_add(1, std::memory_order_relaxed);
+                invalidateSnapshot(hubPath);
+            });
+
+            if (!options.sysfsRoot.empty())
+                sysfs = std::make_unique<SysfsBackend>(options.sysfsRoot);
             // Try to search for MEGA4 devices at initialization
-            list();
+            rescan();
         }
 
         ~Impl()
         {
-            for (auto* d : mega4Devices) libusb_unref_device(d);
-            libusb_exit(ctx);
+            scheduler.reset(); // cancels pending cycles and waits for their requests
+            hotplugMonitor.reset();
+            statusListeners.clear();
+            topology.clear();
+            for (const auto& [dev, event] : connectedPorts) libusb_unref_device(dev);
+            transport.reset(); // completes in-flight transfers before the rest of the hub goes away
         }
 
         std::vector<DeviceInfo> list()
         {
-            std::vector<DeviceInfo> foundDevices = {};
-            libusb_device** list = nullptr;
-            const ssize_t devCount = libusb_get_device_list(ctx, &list);
+            rescan();
+            return hubs.devices();
+        }
 
-            if (devCount < 0) return foundDevices;
+        /**
+         * @brief Brings the hub registry up to date and drops the per-hub state of hubs that left.
+         */
+        HubChanges rescan()
+        {
+            std::vector<UsbTransport::HubEntry> found;
+            if (!(sysfs && sysfs->listHubs(found)) && !transport->enumerateHubs(found))
+                return {};
 
-            for (ssize_t i = 0; i < devCount; ++i)
-            {
-                libusb_device* dev = list[i];
-                libusb_device_descriptor desc{};
+            HubChanges changes = hubs.update(found);
 
-                if (libusb_get_device_descriptor(dev, &desc) != 0 ||
-                    desc.idVendor != MEGA4_VENDOR_ID || desc.idProduct != MEGA4_PID_USB2 && desc.idProduct !=
-                    MEGA4_PID_USB3)
+            std::vector<std::unique_ptr<StatusChangeListener>> stoppedListeners;
+            {
+                std::lock_guard lock(snapshotMutex);
+                for (const auto& info : changes.removed)
+                    snapshots.erase(info.busPortPath);
+            }
+            {
+                std::lock_guard lock(subscribersMutex);
+                for (const auto& info : changes.removed)
                 {
-                    continue;
+                    if (const auto it = statusListeners.find(info.busPortPath); it != statusListeners.end())
+                    {
+                        stoppedListeners.push_back(std::move(it->second));
+                        statusListeners.erase(it);
+                    }
                 }
 
-                libusb_ref_device(dev);
-                mega4Devices.push_back(dev);
+                if (statusListening)
+                    startStatusListeners(changes.added);
+            }
+            // Destroyed outside the lock: they wait for reads whose handlers take subscribersMutex
+            stoppedListeners.clear();
 
-                const uint8_t bus = libusb_get_bus_number(dev);
-                uint8_t portPath[8];
-                const int pathLen = libusb_get_port_numbers(dev, portPath, sizeof(portPath));
+            return changes;
+        }
 
-                std::string path = std::to_string(bus);
-                for (int j = 0; j < pathLen; ++j)
-                    path += "-" + std::to_string(portPath[j]);
+        LatencyHistogram& histogram(const Operation operation)
+        {
+            return latency[static_cast<size_t>(operation)];
+        }
 
-                DeviceInfo info;
-                info.busPortPath = path;
-                info.vid = desc.idVendor;
-                info.pid = desc.idProduct;
-                info.description = "VIA Labs VL817 Hub (" + std::string(
-                        desc.idProduct == MEGA4_PID_USB3 ? "USB3" : "USB2")
-                    + ")";
-                foundDevices.push_back(info);
+        void countTransfer(const int result)
+        {
+            transfers.fetch_add(1, std::memory_order_relaxed);
+            if (result >= 0)
+                return;
+            transferErrors.fetch_add(1, std::memory_order_relaxed);
+            if (result == LIBUSB_ERROR_TIMEOUT)
+                timeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] MetricsSnapshot metrics() const
+        {
+            MetricsSnapshot snapshot;
+            snapshot.transfers = transfers.load(std::memory_order_relaxed);
+            snapshot.transferErrors = transferErrors.load(std::memory_order_relaxed);
+            snapshot.timeouts = timeouts.load(std::memory_order_relaxed);
+            snapshot.retries = retries.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < latency.size(); ++i)
+                snapshot.operations.push_back(latency[i].snapshot(OPERATION_NAMES[i]));
+            return snapshot;
+        }
+
+        /**
+         * @brief Resolves a deviceIndex to its hub, from one version of the registry.
+         *        Done once per operation: the helpers address the hub by path, so a rescan
+         *        moving indices meanwhile cannot send part of the operation to another hub.
+         * @throws std::out_of_range if no hub has that index.
+         */
+        [[nodiscard]] DeviceInfo resolveHub(const int deviceIndex) const
+        {
+            const auto devices = hubs.devices();
+            if (deviceIndex < 0 || deviceIndex >= static_cast<int>(devices.size()))
+            {
+                throw std::out_of_range("Invalid hub index. Tried to access hub " + std::to_string(deviceIndex) +
+                    " but only " + std::to_string(devices.size()) + " hubs are available.");
             }
-            libusb_free_device_list(list, 1);
-            return foundDevices;
+            return devices[deviceIndex];
         }
 
-        void togglePower(const int mega4DeviceIdx, const int mega4PortNumber, const bool on) const
+        /**
+         * @brief Sends a control transfer to a hub and waits for it.
+         * @return The transfer result (bytes transferred or a libusb error code).
+         * @throws std::runtime_error if the hub cannot be opened.
+         */
+        int controlTransfer(const std::string& path, const uint8_t bmRequestType, const uint8_t bRequest,
+                            const uint16_t wValue, const uint16_t wIndex, unsigned char* data,
+                            const uint16_t wLength)
         {
-            std::cout << "Port " << mega4PortNumber << (on ? " ON" : " OFF") << " (hub " << mega4DeviceIdx << ")\n";
+            const LatencyHistogram::Timer timer(histogram(Operation::ControlTransfer));
+            int ret;
+            try
+            {
+                ret = transport->controlTransfer(path, bmRequestType, bRequest, wValue, wIndex, data, wLength,
+                                                 CONTROL_TIMEOUT_MS);
+            }
+            catch (const std::runtime_error&)
+            {
+                countTransfer(LIBUSB_ERROR_NO_DEVICE);
+                throw;
+            }
+            countTransfer(ret);
+            return ret;
+        }
+
+        [[nodiscard]] static bool isSuperSpeedHub(const DeviceInfo& hub)
+        {
+            return hub.pid == MEGA4_PID_USB3;
+        }
+
+        /**
+         * @brief Sends SET_FEATURE/CLEAR_FEATURE(PORT_POWER) for a port without waiting for it to settle.
+         * @return The libusb_control_transfer result.
+         */
+        int sendPowerRequest(const std::string& path, const int port, const bool on)
+        {
+            if (sysfs && sysfs->writePortPower(path, port, on))
+                return 0;
+
+            constexpr uint16_t feature = PORT_POWER;
+            constexpr uint8_t bmRequestType = LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER;
+            const uint8_t request = on ? LIBUSB_REQUEST_SET_FEATURE : LIBUSB_REQUEST_CLEAR_FEATURE;
+
+            return controlTransfer(path,
+                                   bmRequestType,
+                                   request,
+                                   feature,
+                                   port,
+                                   nullptr,
+                                   0);
+        }
+
+        /**
+         * @brief Reads the PORT_POWER bit of a single port.
+         * @return False if the port could not be read.
+         */
+        bool readPortPower(const DeviceInfo& hub, const int port, bool& powered)
+        {
+            std::array<bool, 4> states{};
+            if (sysfs && sysfs->readPortPower(hub.busPortPath, states))
+            {
+                powered = states[port - 1];
+                return true;
+            }
+
+            uint8_t data[4] = {0};
+            if (controlTransfer(hub.busPortPath, GET_PORT_STATUS_REQUEST_TYPE, LIBUSB_REQUEST_GET_STATUS, 0, port,
+                                data, sizeof(data)) != 4)
+                return false;
+            powered = decodePortStatus(port, data, isSuperSpeedHub(hub)).powered;
+            return true;
+        }
+
+        struct PendingSwitch
+        {
+            DeviceInfo hub;
+            int port;
+            bool on;
+        };
+
+        /**
+         * @brief Waits for power requests sent at `sent` to take effect: a fixed settle time, or
+         *        with powerConfirmTimeout set, until every port reports the requested PORT_POWER state.
+         * @return Time from `sent` until the last port was seen switched (or the settle time ended).
+         * @throws std::runtime_error if a port has not switched when powerConfirmTimeout expires.
+         */
+        std::chrono::microseconds waitForSwitch(std::vector<PendingSwitch> pending,
+                                                const std::chrono::steady_clock::time_point sent)
+        {
+            using std::chrono::duration_cast;
+            using std::chrono::microseconds;
+
+            if (powerConfirmTimeout.count() == 0)
+            {
+                std::this_thread::sleep_for(POWER_SETTLE_TIME);
+                return duration_cast<microseconds>(std::chrono::steady_clock::now() - sent);
+            }
 
-            if (mega4DeviceIdx >= static_cast<int>(mega4Devices.size()))
+            const auto deadline = sent + powerConfirmTimeout;
+            std::chrono::steady_clock::duration interval = POWER_POLL_FIRST_INTERVAL;
+            while (true)
             {
-                throw std::out_of_range("Invalid hub index. Tried to access hub " + std::to_string(mega4DeviceIdx) +
-                    " but only " + std::to_string(mega4Devices.size()) + " hubs are available.");
+                for (auto it = pending.begin(); it != pending.end();)
+                {
+                    bool powered = false;
+                    if (readPortPower(it->hub, it->port, powered) && powered == it->on)
+                        it = pending.erase(it);
+                    else
+                        ++it;
+                }
+
+                const auto now = std::chrono::steady_clock::now();
+                if (pending.empty())
+                    return duration_cast<microseconds>(now - sent);
+
+                if (now >= deadline)
+                {
+                    const PendingSwitch& late = pending.front();
+                    throw std::runtime_error("Port " + std::to_string(late.port) + " of hub " +
+                        late.hub.busPortPath + " did not switch " + (late.on ? "ON" : "OFF") +
+                        " within " +
+                        std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(powerConfirmTimeout)
+                            .count()) + " ms");
+                }
+
+                std::this_thread::sleep_for(std::min(interval, deadline - now));
+                interval = std::min<std::chrono::steady_clock::duration>(interval * 2, POWER_POLL_MAX_INTERVAL);
             }
+        }
+
+        std::chrono::microseconds togglePower(const int mega4DeviceIdx, const int mega4PortNumber, const bool on)
+        {
+            UUGEAR_MEGA4_LOG_INFO("Port " << mega4PortNumber << (on ? " ON" : " OFF") << " (hub " << mega4DeviceIdx
+                << ")");
+
+            const DeviceInfo hub = resolveHub(mega4DeviceIdx);
 
             if (mega4PortNumber < 1 || mega4PortNumber > 4)
             {
                 throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
             }
 
+            const auto sent = std::chrono::steady_clock::now();
+            {
+                // The snapshot must end up with the state of the last request the hub received
+                const auto writeLock = hubs.writeLock(hub.busPortPath);
+                std::lock_guard lock(*writeLock);
+                if (sendPowerRequest(hub.busPortPath, mega4PortNumber, on) < 0)
+                {
+                    throw std::runtime_error("Failed to send control transfer to MEGA4");
+                }
+                updateSnapshotPort(hub.busPortPath, mega4PortNumber, on);
+            }
+            hintPortChange(hub.busPortPath, mega4PortNumber);
 
-            libusb_device* dev = mega4Devices[mega4DeviceIdx];
-            libusb_device_handle* handle = nullptr;
+            return waitForSwitch({{hub, mega4PortNumber, on}}, sent);
+        }
 
-            if (libusb_open(dev, &handle) != 0)
+        void applyPowerMasks(const std::vector<PortPowerMask>& masks)
+        {
+            // Validate the whole batch first so a bad entry does not leave it half applied
+            std::vector<DeviceInfo> targets;
+            targets.reserve(masks.size());
+            for (const auto& mask : masks)
             {
-                throw std::runtime_error("Failed to open USB device");
+                targets.push_back(resolveHub(mask.deviceIndex));
+
+                if ((mask.on | mask.off) & ~PORT_MASK_ALL)
+                    throw std::out_of_range("Invalid port mask. MEGA4 has ports 1 to 4 (bits 0 to 3).");
+
+                if (mask.on & mask.off)
+                    throw std::invalid_argument("Invalid port mask. A port cannot be turned ON and OFF at once.");
             }
 
-            constexpr uint16_t feature = PORT_POWER;
-            constexpr uint8_t bmRequestType = LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER;
-            const uint8_t request = on ? LIBUSB_REQUEST_SET_FEATURE : LIBUSB_REQUEST_CLEAR_FEATURE;
+            std::string failures;
+            std::vector<PendingSwitch> sentSwitches;
+            const auto sent = std::chrono::steady_clock::now();
 
-            const int ret = libusb_control_transfer(handle,
-                                                    bmRequestType,
-                                                    request,
-                                                    feature,
-                                                    mega4PortNumber,
-                                                    nullptr,
-                                                    0,
-                                                    1000);
-            libusb_close(handle);
+            for (size_t i = 0; i < masks.size(); ++i)
+            {
+                const PortPowerMask& mask = masks[i];
+                const DeviceInfo& hub = targets[i];
 
-            if (ret < 0)
+                // One hub locked at a time, so batches listing hubs in any order cannot deadlock
+                const auto writeLock = hubs.writeLock(hub.busPortPath);
+                std::lock_guard lock(*writeLock);
+                for (int port = 1; port <= 4; ++port)
+                {
+                    const uint8_t bit = 1u << (port - 1);
+                    if (!((mask.on | mask.off) & bit))
+                        continue;
+
+                    if (sendPowerRequest(hub.busPortPath, port, (mask.on & bit) != 0) < 0)
+                    {
+                        failures += (failures.empty() ? "" : ", ") + std::string("hub ") +
+                            std::to_string(mask.deviceIndex) + " port " + std::to_string(port);
+                    }
+                    else
+                    {
+                        updateSnapshotPort(hub.busPortPath, port, (mask.on & bit) != 0);
+                        hintPortChange(hub.busPortPath, port);
+                        sentSwitches.push_back({hub, port, (mask.on & bit) != 0});
+                    }
+                }
+            }
+
+            // One wait for the whole batch instead of one per port
+            std::string notSwitched;
+            if (!sentSwitches.empty())
             {
-                throw std::runtime_error("Failed to send control transfer to MEGA4");
+                try
+                {
+                    waitForSwitch(std::move(sentSwitches), sent);
+                }
+                catch (const std::runtime_error& ex)
+                {
+                    notSwitched = ex.what();
+                }
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (!failures.empty())
+                throw std::runtime_error("Failed to send control transfer to MEGA4 (" + failures + ")");
+            if (!notSwitched.empty())
+                throw std::runtime_error(notSwitched);
         }
 
-        [[nodiscard]] std::array<bool, 4> getPortStates(const int deviceIndex) const
+        [[nodiscard]] uint64_t snapshotGeneration(const std::string& path)
         {
-            std::array<bool, 4> states{false, false, false, false};
+            std::lock_guard lock(snapshotMutex);
+            return snapshots[path].generation;
+        }
+
+        /**
+         * @brief Stores a full hardware read of a hub's ports as its current snapshot, unless
+         *        the snapshot changed since readGeneration: a power request or status change
+         *        recorded during the read is newer than the read.
+         */
+        void storeSnapshot(const std::string& path, const std::array<bool, 4>& states, const uint64_t readGeneration)
+        {
+            std::lock_guard lock(snapshotMutex);
+            PortStateSnapshot& snapshot = snapshots[path];
+            if (snapshot.generation != readGeneration)
+                return;
+            snapshot.states = states;
+            snapshot.timestamp = std::chrono::steady_clock::now();
+            snapshot.valid = true;
+            ++snapshot.generation;
+        }
+
+        /**
+         * @brief Records a single port state learned without reading the whole hub
+         *        (own power request, status change). The snapshot age is left unchanged.
+         */
+        void updateSnapshotPort(const std::string& path, const int port, const bool on)
+        {
+            if (hubs.indexOf(path) < 0)
+                return; // removed by a rescan meanwhile; do not bring its snapshot back
+
+            std::lock_guard lock(snapshotMutex);
+            PortStateSnapshot& snapshot = snapshots[path];
+            if (!snapshot.valid)
+            {
+                ++snapshot.generation; // a first read still in progress may predate this state
+            }
+            else if (snapshot.states[port - 1] != on)
+            {
+                snapshot.states[port - 1] = on;
+                ++snapshot.generation;
+            }
+        }
+
+        void invalidateSnapshot(const std::string& path)
+        {
+            std::lock_guard lock(snapshotMutex);
+            snapshots[path].valid = false;
+            ++snapshots[path].generation;
+        }
 
-            if (deviceIndex >= static_cast<int>(mega4Devices.size()))
-                throw std::out_of_range("Invalid hub index");
+        /**
+         * @brief Returns the snapshot of a hub, reading the hardware first if it is
+         *        missing, older than the TTL, or a hardware read is forced.
+         */
+        PortStateSnapshot getSnapshot(const int deviceIndex, const bool forceHardwareRead)
+        {
+            const DeviceInfo hub = resolveHub(deviceIndex);
+            const std::string& path = hub.busPortPath;
 
-            libusb_device* dev = mega4Devices[deviceIndex];
-            libusb_device_handle* handle = nullptr;
-            if (libusb_open(dev, &handle) != 0)
-                throw std::runtime_error("Failed to open USB device");
+            if (!forceHardwareRead && stateCacheTtl.count() > 0)
+            {
+                std::lock_guard lock(snapshotMutex);
+                const PortStateSnapshot& snapshot = snapshots[path];
+                if (snapshot.valid && std::chrono::steady_clock::now() - snapshot.timestamp < stateCacheTtl)
+                    return snapshot;
+            }
+
+            const uint64_t readGeneration = snapshotGeneration(path);
+            const auto states = readPortStates(hub);
+            storeSnapshot(path, states, readGeneration);
+
+            std::lock_guard lock(snapshotMutex);
+            PortStateSnapshot snapshot = snapshots[path];
+            if (!snapshot.valid)
+                snapshot.states = states; // dropped, and nothing newer to report: the read is all there is
+            return snapshot;
+        }
+
+        /**
+         * @brief Reads GET_STATUS for all four ports of a hub.
+         *        Ports that cannot be read are reported with valid = false.
+         */
+        [[nodiscard]] std::array<PortStatus, 4> readPortStatus(const DeviceInfo& hub)
+        {
+            std::array<PortStatus, 4> statuses{};
+            const bool superSpeedHub = isSuperSpeedHub(hub);
 
             for (int port = 1; port <= 4; ++port)
             {
-                uint8_t status[4] = {0};
-                const int ret = libusb_control_transfer(
-                    handle,
-                    LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER,
+                uint8_t data[4] = {0};
+                const int ret = controlTransfer(
+                    hub.busPortPath,
+                    GET_PORT_STATUS_REQUEST_TYPE,
                     LIBUSB_REQUEST_GET_STATUS,
                     0,
                     port,
-                    status,
-                    sizeof(status),
-                    1000
+                    data,
+                    sizeof(data)
                 );
 
                 if (ret == 4)
                 {
-                    const auto wPortStatus = static_cast<uint16_t>(status[0] | (status[1] << 8));
-                    states[port - 1] = (wPortStatus & 0x0100) != 0; // Bit 8 = PORT_POWER
+                    statuses[port - 1] = decodePortStatus(port, data, superSpeedHub);
                 }
                 else
                 {
-                    std::cerr << "Warning: failed to get port " << port << " status (ret=" << ret << ")\n";
+                    statuses[port - 1].portNumber = port;
+                    UUGEAR_MEGA4_LOG_WARNING("failed to get port " << port << " status (ret=" << ret << ")");
                 }
             }
 
-            libusb_close(handle);
+            return statuses;
+        }
+
+        /**
+         * @brief Reads the power state of all four ports of a hub.
+         * @throws std::runtime_error if a port cannot be read, rather than reporting it OFF.
+         */
+        [[nodiscard]] std::array<bool, 4> readPortStates(const DeviceInfo& hub)
+        {
+            std::array<bool, 4> states{false, false, false, false};
+            if (sysfs && sysfs->readPortPower(hub.busPortPath, states))
+                return states;
+
+            const auto statuses = readPortStatus(hub);
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!statuses[i].valid)
+                    throw std::runtime_error("Failed to read the status of port " + std::to_string(i + 1) +
+                        " of MEGA4 hub " + hub.busPortPath);
+                states[i] = statuses[i].powered;
+            }
             return states;
         }
 
-        [[nodiscard]] std::vector<PortConnectionInfo> getPortConnections(const int deviceIndex) const
+        /**
+         * @brief Reads the full port status of a hub; the power bits also refresh its snapshot.
+         */
+        std::array<PortStatus, 4> getPortStatus(const int deviceIndex)
         {
-            std::vector<PortConnectionInfo> ports(4);
+            const DeviceInfo hub = resolveHub(deviceIndex);
+            const uint64_t readGeneration = snapshotGeneration(hub.busPortPath);
+            const auto statuses = readPortStatus(hub);
+
+            std::array<bool, 4> states{false, false, false, false};
+            bool complete = true;
             for (int i = 0; i < 4; ++i)
-                ports[i].portNumber = i + 1;
+            {
+                states[i] = statuses[i].powered;
+                complete &= statuses[i].valid;
+            }
+            if (complete)
+                storeSnapshot(hub.busPortPath, states, readGeneration);
 
-            if (deviceIndex >= static_cast<int>(mega4Devices.size()))
-                throw std::out_of_range("Invalid hub index. Tried to access hub " + std::to_string(deviceIndex) +
-                    " but only " + std::to_string(mega4Devices.size()) + " hubs are available.");
+            return statuses;
+        }
+
+        /**
+         * @brief Queues a control transfer to a hub without blocking. If the transfer cannot
+         *        be submitted, done is invoked right away on the calling thread with the error code.
+         */
+        void submitControlTransfer(const std::string& path, const uint8_t bmRequestType, const uint8_t bRequest,
+                                   const uint16_t wValue, const uint16_t wIndex, const uint16_t wLength,
+                                   const UsbTransport::Completion& done)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const int ret = transport->submitControl(
+                path, bmRequestType, bRequest, wValue, wIndex, wLength, CONTROL_TIMEOUT_MS,
+                [this, start, done](const int result, const uint8_t* data, const int length)
+                {
+                    histogram(Operation::AsyncControlTransfer).record(std::chrono::steady_clock::now() - start,
+                                                                      result < 0);
+                    countTransfer(result);
+                    done(result, data, length);
+                });
+            if (ret != 0)
+            {
+                countTransfer(ret);
+                done(ret, nullptr, 0);
+            }
+        }
+
+        void togglePowerAsync(const int deviceIndex, const int port, const bool on, Mega4Hub::PowerCallback done)
+        {
+            const std::string path = resolveHub(deviceIndex).busPortPath;
+
+            if (port < 1 || port > 4)
+                throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
+
+            submitControlTransfer(path,
+                                  LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER,
+                                  on ? LIBUSB_REQUEST_SET_FEATURE : LIBUSB_REQUEST_CLEAR_FEATURE,
+                                  PORT_POWER,
+                                  port,
+                                  0,
+                                  [this, path, port, on, done = std::move(done),
+                                      start = std::chrono::steady_clock::now()](
+                                  const int result, const uint8_t*, int)
+                                  {
+                                      histogram(Operation::PowerAsync).record(
+                                          std::chrono::steady_clock::now() - start, result < 0);
+                                      if (result >= 0)
+                                          updateSnapshotPort(path, port, on);
+                                      done(result < 0
+                                               ? transferError("Failed to send control transfer to MEGA4", result)
+                                               : nullptr);
+                                  });
+        }
+
+        /**
+         * @brief Runs each cycle as a plan of two steps on the power scheduler: OFF, then ON
+         *        once the OFF request completed and offTime has passed since it was sent.
+         */
+        void powerCycle(const Mega4Hub& owner, const std::vector<PortPowerCycle>& cycles,
+                        Mega4Hub::PowerCallback done)
+        {
+            std::vector<PowerPlan> plans;
+            for (const auto& cycle : cycles)
+            {
+                // Addressed by path so the cycle follows the hub if its index moves meanwhile
+                const std::string path = resolveHub(cycle.deviceIndex).busPortPath;
+                if (cycle.port < 1 || cycle.port > 4)
+                    throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
+
+                PowerPlan plan;
+                plan.steps = {{path, cycle.port, false}, {path, cycle.port, true}};
+                plan.spacing = cycle.offTime;
+                plan.maxConcurrent = 1;
+                plan.settleTime = std::chrono::milliseconds(0);
+                plans.push_back(std::move(plan));
+            }
+
+            // Shared by the plans; the last one to end reports the result
+            struct Pending
+            {
+                std::mutex mutex;
+                size_t remaining = 0;
+                std::string failures;
+                Mega4Hub::PowerCallback done;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            };
+            if (plans.empty())
+            {
+                done(nullptr);
+                return;
+            }
+            auto pending = std::make_shared<Pending>();
+            pending->remaining = plans.size();
+            pending->done = std::move(done);
+
+            std::call_once(schedulerStarted, [&] { scheduler = std::make_unique<PowerScheduler>(owner); });
+
+            for (size_t i = 0; i < plans.size(); ++i)
+            {
+                scheduler->submit(std::move(plans[i]), [this, pending, cycle = cycles[i]](const PowerPlanResult& result)
+                {
+                    std::string failures;
+                    {
+                        std::lock_guard lock(pending->mutex);
+                        if (!result.ok())
+                        {
+                            pending->failures += (pending->failures.empty() ? "" : ", ") + std::string("hub ") +
+                                std::to_string(cycle.deviceIndex) + " port " + std::to_string(cycle.port) +
+                                (result.cancelled ? " cancelled" : "");
+                        }
+                        if (--pending->remaining > 0)
+                            return;
+                        failures = pending->failures;
+                    }
+
+                    histogram(Operation::PowerCycle).record(std::chrono::steady_clock::now() - pending->start,
+                                                            !failures.empty());
+                    pending->done(failures.empty()
+                                      ? nullptr
+                                      : std::make_exception_ptr(
+                                          std::runtime_error("Power cycle failed (" + failures + ")")));
+                });
+            }
+        }
 
-            const libusb_device* hubDev = mega4Devices[deviceIndex];
+        void getPortStatesAsync(const int deviceIndex, Mega4Hub::PortStatesCallback done)
+        {
+            const DeviceInfo hub = resolveHub(deviceIndex);
+            const std::string& path = hub.busPortPath;
+            const bool superSpeedHub = isSuperSpeedHub(hub);
+
+            // Shared by the four GET_STATUS transfers; the last one to finish reports the result
+            struct Pending
+            {
+                std::array<bool, 4> states{false, false, false, false};
+                std::atomic<int> remaining{4};
+                std::atomic<int> error{0};
+                uint64_t readGeneration = 0;
+                Mega4Hub::PortStatesCallback done;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            };
+            auto pending = std::make_shared<Pending>();
+            pending->done = std::move(done);
+            pending->readGeneration = snapshotGeneration(path);
+
+            for (int port = 1; port <= 4; ++port)
+            {
+                submitControlTransfer(
+                    path, GET_PORT_STATUS_REQUEST_TYPE, LIBUSB_REQUEST_GET_STATUS, 0, port, 4,
+                    [this, path, pending, port, superSpeedHub](const int result, const uint8_t* data, int)
+                    {
+                        if (result == 4)
+                        {
+                            pending->states[port - 1] = decodePortStatus(port, data, superSpeedHub).powered;
+                        }
+                        else
+                        {
+                            UUGEAR_MEGA4_LOG_WARNING("failed to get port " << port << " status (ret=" << result << ")");
+                            // Any failed port fails the query; a short read has no libusb code of its own
+                            int none = 0;
+                            pending->error.compare_exchange_strong(none, result < 0 ? result : LIBUSB_ERROR_IO);
+                        }
+
+                        if (--pending->remaining == 0)
+                        {
+                            const int error = pending->error;
+                            histogram(Operation::GetPortStatesAsync).record(
+                                std::chrono::steady_clock::now() - pending->start, error != 0);
+                            if (!error)
+                                storeSnapshot(path, pending->states, pending->readGeneration);
+                            pending->done(pending->states,
+                                          error ? transferError("Failed to read MEGA4 port status", error) : nullptr);
+                        }
+                    });
+            }
+        }
 
+        /**
+         * @brief Starts the hotplug monitor if needed. Caller holds subscribersMutex.
+         */
+        void ensureHotplugMonitor()
+        {
+            if (hotplugMonitor)
+                return;
+
+            if (!libusb)
+                throw std::runtime_error("Port events require the libusb transport");
+            libusb_context* ctx = libusb->context();
+
+            // Remember what is already connected so its removal can be reported too
             libusb_device** list = nullptr;
             const ssize_t cnt = libusb_get_device_list(ctx, &list);
-            if (cnt < 0)
-                return ports;
-
+            topology.rebuild(list, cnt);
             for (ssize_t i = 0; i < cnt; ++i)
             {
-                libusb_device* dev = list[i];
-                const libusb_device* parent = libusb_get_parent(dev);
-                if (parent != hubDev) continue;
-
+                PortEvent event;
                 libusb_device_descriptor desc{};
-                if (libusb_get_device_descriptor(dev, &desc) != 0)
-                    continue;
+                if (!connectedPorts.count(list[i]) && libusb_get_device_descriptor(list[i], &desc) == 0 &&
+                    resolvePortEvent(list[i], desc, event))
+                    connectedPorts.emplace(libusb_ref_device(list[i]), event);
+            }
+            if (cnt >= 0) libusb_free_device_list(list, 1);
+
+            hotplugMonitor = std::make_unique<HotplugMonitor>(
+                ctx, [this](libusb_device* dev, const bool arrived) { onHotplug(dev, arrived); });
+            libusb->engine().startEventThread(); // hotplug callbacks are delivered while handling libusb events
+        }
+
+        int subscribePortEvents(Mega4Hub::PortEventCallback callback)
+        {
+            std::lock_guard lock(subscribersMutex);
+            ensureHotplugMonitor();
+
+            const int id = nextSubscriptionId++;
+            subscribers.emplace(id, std::move(callback));
+            return id;
+        }
+
+        int subscribePortStatus(Mega4Hub::PortStatusCallback callback)
+        {
+            std::lock_guard lock(subscribersMutex);
+
+            if (!statusListening)
+            {
+                statusListening = true;
+                startStatusListeners(hubs.devices());
+            }
+
+            const int id = nextSubscriptionId++;
+            statusSubscribers.emplace(id, std::move(callback));
+            return id;
+        }
+
+        /**
+         * @brief Starts the status listeners of some hubs, and the hotplug monitor if any of
+         *        them runs in hint mode. Caller holds subscribersMutex.
+         */
+        void startStatusListeners(const std::vector<DeviceInfo>& hubInfos)
+        {
+            bool hintMode = false;
+            for (const auto& info : hubInfos)
+                hintMode |= !startStatusListener(info);
+
+            // Hubs owned by the kernel driver learn about connects/disconnects from hotplug instead
+            if (hintMode && libusb)
+            {
+                try
+                {
+                    ensureHotplugMonitor();
+                }
+                catch (const std::runtime_error& ex)
+                {
+                    UUGEAR_MEGA4_LOG_WARNING("port status changes limited to own power requests (" << ex.what()
+                        << ")");
+                }
+            }
+        }
+
+        /**
+         * @brief Creates and starts the status listener of a hub. Caller holds subscribersMutex.
+         *        A hub that cannot be opened a second time is left without one, so that
+         *        hintPortChange() reads its ports through the transport.
+         * @return False if the hub's ports are only re-read on hints.
+         */
+        bool startStatusListener(const DeviceInfo& hub)
+        {
+            const std::string& hubPath = hub.busPortPath;
+            // Without libusb (simulation), hintPortChange() reads the port through the transport instead
+            if (!libusb)
+                return false;
+
+            libusb_device* dev = libusb->device(hubPath);
+            if (!dev)
+                return true;
+
+            std::unique_ptr<StatusChangeListener> listener;
+            try
+            {
+                listener = std::make_unique<StatusChangeListener>(
+                    libusb->engine(), dev, isSuperSpeedHub(hub),
+                    [this, hubPath](const int port, const uint16_t wPortStatus, const uint16_t wPortChange)
+                    {
+                        onPortStatus(hubPath, port, wPortStatus, wPortChange);
+                    });
+            }
+            catch (const std::runtime_error& ex)
+            {
+                UUGEAR_MEGA4_LOG_WARNING("no status listener for hub " << hubPath << ", its ports are re-read on hints ("
+                    << ex.what() << ")");
+                return false;
+            }
+            const bool listening = listener->start();
+            statusListeners[hubPath] = std::move(listener);
+            return listening;
+        }
 
-                const uint8_t port = libusb_get_port_number(dev);
-                if (port < 1 || port > 4)
-                    continue;
+        /**
+         * @brief Asks the status listener of a hub to re-read one port, or reads it through
+         *        the transport for a hub without one.
+         */
+        void hintPortChange(const std::string& path, const int port)
+        {
+            if (hubs.indexOf(path) < 0)
+                return;
 
-                PortConnectionInfo& info = ports[port - 1];
-                info.hasDevice = true;
-                info.vid = desc.idVendor;
-                info.pid = desc.idProduct;
+            {
+                std::lock_guard lock(subscribersMutex);
+                if (const auto it = statusListeners.find(path); it != statusListeners.end())
+                {
+                    it->second->refreshPort(port);
+                    return;
+                }
+                if (!statusListening)
+                    return;
+            }
+
+            submitControlTransfer(path, GET_PORT_STATUS_REQUEST_TYPE, LIBUSB_REQUEST_GET_STATUS, 0, port, 4,
+                                  [this, path, port](const int result, const uint8_t* data, int)
+                                  {
+                                      if (result == 4)
+                                          onPortStatus(path, port, static_cast<uint16_t>(data[0] | (data[1] << 8)),
+                                                       static_cast<uint16_t>(data[2] | (data[3] << 8)));
+                                  });
+        }
+
+        /**
+         * @brief Dispatches a port status read by a status listener. Runs on the libusb event thread.
+         */
+        void onPortStatus(const std::string& hubPath, const int port, const uint16_t wPortStatus,
+                          const uint16_t wPortChange)
+        {
+            DeviceInfo hub;
+            const int deviceIndex = hubs.find(hubPath, hub);
+            if (deviceIndex < 0)
+                return; // hub removed by a rescan while the read was in flight
 
-                libusb_device_handle* handle = nullptr;
+            PortStatusChange change;
+            change.deviceIndex = deviceIndex;
+            change.portNumber = port;
+            change.wPortStatus = wPortStatus;
+            change.wPortChange = wPortChange;
 
-                if (libusb_open(dev, &handle) != 0) continue;
+            const uint8_t data[4] = {
+                static_cast<uint8_t>(wPortStatus), static_cast<uint8_t>(wPortStatus >> 8),
+                static_cast<uint8_t>(wPortChange), static_cast<uint8_t>(wPortChange >> 8)
+            };
+            change.status = decodePortStatus(port, data, isSuperSpeedHub(hub));
+            change.powered = change.status.powered;
+            updateSnapshotPort(hubPath, port, change.powered);
+
+            std::vector<Mega4Hub::PortStatusCallback> callbacks;
+            std::optional<DispatchTracker::Scope> dispatch;
+            {
+                std::lock_guard lock(subscribersMutex);
+                for (const auto& [id, callback] : statusSubscribers)
+                    callbacks.push_back(callback);
+                dispatch.emplace(dispatches, subscribersMutex);
+            }
+            for (const auto& callback : callbacks)
+                callback(change);
+        }
+
+        void unsubscribePortEvents(const int subscriptionId)
+        {
+            std::unique_lock lock(subscribersMutex);
+            subscribers.erase(subscriptionId);
+            dispatches.waitForEarlier(lock);
+        }
+
+        void unsubscribePortStatus(const int subscriptionId)
+        {
+            std::unique_lock lock(subscribersMutex);
+            statusSubscribers.erase(subscriptionId);
+            dispatches.waitForEarlier(lock);
+        }
+
+        /**
+         * @brief Fills a connect event for a device if it sits on a downstream port of a known MEGA4.
+         * @return False if the device is not connected to a MEGA4 port.
+         */
+        bool resolvePortEvent(libusb_device* dev, const libusb_device_descriptor& desc, PortEvent& event)
+        {
+            libusb_device* parent = libusb_get_parent(dev);
+            DeviceInfo hub;
+            event.deviceIndex = parent ? hubs.find(LibusbTransport::busPortPath(parent), hub) : -1;
 
-                unsigned char buf[256];
-                if (desc.iManufacturer &&
-                    libusb_get_string_descriptor_ascii(handle, desc.iManufacturer, buf, sizeof(buf)) > 0)
-                    info.manufacturer = reinterpret_cast<char*>(buf);
+            const uint8_t port = libusb_get_port_number(dev);
+            if (event.deviceIndex < 0 || port < 1 || port > 4)
+                return false;
+
+            event.connected = true;
+            event.hubPath = hub.busPortPath;
+            event.port.portNumber = port;
+            describePortDevice(dev, desc, event.port, descriptorCache);
+            return true;
+        }
+
+        /**
+         * @brief Resolves a hotplug notification to a MEGA4 hub and port and dispatches it.
+         *        Runs on the hotplug dispatch thread.
+         */
+        void onHotplug(libusb_device* dev, const bool arrived)
+        {
+            if (arrived)
+            {
+                topology.add(dev);
+            }
+            else
+            {
+                topology.remove(dev);
+                descriptorCache.invalidate(dev);
+            }
+
+            libusb_device_descriptor desc{};
+            if (libusb_get_device_descriptor(dev, &desc) != 0)
+                return;
+
+            // A MEGA4 that left can no longer use its pooled handle; it is reattached on next use
+            if (isMega4(desc.idVendor, desc.idProduct))
+            {
+                if (!arrived) libusb->invalidate(dev);
+                return;
+            }
+
+            PortEvent event;
+
+            if (arrived)
+            {
+                if (!resolvePortEvent(dev, desc, event))
+                    return; // not attached to a MEGA4 downstream port
+
+                connectedPorts.emplace(libusb_ref_device(dev), event);
+            }
+            else
+            {
+                // Strings cannot be read any more, report what was seen at arrival
+                const auto it = connectedPorts.find(dev);
+                if (it == connectedPorts.end())
+                    return;
+
+                event = it->second;
+                event.deviceIndex = hubs.indexOf(event.hubPath); // may have moved since the arrival
+                event.connected = false;
+                libusb_unref_device(it->first);
+                connectedPorts.erase(it);
+            }
+
+            hintPortChange(event.hubPath, event.port.portNumber);
+
+            std::vector<Mega4Hub::PortEventCallback> callbacks;
+            std::optional<DispatchTracker::Scope> dispatch;
+            {
+                std::lock_guard lock(subscribersMutex);
+                for (const auto& [id, callback] : subscribers)
+                    callbacks.push_back(callback);
+                dispatch.emplace(dispatches, subscribersMutex);
+            }
+            for (const auto& callback : callbacks)
+                callback(event);
+        }
 
-                if (desc.iProduct &&
-                    libusb_get_string_descriptor_ascii(handle, desc.iProduct, buf, sizeof(buf)) > 0)
-                    info.product = reinterpret_cast<char*>(buf);
+        /**
+         * @brief Makes sure the topology index reflects the bus. While the hotplug monitor
+         *        runs it is updated incrementally; without hotplug support it is rebuilt
+         *        from one enumeration on every call.
+         */
+        void refreshTopology()
+        {
+            {
+                std::lock_guard lock(subscribersMutex);
+                if (hotplugMonitor)
+                    return;
 
-                libusb_close(handle);
+                if (!hotplugUnavailable)
+                {
+                    try
+                    {
+                        ensureHotplugMonitor(); // seeds the index from its initial enumeration
+                        return;
+                    }
+                    catch (const std::runtime_error&)
+                    {
+                        hotplugUnavailable = true;
+                    }
+                }
             }
 
+            libusb_device** list = nullptr;
+            const ssize_t cnt = libusb_get_device_list(libusb->context(), &list);
+            if (cnt < 0)
+                return;
+            topology.rebuild(list, cnt);
+            descriptorCache.retain(list, cnt); // no departure events to drop entries one by one
             libusb_free_device_list(list, 1);
+        }
+
+        [[nodiscard]] std::vector<PortConnectionInfo> getPortConnections(const int deviceIndex)
+        {
+            std::vector<PortConnectionInfo> ports(4);
+            for (int i = 0; i < 4; ++i)
+                ports[i].portNumber = i + 1;
+
+            const std::string path = resolveHub(deviceIndex).busPortPath;
+            if ((sysfs && sysfs->readPortConnections(path, ports)) || transport->readPortConnections(path, ports) ||
+                !libusb)
+                return ports;
+
+            refreshTopology();
+
+            for (const auto& [port, dev] : topology.children(libusb->device(path)))
+            {
+                libusb_device_descriptor desc{};
+                if (port >= 1 && port <= 4 && libusb_get_device_descriptor(dev, &desc) == 0)
+                    describePortDevice(dev, desc, ports[port - 1], descriptorCache);
+                libusb_unref_device(dev);
+            }
+
             return ports;
         }
     };
 
-    Mega4Hub::Mega4Hub() : pImpl(new Impl)
+    Mega4Hub::Mega4Hub() : pImpl(new Impl(Mega4HubOptions{}))
+    {
+    }
+
+    Mega4Hub::Mega4Hub(const Mega4HubOptions& options) : pImpl(new Impl(options))
+    {
+    }
+
+    Mega4Hub::Mega4Hub(NoBackend) : pImpl(nullptr)
     {
     }
 
     Mega4Hub::~Mega4Hub() { delete pImpl; }
 
-    std::vector<DeviceInfo> Mega4Hub::listDevices() const { return pImpl->list(); }
+    std::vector<DeviceInfo> Mega4Hub::listDevices() const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::ListDevices));
+        return pImpl->list();
+    }
+
+    HubChanges Mega4Hub::rescanDevices() const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::RescanDevices));
+        return pImpl->rescan();
+    }
+
+    std::vector<DeviceInfo> Mega4Hub::knownDevices() const
+    {
+        return pImpl->hubs.devices();
+    }
+
+    int Mega4Hub::deviceIndexOf(const std::string& busPortPath) const
+    {
+        return pImpl->hubs.indexOf(busPortPath);
+    }
+
+    std::array<bool, 4> Mega4Hub::getPortStates(const int deviceIndex, const bool forceHardwareRead) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::GetPortStates));
+        return pImpl->getSnapshot(deviceIndex, forceHardwareRead).states;
+    }
+
+    PortStateSnapshot Mega4Hub::getPortStateSnapshot(const int deviceIndex, const bool forceHardwareRead) const
+    {
+        return pImpl->getSnapshot(deviceIndex, forceHardwareRead);
+    }
+
+    std::array<PortStatus, 4> Mega4Hub::getPortStatus(const int deviceIndex) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::GetPortStatus));
+        return pImpl->getPortStatus(deviceIndex);
+    }
+
+    std::vector<PortConnectionInfo> Mega4Hub::getPortConnections(const int deviceIndex) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::GetPortConnections));
+        return pImpl->getPortConnections(deviceIndex);
+    }
+
+    std::chrono::microseconds Mega4Hub::powerOn(const int port, const int deviceIndex) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::PowerOn));
+        return pImpl->togglePower(deviceIndex, port, true);
+    }
 
-    std::array<bool, 4> Mega4Hub::getPortStates(const int deviceIndex) const
+    std::chrono::microseconds Mega4Hub::powerOff(const int port, const int deviceIndex) const
     {
-        return pImpl->getPortStates(deviceIndex);
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::PowerOff));
+        return pImpl->togglePower(deviceIndex, port, false);
     }
 
-    std::vector<PortConnectionInfo>
-    Mega4Hub::getPortConnections(const int deviceIndex) const { return pImpl->getPortConnections(deviceIndex); }
+    void Mega4Hub::applyPowerMask(const uint8_t onMask, const uint8_t offMask, const int deviceIndex) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::ApplyPowerMasks));
+        pImpl->applyPowerMasks({PortPowerMask{deviceIndex, onMask, offMask}});
+    }
 
-    void Mega4Hub::powerOn(const int port, const int deviceIndex) const { pImpl->togglePower(deviceIndex, port, true); }
+    void Mega4Hub::applyPowerMasks(const std::vector<PortPowerMask>& masks) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::ApplyPowerMasks));
+        pImpl->applyPowerMasks(masks);
+    }
+
+    std::future<void> Mega4Hub::powerOnAsync(const int port, const int deviceIndex) const
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future = promise->get_future();
+        powerOnAsync(port, deviceIndex, [promise](const std::exception_ptr& error)
+        {
+            if (error) promise->set_exception(error);
+            else promise->set_value();
+        });
+        return future;
+    }
 
-    void Mega4Hub::powerOff(const int port, const int deviceIndex) const
+    std::future<void> Mega4Hub::powerOffAsync(const int port, const int deviceIndex) const
     {
-        pImpl->togglePower(deviceIndex, port, false);
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future = promise->get_future();
+        powerOffAsync(port, deviceIndex, [promise](const std::exception_ptr& error)
+        {
+            if (error) promise->set_exception(error);
+            else promise->set_value();
+        });
+        return future;
     }
 
-    bool Mega4Hub::isPortOn(const int port, const int deviceIndex) const
+    std::future<std::array<bool, 4>> Mega4Hub::getPortStatesAsync(const int deviceIndex) const
     {
-        const auto states = pImpl->getPortStates(deviceIndex);
+        auto promise = std::make_shared<std::promise<std::array<bool, 4>>>();
+        auto future = promise->get_future();
+        getPortStatesAsync(deviceIndex, [promise](const std::array<bool, 4>& states, const std::exception_ptr& error)
+        {
+            if (error) promise->set_exception(error);
+            else promise->set_value(states);
+        });
+        return future;
+    }
+
+    void Mega4Hub::powerOnAsync(const int port, const int deviceIndex, PowerCallback done) const
+    {
+        pImpl->togglePowerAsync(deviceIndex, port, true, std::move(done));
+    }
+
+    void Mega4Hub::powerOffAsync(const int port, const int deviceIndex, PowerCallback done) const
+    {
+        pImpl->togglePowerAsync(deviceIndex, port, false, std::move(done));
+    }
+
+    void Mega4Hub::getPortStatesAsync(const int deviceIndex, PortStatesCallback done) const
+    {
+        pImpl->getPortStatesAsync(deviceIndex, std::move(done));
+    }
+
+    std::future<void> Mega4Hub::powerCycle(const int port, const std::chrono::milliseconds offTime,
+                                           const int deviceIndex) const
+    {
+        return powerCycle({PortPowerCycle{deviceIndex, port, offTime}});
+    }
+
+    std::future<void> Mega4Hub::powerCycle(const std::vector<PortPowerCycle>& cycles) const
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future = promise->get_future();
+        powerCycle(cycles, [promise](const std::exception_ptr& error)
+        {
+            if (error) promise->set_exception(error);
+            else promise->set_value();
+        });
+        return future;
+    }
+
+    void Mega4Hub::powerCycle(const std::vector<PortPowerCycle>& cycles, PowerCallback done) const
+    {
+        pImpl->powerCycle(*this, cycles, std::move(done));
+    }
+
+    int Mega4Hub::subscribePortEvents(PortEventCallback callback) const
+    {
+        return pImpl->subscribePortEvents(std::move(callback));
+    }
+
+    void Mega4Hub::unsubscribePortEvents(const int subscriptionId) const
+    {
+        pImpl->unsubscribePortEvents(subscriptionId);
+    }
+
+    int Mega4Hub::subscribePortStatus(PortStatusCallback callback) const
+    {
+        return pImpl->subscribePortStatus(std::move(callback));
+    }
+
+    void Mega4Hub::unsubscribePortStatus(const int subscriptionId) const
+    {
+        pImpl->unsubscribePortStatus(subscriptionId);
+    }
+
+    bool Mega4Hub::isPortOn(const int port, const int deviceIndex, const bool forceHardwareRead) const
+    {
+        const LatencyHistogram::Timer timer(pImpl->histogram(Operation::IsPortOn));
         if (port < 1 || port > 4)
             throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
-        return states[port - 1];
+        return pImpl->getSnapshot(deviceIndex, forceHardwareRead).states[port - 1];
     }
+
+    MetricsSnapshot Mega4Hub::metrics() const { return pImpl->metrics(); }
 }
@@ -0,0 +1,526 @@
+#include "UUGear/Mega4/Mega4Server.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Logger.hpp"
+#include "DaemonProtocol.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace UUGear::Mega4
+{
+    // Clients waiting to be accepted
+    constexpr int LISTEN_BACKLOG = 64;
+
+    namespace
+    {
+        /**
+         * @brief One client. Frames are queued by send() and written by the connection's own
+         *        writer thread, so the threads producing them (libusb events, hotplug dispatch,
+         *        workers) never block on a client that does not read its socket.
+         */
+        struct Connection
+        {
+            explicit Connection(const int fd) : socket(fd), writer([this] { write(); }) {}
+
+            ~Connection() { stop(); }
+
+            Connection(const Connection&) = delete;
+            Connection& operator=(const Connection&) = delete;
+
+            /**
+             * @brief Queues a frame without blocking. A client that lets more than
+             *        Mega4Server::MAX_PENDING_BYTES pile up is disconnected.
+             */
+            void send(const std::vector<uint8_t>& frame)
+            {
+                bool overflow;
+                {
+                    std::lock_guard lock(mutex);
+                    if (stopping || broken)
+                        return;
+                    overflow = !outbox.empty() && outbox.size() + frame.size() > Mega4Server::MAX_PENDING_BYTES;
+                    if (overflow)
+                    {
+                        broken = true;
+                        outbox.clear();
+                    }
+                    else
+                    {
+                        outbox.insert(outbox.end(), frame.begin(), frame.end());
+                    }
+                }
+                if (overflow)
+                {
+                    UUGEAR_MEGA4_LOG_WARNING("mega4d: disconnecting a client that does not read its responses");
+                    socket.shutdown(); // ends its reader thread
+                    return;
+                }
+                wake.notify_one();
+            }
+
+            /**
+             * @brief Stops the writer thread; frames not written yet are dropped.
+             */
+            void stop()
+            {
+                {
+                    std::lock_guard lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_one();
+                if (writer.joinable())
+                    writer.join();
+            }
+
+            FrameSocket socket;
+            std::atomic<bool> portEvents{false}; ///< Subscribed to PortEvent pushes
+            std::atomic<bool> portStatus{false}; ///< Subscribed to PortStatusChange pushes
+            std::atomic<bool> closed{false}; ///< The reader thread has ended
+
+        private:
+            void write()
+            {
+                std::unique_lock lock(mutex);
+                while (true)
+                {
+                    wake.wait(lock, [this] { return stopping || !outbox.empty(); });
+                    if (stopping)
+                        return;
+                    // Everything queued so far leaves in one write
+                    std::vector<uint8_t> batch = std::move(outbox);
+                    outbox.clear();
+                    lock.unlock();
+                    const bool sent = socket.send(std::move(batch));
+                    lock.lock();
+                    if (!sent)
+                    {
+                        broken = true;
+                        outbox.clear();
+                    }
+                }
+            }
+
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::vector<uint8_t> outbox; ///< Frames not handed to the socket yet
+            bool stopping = false;
+            bool broken = false; ///< Write failed or the client fell too far behind; frames are dropped
+            std::thread writer; ///< Last: started once the rest is constructed
+        };
+
+        /**
+         * @brief Open connections; shared with the hub subscriptions, which may outlive the server briefly.
+         */
+        struct Connections
+        {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<Connection>> open;
+
+            void push(const std::vector<uint8_t>& frame, std::atomic<bool> Connection::* subscribed)
+            {
+                std::vector<std::shared_ptr<Connection>> targets;
+                {
+                    std::lock_guard lock(mutex);
+                    for (const auto& connection : open)
+                    {
+                        if ((*connection.*subscribed).load(std::memory_order_relaxed))
+                            targets.push_back(connection);
+                    }
+                }
+                // Only queued: each connection's writer thread does the blocking write
+                for (const auto& connection : targets)
+                    connection->send(frame);
+            }
+        };
+
+        std::vector<uint8_t> okFrame(const uint32_t id)
+        {
+            return FrameEncoder(id, static_cast<uint8_t>(DaemonStatus::Ok)).finish();
+        }
+
+        std::vector<uint8_t> errorFrame(const uint32_t id, const std::exception_ptr& error)
+        {
+            DaemonStatus status = DaemonStatus::RuntimeError;
+            std::string message = "Unknown error";
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const std::out_of_range& ex)
+            {
+                status = DaemonStatus::OutOfRange;
+                message = ex.what();
+            }
+            catch (const std::invalid_argument& ex)
+            {
+                status = DaemonStatus::InvalidArgument;
+                message = ex.what();
+            }
+            catch (const std::exception& ex)
+            {
+                message = ex.what();
+            }
+            catch (...)
+            {
+            }
+            FrameEncoder frame(id, static_cast<uint8_t>(status));
+            frame.str(message);
+            return frame.finish();
+        }
+    }
+
+    struct Mega4Server::Impl
+    {
+        struct Reader
+        {
+            std::shared_ptr<Connection> connection;
+            std::thread thread;
+        };
+
+        const Mega4Hub& hub;
+        std::string path;
+        int listenFd = -1;
+        std::shared_ptr<Connections> connections = std::make_shared<Connections>();
+        std::vector<Reader> readers; ///< Acceptor thread only, then the destructor
+        std::unique_ptr<ThreadPool> pool;
+        int eventSubscription = -1;
+        int statusSubscription = -1;
+        std::thread acceptor;
+
+        Impl(const Mega4Hub& hub, std::string socketPath, const size_t workers)
+            : hub(hub), path(std::move(socketPath)), pool(std::make_unique<ThreadPool>(workers))
+        {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(address.sun_path))
+                throw std::runtime_error("Invalid mega4d socket path: " + path);
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+            listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listenFd < 0)
+                throw std::runtime_error(std::string("Failed to create mega4d socket: ") + std::strerror(errno));
+            ::unlink(path.c_str()); // left behind by a daemon that did not exit cleanly
+            if (::bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+                ::listen(listenFd, LISTEN_BACKLOG) < 0)
+            {
+                const std::string reason = std::strerror(errno);
+                ::close(listenFd);
+                throw std::runtime_error("Failed to listen on " + path + ": " + reason);
+            }
+
+            subscribe();
+            acceptor = std::thread([this] { accept(); });
+        }
+
+        ~Impl()
+        {
+            ::shutdown(listenFd, SHUT_RDWR); // wakes accept() up
+            acceptor.join();
+            ::close(listenFd);
+            ::unlink(path.c_str());
+
+            if (eventSubscription >= 0)
+                hub.unsubscribePortEvents(eventSubscription);
+            if (statusSubscription >= 0)
+                hub.unsubscribePortStatus(statusSubscription);
+
+            {
+                std::lock_guard lock(connections->mutex);
+                for (const auto& connection : connections->open)
+                    connection->socket.shutdown();
+            }
+            for (auto& reader : readers)
+                reader.thread.join();
+
+            // Runs the requests already queued; their responses go nowhere
+            pool.reset();
+        }
+
+        void subscribe()
+        {
+            try
+            {
+                eventSubscription = hub.subscribePortEvents([connections = connections](const PortEvent& event)
+                {
+                    FrameEncoder frame(0, static_cast<uint8_t>(DaemonEvent::Port));
+                    frame.put(event);
+                    connections->push(frame.finish(), &Connection::portEvents);
+                });
+            }
+            catch (const std::runtime_error& ex)
+            {
+                UUGEAR_MEGA4_LOG_INFO("mega4d: port events not available (" << ex.what() << ")");
+            }
+
+            try
+            {
+                statusSubscription = hub.subscribePortStatus([connections = connections](const PortStatusChange& change)
+                {
+                    FrameEncoder frame(0, static_cast<uint8_t>(DaemonEvent::PortStatus));
+                    frame.put(change);
+                    connections->push(frame.finish(), &Connection::portStatus);
+                });
+            }
+            catch (const std::runtime_error& ex)
+            {
+                UUGEAR_MEGA4_LOG_INFO("mega4d: port status changes not available (" << ex.what() << ")");
+            }
+        }
+
+        void accept()
+        {
+            while (true)
+            {
+                const int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    return; // shut down
+                }
+
+                auto connection = std::make_shared<Connection>(fd);
+                {
+                    std::lock_guard lock(connections->mutex);
+                    connections->open.push_back(connection);
+                }
+                reap();
+                readers.push_back({connection, std::thread([this, connection] { serve(connection); })});
+            }
+        }
+
+        /**
+         * @brief Joins the reader threads of the clients that disconnected.
+         */
+        void reap()
+        {
+            for (auto it = readers.begin(); it != readers.end();)
+            {
+                if (it->connection->closed.load())
+                {
+                    it->thread.join();
+                    it = readers.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        void serve(const std::shared_ptr<Connection>& connection)
+        {
+            std::vector<uint8_t> frame;
+            while (connection->socket.receive(frame))
+            {
+                FrameDecoder request(std::move(frame));
+                const uint32_t id = request.id();
+                try
+                {
+                    dispatch(connection, request);
+                }
+                catch (...)
+                {
+                    connection->send(errorFrame(id, std::current_exception()));
+                }
+            }
+
+            {
+                std::lock_guard lock(connections->mutex);
+                auto& open = connections->open;
+                for (auto it = open.begin(); it != open.end(); ++it)
+                {
+                    if (*it == connection)
+                    {
+                        open.erase(it);
+                        break;
+                    }
+                }
+            }
+            connection->stop();
+            connection->closed.store(true);
+        }
+
+        /**
+         * @brief Starts a request: requests the hub can answer asynchronously and
+         *        subscriptions are handled here, everything else on the pool.
+         */
+        void dispatch(const std::shared_ptr<Connection>& connection, FrameDecoder& request)
+        {
+            const uint32_t id = request.id();
+            switch (static_cast<DaemonOp>(request.code()))
+            {
+            case DaemonOp::PowerOnAsync:
+            case DaemonOp::PowerOffAsync:
+                {
+                    const int port = request.i32();
+                    const int deviceIndex = request.i32();
+                    auto done = [connection, id](const std::exception_ptr& error)
+                    {
+                        connection->send(error ? errorFrame(id, error) : okFrame(id));
+                    };
+                    if (static_cast<DaemonOp>(request.code()) == DaemonOp::PowerOnAsync)
+                        hub.powerOnAsync(port, deviceIndex, done);
+                    else
+                        hub.powerOffAsync(port, deviceIndex, done);
+                    return;
+                }
+            case DaemonOp::GetPortStatesAsync:
+                hub.getPortStatesAsync(request.i32(), [connection, id](const std::array<bool, 4>& states,
+                                                                        const std::exception_ptr& error)
+                {
+                    if (error)
+                    {
+                        connection->send(errorFrame(id, error));
+                        return;
+                    }
+                    FrameEncoder reply(id, static_cast<uint8_t>(DaemonStatus::Ok));
+                    reply.put(states);
+                    connection->send(reply.finish());
+                });
+                return;
+            case DaemonOp::PowerCycle:
+                {
+                    std::vector<PortPowerCycle> cycles(request.u16());
+                    for (auto& cycle : cycles)
+                    {
+                        cycle.deviceIndex = request.i32();
+                        cycle.port = request.i32();
+                        cycle.offTime = std::chrono::milliseconds(request.u32());
+                    }
+                    // Answered when the cycles end, so the off-time holds no worker
+                    hub.powerCycle(cycles, [connection, id](const std::exception_ptr& error)
+                    {
+                        connection->send(error ? errorFrame(id, error) : okFrame(id));
+                    });
+                    return;
+                }
+            case DaemonOp::SubscribePortEvents:
+                if (eventSubscription < 0)
+                    throw std::runtime_error("Port events are not available from this mega4d");
+                connection->portEvents.store(true);
+                connection->send(okFrame(id));
+                return;
+            case DaemonOp::UnsubscribePortEvents:
+                connection->portEvents.store(false);
+                connection->send(okFrame(id));
+                return;
+            case DaemonOp::SubscribePortStatus:
+                if (statusSubscription < 0)
+                    throw std::runtime_error("Port status changes are not available from this mega4d");
+                connection->portStatus.store(true);
+                connection->send(okFrame(id));
+                return;
+            case DaemonOp::UnsubscribePortStatus:
+                connection->portStatus.store(false);
+                connection->send(okFrame(id));
+                return;
+            default:
+                pool->post([this, connection, request]() mutable
+                {
+                    connection->send(handle(request));
+                });
+            }
+        }
+
+        /**
+         * @brief Runs a blocking request and returns its response.
+         */
+        std::vector<uint8_t> handle(FrameDecoder& request)
+        {
+            const uint32_t id = request.id();
+            try
+            {
+                FrameEncoder reply(id, static_cast<uint8_t>(DaemonStatus::Ok));
+                switch (static_cast<DaemonOp>(request.code()))
+                {
+                case DaemonOp::ListDevices:
+                    reply.put(hub.listDevices());
+                    break;
+                case DaemonOp::RescanDevices:
+                    reply.put(hub.rescanDevices());
+                    break;
+                case DaemonOp::KnownDevices:
+                    reply.put(hub.knownDevices());
+                    break;
+                case DaemonOp::DeviceIndexOf:
+                    reply.i32(hub.deviceIndexOf(request.str()));
+                    break;
+                case DaemonOp::PowerOn:
+                case DaemonOp::PowerOff:
+                    {
+                        const int port = request.i32();
+                        const int deviceIndex = request.i32();
+                        const auto elapsed = static_cast<DaemonOp>(request.code()) == DaemonOp::PowerOn
+                                                 ? hub.powerOn(port, deviceIndex)
+                                                 : hub.powerOff(port, deviceIndex);
+                        reply.u64(static_cast<uint64_t>(elapsed.count()));
+                        break;
+                    }
+                case DaemonOp::ApplyPowerMasks:
+                    {
+                        std::vector<PortPowerMask> masks(request.u16());
+                        for (auto& mask : masks)
+                        {
+                            mask.deviceIndex = request.i32();
+                            mask.on = request.u8();
+                            mask.off = request.u8();
+                        }
+                        hub.applyPowerMasks(masks);
+                        break;
+                    }
+                case DaemonOp::GetPortStates:
+                    {
+                        const int deviceIndex = request.i32();
+                        reply.put(hub.getPortStates(deviceIndex, request.u8() != 0));
+                        break;
+                    }
+                case DaemonOp::GetPortStateSnapshot:
+                    {
+                        const int deviceIndex = request.i32();
+                        reply.put(hub.getPortStateSnapshot(deviceIndex, request.u8() != 0));
+                        break;
+                    }
+                case DaemonOp::GetPortStatus:
+                    reply.put(hub.getPortStatus(request.i32()));
+                    break;
+                case DaemonOp::GetPortConnections:
+                    reply.put(hub.getPortConnections(request.i32()));
+                    break;
+                case DaemonOp::Metrics:
+                    reply.put(hub.metrics());
+                    break;
+                default:
+                    throw std::invalid_argument("Unknown mega4d request " + std::to_string(request.code()));
+                }
+                return reply.finish();
+            }
+            catch (...)
+            {
+                return errorFrame(id, std::current_exception());
+            }
+        }
+    };
+
+    Mega4Server::Mega4Server(const Mega4Hub& hub, std::string socketPath, const size_t workers)
+        : pImpl(std::make_unique<Impl>(hub, std::move(socketPath), workers))
+    {
+    }
+
+    Mega4Server::~Mega4Server() = default;
+
+    const std::string& Mega4Server::socketPath() const
+    {
+        return pImpl->path;
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,114 @@
+#include "UUGear/Mega4/Metrics.hpp"
+
+#include <cstdio>
+#include <sstream>
+
+namespace UUGear::Mega4
+{
+    LatencySnapshot LatencyHistogram::snapshot(std::string operation, std::string plugin) const
+    {
+        LatencySnapshot snapshot;
+        snapshot.operation = std::move(operation);
+        snapshot.plugin = std::move(plugin);
+        for (size_t i = 0; i < buckets_.size(); ++i)
+        {
+            snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.buckets[i];
+        }
+        snapshot.sumNanoseconds = sumNanoseconds_.load(std::memory_order_relaxed);
+        snapshot.failures = failures_.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    namespace
+    {
+        std::string seconds(const double value)
+        {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.9g", value);
+            return buf;
+        }
+
+        std::string escapeLabel(const std::string& value)
+        {
+            std::string escaped;
+            for (const char c : value)
+            {
+                if (c == '\\' || c == '"') escaped += '\\';
+                if (c == '\n')
+                {
+                    escaped += "\\n";
+                    continue;
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        std::string labelsOf(const LatencySnapshot& snapshot, const bool plugin)
+        {
+            if (plugin)
+                return "plugin=\"" + escapeLabel(snapshot.plugin) + "\",callback=\"" +
+                    escapeLabel(snapshot.operation) + "\"";
+            return "operation=\"" + escapeLabel(snapshot.operation) + "\"";
+        }
+
+        void counter(std::ostringstream& out, const char* name, const char* help, const uint64_t value)
+        {
+            out << "# HELP " << name << ' ' << help << '\n'
+                << "# TYPE " << name << " counter\n"
+                << name << ' ' << value << '\n';
+        }
+
+        void histograms(std::ostringstream& out, const std::string& name, const char* help,
+                        const std::vector<LatencySnapshot>& snapshots, const bool plugins)
+        {
+            if (snapshots.empty())
+                return;
+
+            out << "# HELP " << name << ' ' << help << '\n'
+                << "# TYPE " << name << " histogram\n";
+
+            for (const auto& snapshot : snapshots)
+            {
+                const std::string labels = labelsOf(snapshot, plugins);
+
+                // The last bucket is open-ended and only appears as +Inf
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i + 1 < snapshot.buckets.size(); ++i)
+                {
+                    cumulative += snapshot.buckets[i];
+                    out << name << "_bucket{" << labels << ",le=\"" << seconds(static_cast<double>(1ull << i) * 1e-9)
+                        << "\"} " << cumulative << '\n';
+                }
+                out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << snapshot.count << '\n'
+                    << name << "_sum{" << labels << "} " << seconds(static_cast<double>(snapshot.sumNanoseconds) * 1e-9)
+                    << '\n'
+                    << name << "_count{" << labels << "} " << snapshot.count << '\n';
+            }
+
+            const std::string failures = name.substr(0, name.rfind("_duration_seconds")) + "_failures_total";
+            out << "# HELP " << failures << " Calls that ended with an exception.\n"
+                << "# TYPE " << failures << " counter\n";
+            for (const auto& snapshot : snapshots)
+            {
+                out << failures << '{' << labelsOf(snapshot, plugins) << "} " << snapshot.failures << '\n';
+            }
+        }
+    }
+
+    std::string MetricsSnapshot::toPrometheus() const
+    {
+        std::ostringstream out;
+        counter(out, "mega4_transfers_total", "Control transfers sent to MEGA4 hubs.", transfers);
+        counter(out, "mega4_transfer_errors_total", "Control transfers that failed.", transferErrors);
+        counter(out, "mega4_transfer_timeouts_total", "Control transfers that timed out.", timeouts);
+        counter(out, "mega4_transfer_retries_total", "Control transfers retried after reopening the hub.",
+                retries);
+        histograms(out, "mega4_operation_duration_seconds", "Duration of Mega4Hub operations.", operations,
+                   false);
+        histograms(out, "mega4_plugin_callback_duration_seconds", "Duration of plugin callbacks.",
+                   pluginCallbacks, true);
+        return out.str();
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,323 @@
+#include "UUGear/Mega4/PowerScheduler.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "TimerWheel.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace UUGear::Mega4
+{
+    // Resolution of plan timings, and the horizon covered by one revolution of the wheel (2.56 s)
+    constexpr auto SCHEDULER_TICK = std::chrono::milliseconds(5);
+    constexpr size_t SCHEDULER_SLOTS = 512;
+
+    bool PowerPlanResult::ok() const
+    {
+        for (const auto& step : steps)
+        {
+            if (step.state != PowerStepState::Done)
+                return false;
+        }
+        return true;
+    }
+
+    struct PowerScheduler::Impl
+    {
+        using Clock = TimerWheel::Clock;
+
+        struct Plan
+        {
+            uint64_t id = 0;
+            PowerPlan plan;
+            PlanCallback done;
+            PowerPlanResult result;
+            size_t next = 0; ///< Next step to start
+            size_t requests = 0; ///< Steps waiting for the hub to acknowledge them
+            size_t slots = 0; ///< Steps requested or still settling
+            Clock::time_point nextStart{}; ///< Earliest start of the next step (spacing)
+            bool startTimer = false; ///< A timer will pump the plan at nextStart
+            bool cancelled = false;
+        };
+
+        struct Completion
+        {
+            uint64_t planId;
+            size_t step;
+            std::exception_ptr error;
+        };
+
+        const Mega4Hub& hub;
+        std::atomic<uint64_t> nextId{1};
+
+        // Inbox, filled by callers and by the hub's completion callbacks
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<std::unique_ptr<Plan>> submitted;
+        std::vector<uint64_t> cancelled;
+        std::vector<Completion> completed;
+        bool stopping = false;
+
+        // Scheduler thread only
+        TimerWheel wheel{SCHEDULER_TICK, SCHEDULER_SLOTS};
+        std::map<uint64_t, std::unique_ptr<Plan>> plans;
+        bool draining = false; ///< Stopping: no settle waits, end plans as soon as their requests complete
+
+        std::thread thread;
+
+        explicit Impl(const Mega4Hub& hub) : hub(hub)
+        {
+            thread = std::thread([this] { run(); });
+        }
+
+        ~Impl()
+        {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+                wake.notify_one();
+            }
+            thread.join();
+        }
+
+        void post(Completion completion)
+        {
+            std::lock_guard lock(mutex);
+            completed.push_back(std::move(completion));
+            // Notified under the lock: once it is released the scheduler may be gone
+            wake.notify_one();
+        }
+
+        void run()
+        {
+            while (true)
+            {
+                std::vector<std::unique_ptr<Plan>> newPlans;
+                std::vector<uint64_t> cancels;
+                std::vector<Completion> completions;
+                bool stop;
+                {
+                    std::unique_lock lock(mutex);
+                    const auto ready = [this]
+                    {
+                        return (stopping && !draining) || !submitted.empty() || !cancelled.empty() ||
+                            !completed.empty();
+                    };
+                    if (wheel.empty() || draining)
+                        wake.wait(lock, ready);
+                    else
+                        wake.wait_until(lock, wheel.nextTick(), ready);
+
+                    newPlans.swap(submitted);
+                    cancels.swap(cancelled);
+                    completions.swap(completed);
+                    stop = stopping;
+                }
+
+                for (auto& plan : newPlans)
+                {
+                    Plan& added = *plan;
+                    plans.emplace(added.id, std::move(plan));
+                    pump(added);
+                }
+                for (const uint64_t id : cancels)
+                    cancel(id);
+                for (auto& completion : completions)
+                    complete(completion);
+
+                if (stop && !draining)
+                {
+                    draining = true;
+                    std::vector<uint64_t> ids;
+                    for (const auto& [id, plan] : plans)
+                        ids.push_back(id);
+                    for (const uint64_t id : ids)
+                        cancel(id);
+                }
+
+                if (draining)
+                {
+                    if (plans.empty())
+                        return;
+                    continue;
+                }
+                wheel.advance(Clock::now());
+            }
+        }
+
+        Plan* find(const uint64_t id)
+        {
+            const auto it = plans.find(id);
+            return it == plans.end() ? nullptr : it->second.get();
+        }
+
+        /**
+         * @brief Starts as many steps as the plan's limits allow, or arms a timer for the next one.
+         */
+        void pump(Plan& plan)
+        {
+            const size_t maxConcurrent = plan.plan.maxConcurrent ? plan.plan.maxConcurrent : 1;
+            while (!plan.cancelled && plan.next < plan.plan.steps.size() && plan.slots < maxConcurrent)
+            {
+                const auto now = Clock::now();
+                if (now < plan.nextStart)
+                {
+                    if (!plan.startTimer)
+                    {
+                        plan.startTimer = true;
+                        wheel.schedule(plan.nextStart, [this, id = plan.id]
+                        {
+                            if (Plan* timed = find(id))
+                            {
+                                timed->startTimer = false;
+                                pump(*timed);
+                            }
+                        });
+                    }
+                    return;
+                }
+                start(plan, now);
+            }
+            finishIfDone(plan);
+        }
+
+        void start(Plan& plan, const Clock::time_point now)
+        {
+            const size_t index = plan.next++;
+            const PowerStep& step = plan.plan.steps[index];
+            ++plan.requests;
+            ++plan.slots;
+            plan.nextStart = now + plan.plan.spacing;
+
+            auto done = [this, id = plan.id, index](const std::exception_ptr& error)
+            {
+                post({id, index, error});
+            };
+            try
+            {
+                const int deviceIndex = hub.deviceIndexOf(step.hubPath);
+                if (deviceIndex < 0)
+                    throw std::out_of_range("No MEGA4 hub at " + step.hubPath);
+                if (step.on)
+                    hub.powerOnAsync(step.port, deviceIndex, done);
+                else
+                    hub.powerOffAsync(step.port, deviceIndex, done);
+            }
+            catch (...)
+            {
+                done(std::current_exception());
+            }
+        }
+
+        void complete(const Completion& completion)
+        {
+            Plan* plan = find(completion.planId);
+            if (!plan)
+                return;
+
+            --plan->requests;
+            PowerStepOutcome& outcome = plan->result.steps[completion.step];
+            outcome.state = completion.error ? PowerStepState::Failed : PowerStepState::Done;
+            outcome.error = completion.error;
+
+            // A port that did not switch draws no inrush current
+            if (completion.error || plan->cancelled)
+            {
+                --plan->slots;
+            }
+            else
+            {
+                wheel.schedule(Clock::now() + plan->plan.settleTime, [this, id = plan->id]
+                {
+                    if (Plan* settled = find(id))
+                    {
+                        --settled->slots;
+                        pump(*settled);
+                    }
+                });
+            }
+            pump(*plan);
+        }
+
+        void cancel(const uint64_t id)
+        {
+            Plan* plan = find(id);
+            if (!plan || plan->cancelled)
+                return;
+
+            plan->cancelled = true;
+            plan->result.cancelled = true;
+            for (size_t i = plan->next; i < plan->result.steps.size(); ++i)
+                plan->result.steps[i].state = PowerStepState::Skipped;
+            finishIfDone(*plan);
+        }
+
+        /**
+         * @brief Reports and forgets the plan once nothing of it is pending any more.
+         */
+        void finishIfDone(Plan& plan)
+        {
+            if (plan.requests > 0)
+                return;
+            if (!plan.cancelled && (plan.next < plan.plan.steps.size() || plan.slots > 0))
+                return;
+
+            const auto it = plans.find(plan.id);
+            const std::unique_ptr<Plan> finished = std::move(it->second);
+            plans.erase(it);
+            if (finished->done)
+            {
+                try
+                {
+                    finished->done(finished->result);
+                }
+                catch (...)
+                {
+                    // A throwing callback must not take the scheduler thread down
+                }
+            }
+        }
+    };
+
+    PowerScheduler::PowerScheduler(const Mega4Hub& hub) : pImpl(std::make_unique<Impl>(hub))
+    {
+    }
+
+    PowerScheduler::~PowerScheduler() = default;
+
+    uint64_t PowerScheduler::submit(PowerPlan plan, PlanCallback done)
+    {
+        auto state = std::make_unique<Impl::Plan>();
+        state->id = pImpl->nextId.fetch_add(1, std::memory_order_relaxed);
+        state->result.planId = state->id;
+        state->result.steps.resize(plan.steps.size());
+        state->plan = std::move(plan);
+        state->done = std::move(done);
+
+        const uint64_t id = state->id;
+        std::lock_guard lock(pImpl->mutex);
+        if (pImpl->stopping)
+            throw std::runtime_error("PowerScheduler is shutting down");
+        pImpl->submitted.push_back(std::move(state));
+        pImpl->wake.notify_one();
+        return id;
+    }
+
+    std::future<PowerPlanResult> PowerScheduler::submit(PowerPlan plan)
+    {
+        auto promise = std::make_shared<std::promise<PowerPlanResult>>();
+        auto future = promise->get_future();
+        submit(std::move(plan), [promise](const PowerPlanResult& result) { promise->set_value(result); });
+        return future;
+    }
+
+    void PowerScheduler::cancel(const uint64_t planId)
+    {
+        std::lock_guard lock(pImpl->mutex);
+        pImpl->cancelled.push_back(planId);
+        pImpl->wake.notify_one();
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,116 @@
+#include "RecordingTransport.hpp"
+
+#include <libusb.h>
+#include <stdexcept>
+
+namespace UUGear::Mega4
+{
+    namespace
+    {
+        TraceRecord controlRecord(const TraceRecord::Kind kind, const std::string& hubPath,
+                                  const uint8_t bmRequestType, const uint8_t bRequest, const uint16_t wValue,
+                                  const uint16_t wIndex, const uint16_t wLength)
+        {
+            TraceRecord record;
+            record.kind = kind;
+            record.hubPath = hubPath;
+            record.bmRequestType = bmRequestType;
+            record.bRequest = bRequest;
+            record.wValue = wValue;
+            record.wIndex = wIndex;
+            record.wLength = wLength;
+            return record;
+        }
+    }
+
+    RecordingTransport::RecordingTransport(std::unique_ptr<UsbTransport> inner, const std::string& path)
+        : writer_(path), inner_(std::move(inner))
+    {
+        inner_->setReattachHandler([this](const std::string& hubPath) { notifyReattached(hubPath); });
+    }
+
+    bool RecordingTransport::enumerateHubs(std::vector<HubEntry>& hubs)
+    {
+        TraceRecord record;
+        record.kind = TraceRecord::Kind::Enumeration;
+        record.start = writer_.elapsed();
+
+        const size_t first = hubs.size();
+        const bool ok = inner_->enumerateHubs(hubs);
+
+        record.duration = writer_.elapsed() - record.start;
+        record.result = ok ? 1 : 0;
+        if (ok)
+            record.hubs.assign(hubs.begin() + static_cast<std::ptrdiff_t>(first), hubs.end());
+        writer_.write(record);
+        return ok;
+    }
+
+    int RecordingTransport::controlTransfer(const std::string& hubPath, const uint8_t bmRequestType,
+                                            const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                            unsigned char* data, const uint16_t wLength, const unsigned int timeoutMs)
+    {
+        TraceRecord record = controlRecord(TraceRecord::Kind::Control, hubPath, bmRequestType, bRequest, wValue,
+                                           wIndex, wLength);
+        const bool in = (bmRequestType & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+        if (!in && data)
+            record.data.assign(data, data + wLength);
+        record.start = writer_.elapsed();
+
+        int ret;
+        try
+        {
+            ret = inner_->controlTransfer(hubPath, bmRequestType, bRequest, wValue, wIndex, data, wLength,
+                                          timeoutMs);
+        }
+        catch (const std::runtime_error& ex)
+        {
+            record.duration = writer_.elapsed() - record.start;
+            record.flags = TraceRecord::FLAG_THREW;
+            record.message = ex.what();
+            writer_.write(record);
+            throw;
+        }
+
+        record.duration = writer_.elapsed() - record.start;
+        record.result = ret;
+        if (in && ret > 0)
+            record.data.assign(data, data + ret);
+        writer_.write(record);
+        return ret;
+    }
+
+    int RecordingTransport::submitControl(const std::string& hubPath, const uint8_t bmRequestType,
+                                          const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                          const uint16_t wLength, const unsigned int timeoutMs, Completion done)
+    {
+        auto record = std::make_shared<TraceRecord>(controlRecord(TraceRecord::Kind::AsyncControl, hubPath,
+                                                                  bmRequestType, bRequest, wValue, wIndex, wLength));
+        record->start = writer_.elapsed();
+
+        const int ret = inner_->submitControl(
+            hubPath, bmRequestType, bRequest, wValue, wIndex, wLength, timeoutMs,
+            [this, record, done = std::move(done)](const int result, const uint8_t* data, const int length)
+            {
+                record->duration = writer_.elapsed() - record->start;
+                record->result = result;
+                if (data && length > 0)
+                    record->data.assign(data, data + length);
+                writer_.write(*record);
+                done(result, data, length);
+            });
+
+        if (ret != 0)
+        {
+            record->flags = TraceRecord::FLAG_NOT_SUBMITTED;
+            record->result = ret;
+            writer_.write(*record);
+        }
+        return ret;
+    }
+
+    bool RecordingTransport::readPortConnections(const std::string& hubPath, std::vector<PortConnectionInfo>& ports)
+    {
+        return inner_->readPortConnections(hubPath, ports);
+    }
+} // namespace UUGear::Mega4
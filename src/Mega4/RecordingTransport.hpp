@@ -0,0 +1,47 @@
+#ifndef UUGEAR_MEGA4_LIB_RECORDINGTRANSPORT_HPP
+#define UUGEAR_MEGA4_LIB_RECORDINGTRANSPORT_HPP
+
+#include "UsbTransport.hpp"
+#include "TransportTrace.hpp"
+
+#include <memory>
+
+namespace UUGear::Mega4
+{
+    class RecordingTransport;
+}
+
+/**
+ * @brief UsbTransport decorator writing every enumeration and control transfer
+ *        that goes through it to a capture file (see TraceRecord), with its
+ *        setup packet, data stage, result and timing.
+ *
+ * Port connections are forwarded but not recorded.
+ */
+class UUGear::Mega4::RecordingTransport final : public UsbTransport
+{
+public:
+    /**
+     * @throws std::runtime_error if the capture file cannot be created.
+     */
+    RecordingTransport(std::unique_ptr<UsbTransport> inner, const std::string& path);
+
+    RecordingTransport(const RecordingTransport&) = delete;
+    RecordingTransport& operator=(const RecordingTransport&) = delete;
+
+    bool enumerateHubs(std::vector<HubEntry>& hubs) override;
+
+    int controlTransfer(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                        uint16_t wIndex, unsigned char* data, uint16_t wLength, unsigned int timeoutMs) override;
+
+    int submitControl(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                      uint16_t wIndex, uint16_t wLength, unsigned int timeoutMs, Completion done) override;
+
+    bool readPortConnections(const std::string& hubPath, std::vector<PortConnectionInfo>& ports) override;
+
+private:
+    TraceWriter writer_;
+    std::unique_ptr<UsbTransport> inner_; ///< Destroyed first: its pending completions are still recorded
+};
+
+#endif //UUGEAR_MEGA4_LIB_RECORDINGTRANSPORT_HPP
@@ -0,0 +1,147 @@
+#include "ReplayTransport.hpp"
+
+#include <libusb.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace UUGear::Mega4
+{
+    ReplayTransport::ReplayTransport(const std::string& path, const bool withTiming)
+        : withTiming_(withTiming), records_(TraceReader::readAll(path))
+    {
+        for (const auto& record : records_)
+        {
+            if (record.kind == TraceRecord::Kind::Enumeration)
+                enumerations_.push_back(&record);
+            else
+                transfers_[{record.hubPath, record.bmRequestType, record.bRequest, record.wValue, record.wIndex,
+                            record.wLength}].push_back(&record);
+        }
+        worker_ = std::thread(&ReplayTransport::run, this);
+    }
+
+    ReplayTransport::~ReplayTransport()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        worker_.join();
+    }
+
+    void ReplayTransport::run()
+    {
+        std::unique_lock lock(mutex_);
+        while (true)
+        {
+            if (pending_.empty())
+            {
+                if (stopping_)
+                    return;
+                wake_.wait(lock);
+                continue;
+            }
+
+            // Once stopping, the remaining transfers complete without waiting for their time
+            const auto due = pending_.begin()->first;
+            if (!stopping_ && std::chrono::steady_clock::now() < due)
+            {
+                wake_.wait_until(lock, due);
+                continue;
+            }
+
+            Pending next = std::move(pending_.begin()->second);
+            pending_.erase(pending_.begin());
+            lock.unlock();
+
+            const TraceRecord& record = *next.record;
+            const bool in = (record.bmRequestType & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+            try
+            {
+                next.done(record.result, record.result >= 0 ? record.data.data() : nullptr,
+                          in && record.result >= 0 ? static_cast<int>(record.data.size()) : 0);
+            }
+            catch (...)
+            {
+                // Same contract as the libusb event thread: a throwing callback must not stop the worker
+            }
+
+            lock.lock();
+        }
+    }
+
+    const TraceRecord* ReplayTransport::take(const Key& key)
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = transfers_.find(key);
+        if (it == transfers_.end() || it->second.empty())
+            return nullptr;
+
+        const TraceRecord* record = it->second.front();
+        it->second.pop_front();
+        return record;
+    }
+
+    bool ReplayTransport::enumerateHubs(std::vector<HubEntry>& hubs)
+    {
+        const TraceRecord* record;
+        {
+            std::lock_guard lock(mutex_);
+            if (!enumerations_.empty())
+            {
+                lastEnumeration_ = enumerations_.front();
+                enumerations_.pop_front();
+            }
+            record = lastEnumeration_;
+        }
+        if (!record)
+            return false;
+
+        if (withTiming_)
+            std::this_thread::sleep_for(record->duration);
+        hubs.insert(hubs.end(), record->hubs.begin(), record->hubs.end());
+        return record->result != 0;
+    }
+
+    int ReplayTransport::controlTransfer(const std::string& hubPath, const uint8_t bmRequestType,
+                                         const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                         unsigned char* data, const uint16_t wLength, unsigned int)
+    {
+        const TraceRecord* record = take({hubPath, bmRequestType, bRequest, wValue, wIndex, wLength});
+        if (!record)
+            return LIBUSB_ERROR_NOT_FOUND;
+
+        if (withTiming_)
+            std::this_thread::sleep_for(record->duration);
+        if (record->flags & TraceRecord::FLAG_THREW)
+            throw std::runtime_error(record->message);
+
+        if ((bmRequestType & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN && data && record->result > 0)
+            std::memcpy(data, record->data.data(), std::min<size_t>(record->data.size(), wLength));
+        return record->result;
+    }
+
+    int ReplayTransport::submitControl(const std::string& hubPath, const uint8_t bmRequestType,
+                                       const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                       const uint16_t wLength, unsigned int, Completion done)
+    {
+        const TraceRecord* record = take({hubPath, bmRequestType, bRequest, wValue, wIndex, wLength});
+        if (!record)
+            return LIBUSB_ERROR_NOT_FOUND;
+        if (record->flags & TraceRecord::FLAG_NOT_SUBMITTED)
+            return record->result;
+        if (record->flags & TraceRecord::FLAG_THREW)
+            return LIBUSB_ERROR_NO_DEVICE; // captured synchronously, the hub could not be opened
+
+        const auto due = std::chrono::steady_clock::now() +
+            (withTiming_ ? record->duration : std::chrono::nanoseconds(0));
+        {
+            std::lock_guard lock(mutex_);
+            pending_.emplace(due, Pending{record, std::move(done)});
+        }
+        wake_.notify_all();
+        return 0;
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,85 @@
+#ifndef UUGEAR_MEGA4_LIB_REPLAYTRANSPORT_HPP
+#define UUGEAR_MEGA4_LIB_REPLAYTRANSPORT_HPP
+
+#include "UsbTransport.hpp"
+#include "TransportTrace.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+namespace UUGear::Mega4
+{
+    class ReplayTransport;
+}
+
+/**
+ * @brief UsbTransport answering from a capture written by RecordingTransport.
+ *
+ * Enumerations are answered in capture order (the last one repeats once they run
+ * out). A control transfer is answered by the next unused captured transfer with
+ * the same hub path and setup packet, whether it was captured synchronous or
+ * asynchronous, so a build that reorders or batches its requests still replays;
+ * requests the capture has no answer for fail with LIBUSB_ERROR_NOT_FOUND.
+ *
+ * With timing enabled every answer takes as long as it took on the hardware;
+ * otherwise answers are immediate.
+ */
+class UUGear::Mega4::ReplayTransport final : public UsbTransport
+{
+public:
+    /**
+     * @throws std::runtime_error if the capture cannot be read.
+     */
+    ReplayTransport(const std::string& path, bool withTiming);
+
+    /**
+     * @brief Completes every pending asynchronous transfer, then stops the worker.
+     */
+    ~ReplayTransport() override;
+
+    ReplayTransport(const ReplayTransport&) = delete;
+    ReplayTransport& operator=(const ReplayTransport&) = delete;
+
+    bool enumerateHubs(std::vector<HubEntry>& hubs) override;
+
+    int controlTransfer(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                        uint16_t wIndex, unsigned char* data, uint16_t wLength, unsigned int timeoutMs) override;
+
+    int submitControl(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                      uint16_t wIndex, uint16_t wLength, unsigned int timeoutMs, Completion done) override;
+
+private:
+    using Key = std::tuple<std::string, uint8_t, uint8_t, uint16_t, uint16_t, uint16_t>;
+
+    struct Pending
+    {
+        const TraceRecord* record;
+        Completion done;
+    };
+
+    /**
+     * @brief Takes the next unused transfer captured for a request, or nullptr.
+     */
+    const TraceRecord* take(const Key& key);
+
+    void run();
+
+    const bool withTiming_;
+    const std::vector<TraceRecord> records_;
+
+    std::mutex mutex_;
+    std::deque<const TraceRecord*> enumerations_;
+    const TraceRecord* lastEnumeration_ = nullptr;
+    std::map<Key, std::deque<const TraceRecord*>> transfers_;
+
+    std::condition_variable wake_;
+    std::multimap<std::chrono::steady_clock::time_point, Pending> pending_; ///< By completion time
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_REPLAYTRANSPORT_HPP
@@ -0,0 +1,320 @@
+#include "UUGear/Mega4/SharedStatePublisher.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Logger.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+namespace UUGear::Mega4
+{
+    namespace
+    {
+        int64_t nowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void copyText(char* field, const size_t size, const std::string& text)
+        {
+            const size_t length = std::min(text.size(), size - 1);
+            std::memcpy(field, text.data(), length);
+            std::memset(field + length, 0, size - length);
+        }
+
+        /**
+         * @brief Seqlock write; only one thread writes a slot at a time.
+         */
+        void store(SharedHubSlot& slot, const SharedHubRecord& record)
+        {
+            uint64_t words[SharedHubSlot::WORDS];
+            std::memcpy(words, &record, sizeof(record));
+
+            const uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < SharedHubSlot::WORDS; ++i)
+                slot.words[i].store(words[i], std::memory_order_relaxed);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        /**
+         * @brief Creates the segment, exclusively locked with flock() for as long as the
+         *        returned descriptor stays open.
+         *
+         * The lock marks a live publisher, and the kernel drops it when that publisher
+         * dies. A segment found unlocked was left by a publisher that died, and is replaced.
+         * A new segment is locked before it is sized, so one found locked or empty is in use.
+         * @throws std::runtime_error if another publisher owns the segment or it cannot be created.
+         */
+        int createSegment(const std::string& name)
+        {
+            for (int attempt = 0; attempt < 3; ++attempt)
+            {
+                if (const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644); fd >= 0)
+                {
+                    // Only waits for a publisher checking whether this segment is stale
+                    ::flock(fd, LOCK_EX);
+                    return fd;
+                }
+                if (errno != EEXIST)
+                    break;
+
+                const int existing = ::shm_open(name.c_str(), O_RDWR, 0);
+                if (existing < 0)
+                {
+                    if (errno == ENOENT)
+                        continue; // removed in the meantime
+                    break;
+                }
+                struct stat info{};
+                if (::flock(existing, LOCK_EX | LOCK_NB) != 0 || ::fstat(existing, &info) != 0 ||
+                    info.st_size < static_cast<off_t>(sizeof(SharedStateLayout)))
+                {
+                    ::close(existing);
+                    throw std::runtime_error("Shared MEGA4 state " + name + " is in use by another publisher");
+                }
+                // Unlinked under the lock, so a publisher recovering it at the same time finds no link left
+                if (info.st_nlink > 0)
+                {
+                    UUGEAR_MEGA4_LOG_WARNING("replacing shared MEGA4 state " << name
+                        << " left by a publisher that stopped");
+                    ::shm_unlink(name.c_str());
+                }
+                ::close(existing);
+            }
+            throw std::runtime_error("Failed to create shared MEGA4 state " + name + ": " + std::strerror(errno));
+        }
+
+        /**
+         * @brief Whether two records differ in anything but their generation and change time.
+         */
+        bool differs(const SharedHubRecord& a, const SharedHubRecord& b)
+        {
+            SharedHubRecord left = a;
+            SharedHubRecord right = b;
+            left.generation = right.generation = 0;
+            left.changedNs = right.changedNs = 0;
+            return std::memcmp(&left, &right, sizeof(left)) != 0;
+        }
+    }
+
+    struct SharedStatePublisher::Impl
+    {
+        const Mega4Hub& hub;
+        std::string name;
+        std::chrono::milliseconds interval;
+        SharedStateLayout* layout = nullptr;
+        int fd = -1; ///< Holds the flock() that marks the segment as published, see createSegment()
+
+        // Writer state, guarded by publishMutex
+        mutable std::mutex publishMutex;
+        std::map<std::string, size_t> slotOf; ///< busPortPath -> slot
+        std::vector<SharedHubRecord> published; ///< Last record written to each slot
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool dirty = false;
+        bool stopping = false;
+        int statusSubscription = -1;
+        std::thread thread;
+
+        Impl(const Mega4Hub& hub, std::string segmentName, const std::chrono::milliseconds interval)
+            : hub(hub), name(std::move(segmentName)), interval(interval),
+              published(SharedStateLayout::MAX_HUBS)
+        {
+            fd = createSegment(name);
+            void* mapped = MAP_FAILED;
+            if (::ftruncate(fd, sizeof(SharedStateLayout)) == 0)
+                mapped = ::mmap(nullptr, sizeof(SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                const std::string reason = std::strerror(errno);
+                ::shm_unlink(name.c_str());
+                ::close(fd);
+                throw std::runtime_error("Failed to set up shared MEGA4 state " + name + ": " + reason);
+            }
+
+            // A new segment reads as zeroes
+            layout = static_cast<SharedStateLayout*>(mapped);
+            layout->capacity = SharedStateLayout::MAX_HUBS;
+            layout->version = SharedStateLayout::VERSION;
+            layout->magic = SharedStateLayout::MAGIC;
+
+            publish();
+
+            try
+            {
+                statusSubscription = hub.subscribePortStatus([this](const PortStatusChange&)
+                {
+                    std::lock_guard lock(mutex);
+                    dirty = true;
+                    wake.notify_one();
+                });
+            }
+            catch (const std::runtime_error& ex)
+            {
+                UUGEAR_MEGA4_LOG_INFO("shared state refreshed every interval only (" << ex.what() << ")");
+            }
+            thread = std::thread([this] { run(); });
+        }
+
+        ~Impl()
+        {
+            if (statusSubscription >= 0)
+                hub.unsubscribePortStatus(statusSubscription);
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+                wake.notify_one();
+            }
+            thread.join();
+
+            layout->heartbeatNs.store(0, std::memory_order_relaxed);
+            ::munmap(layout, sizeof(SharedStateLayout));
+
+            // Still locked, so the name cannot have been handed to another publisher, unless removed by hand
+            struct stat info{};
+            if (::fstat(fd, &info) == 0 && info.st_nlink > 0)
+                ::shm_unlink(name.c_str());
+            ::close(fd);
+        }
+
+        void run()
+        {
+            std::unique_lock lock(mutex);
+            while (true)
+            {
+                wake.wait_for(lock, interval, [this] { return stopping || dirty; });
+                if (stopping)
+                    return;
+                dirty = false;
+                lock.unlock();
+                publish();
+                lock.lock();
+            }
+        }
+
+        void publish()
+        {
+            std::lock_guard lock(publishMutex);
+            const auto devices = hub.knownDevices();
+
+            // Free the slots of hubs that left
+            for (auto it = slotOf.begin(); it != slotOf.end();)
+            {
+                const bool present = std::any_of(devices.begin(), devices.end(),
+                                                 [&](const DeviceInfo& d) { return d.busPortPath == it->first; });
+                if (present)
+                {
+                    ++it;
+                    continue;
+                }
+                SharedHubRecord& record = published[it->second];
+                const uint64_t generation = record.generation;
+                record = SharedHubRecord{};
+                record.generation = generation + 1;
+                record.changedNs = nowNs();
+                write(it->second, record);
+                it = slotOf.erase(it);
+            }
+
+            for (size_t index = 0; index < devices.size(); ++index)
+                publishHub(static_cast<int>(index), devices[index].busPortPath);
+
+            layout->heartbeatNs.store(nowNs(), std::memory_order_relaxed);
+        }
+
+        void publishHub(const int deviceIndex, const std::string& path)
+        {
+            SharedHubRecord record{};
+            copyText(record.busPortPath, sizeof(record.busPortPath), path);
+            record.inUse = 1;
+            try
+            {
+                const auto states = hub.getPortStates(deviceIndex);
+                for (size_t i = 0; i < states.size(); ++i)
+                {
+                    if (states[i])
+                        record.powered |= static_cast<uint8_t>(1u << i);
+                }
+            }
+            catch (const std::exception&)
+            {
+                return; // keep the last published state; a new hub gets no slot until it can be read
+            }
+
+            // Reserve a slot only for a readable hub: slots with inUse 0 are handed out as free
+            auto it = slotOf.find(path);
+            if (it == slotOf.end())
+            {
+                size_t free = 0;
+                while (free < published.size() && published[free].inUse)
+                    ++free;
+                if (free == published.size())
+                    return; // more hubs than slots
+                it = slotOf.emplace(path, free).first;
+            }
+            const size_t slot = it->second;
+
+            for (int port = 1; port <= 4; ++port)
+                record.ports[port - 1].portNumber = static_cast<uint8_t>(port);
+            try
+            {
+                for (const auto& connection : hub.getPortConnections(deviceIndex))
+                {
+                    if (connection.portNumber < 1 || connection.portNumber > 4)
+                        continue;
+                    SharedPortRecord& port = record.ports[connection.portNumber - 1];
+                    port.hasDevice = connection.hasDevice ? 1 : 0;
+                    port.vid = connection.vid;
+                    port.pid = connection.pid;
+                    port.deviceClass = connection.deviceClass;
+                    copyText(port.manufacturer, sizeof(port.manufacturer), connection.manufacturer);
+                    copyText(port.product, sizeof(port.product), connection.product);
+                }
+                record.connectionsValid = 1;
+            }
+            catch (const std::exception&)
+            {
+            }
+
+            if (!differs(record, published[slot]))
+                return;
+            record.generation = published[slot].generation + 1;
+            record.changedNs = nowNs();
+            published[slot] = record;
+            write(slot, record);
+        }
+
+        void write(const size_t slot, const SharedHubRecord& record) const
+        {
+            store(layout->slots[slot], record);
+            layout->generation.fetch_add(1, std::memory_order_release);
+        }
+    };
+
+    SharedStatePublisher::SharedStatePublisher(const Mega4Hub& hub, std::string name,
+                                               const std::chrono::milliseconds interval)
+        : pImpl(std::make_unique<Impl>(hub, std::move(name), interval))
+    {
+    }
+
+    SharedStatePublisher::~SharedStatePublisher() = default;
+
+    void SharedStatePublisher::publish() const
+    {
+        pImpl->publish();
+    }
+
+    const std::string& SharedStatePublisher::name() const
+    {
+        return pImpl->name;
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,367 @@
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+
+#include <libusb.h>
+#include <stdexcept>
+#include <thread>
+
+namespace UUGear::Mega4
+{
+    // Hub class feature selectors (USB 2.0 table 11-17)
+    constexpr uint16_t PORT_RESET = 4;
+    constexpr uint16_t PORT_POWER = 8;
+    constexpr uint16_t C_PORT_CONNECTION = 16;
+    constexpr uint16_t C_PORT_RESET = 20;
+
+    constexpr uint16_t CHANGE_CONNECTION = 0x0001;
+    constexpr uint16_t CHANGE_OVER_CURRENT = 0x0008;
+    constexpr uint16_t CHANGE_RESET = 0x0010;
+
+    // USB3 link states reported in wPortStatus bits 5–8
+    constexpr uint16_t LINK_U0 = 0x0;
+    constexpr uint16_t LINK_SS_DISABLED = 0x4;
+    constexpr uint16_t LINK_RX_DETECT = 0x5;
+
+    static void checkPort(const int port)
+    {
+        if (port < 1 || port > 4)
+            throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
+    }
+
+    SimulatedMega4::SimulatedMega4(std::string busPortPath, const bool usb3) : usb3_(usb3)
+    {
+        info_.busPortPath = std::move(busPortPath);
+        info_.vid = 0x2109;
+        info_.pid = usb3 ? 0x0817 : 0x2817;
+        info_.description = std::string("Simulated VIA Labs VL817 Hub (") + (usb3 ? "USB3" : "USB2") + ")";
+    }
+
+    void SimulatedMega4::setLatency(const std::chrono::microseconds latency)
+    {
+        std::lock_guard lock(mutex_);
+        latency_ = latency;
+    }
+
+    void SimulatedMega4::setSwitchDelay(const std::chrono::microseconds delay)
+    {
+        std::lock_guard lock(mutex_);
+        switchDelay_ = delay;
+    }
+
+    void SimulatedMega4::setFailureRate(const double probability, const int errorCode)
+    {
+        std::lock_guard lock(mutex_);
+        failureRate_ = probability;
+        failureError_ = errorCode;
+    }
+
+    void SimulatedMega4::failNextTransfers(const int count, const int errorCode)
+    {
+        std::lock_guard lock(mutex_);
+        failNext_ = count;
+        failNextError_ = errorCode;
+    }
+
+    void SimulatedMega4::setPaused(const bool paused)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            paused_ = paused;
+        }
+        resumed_.notify_all();
+    }
+
+    int SimulatedMega4::pausedTransfers() const
+    {
+        std::lock_guard lock(mutex_);
+        return pausedTransfers_;
+    }
+
+    void SimulatedMega4::setSeed(const uint32_t seed)
+    {
+        std::lock_guard lock(mutex_);
+        random_.seed(seed);
+    }
+
+    void SimulatedMega4::setConnected(const bool connected)
+    {
+        std::lock_guard lock(mutex_);
+        if (connected && !connected_)
+        {
+            // Re-enumeration: new address, ports come back powered
+            address_ = static_cast<uint8_t>(address_ % 127 + 1);
+            for (auto& port : ports_)
+            {
+                port.switchingTo.reset();
+                port.powered = true;
+                port.change = port.device ? CHANGE_CONNECTION : 0;
+                port.deviceAddress = port.device ? nextDeviceAddress() : 0;
+            }
+        }
+        connected_ = connected;
+    }
+
+    void SimulatedMega4::attachDevice(const PortConnectionInfo& device, const PortSpeed speed)
+    {
+        checkPort(device.portNumber);
+        if (speed != PortSpeed::Low && speed != PortSpeed::Full && speed != PortSpeed::High)
+            throw std::out_of_range("A device on the USB2 hub runs at low, full or high speed.");
+        std::lock_guard lock(mutex_);
+
+        Port& port = ports_[device.portNumber - 1];
+        port.device = device;
+        port.device->hasDevice = true;
+        port.speed = speed;
+        if (port.powered)
+        {
+            port.change |= CHANGE_CONNECTION;
+            port.deviceAddress = nextDeviceAddress();
+        }
+    }
+
+    void SimulatedMega4::detachDevice(const int port)
+    {
+        checkPort(port);
+        std::lock_guard lock(mutex_);
+
+        Port& p = ports_[port - 1];
+        if (p.device && p.powered)
+            p.change |= CHANGE_CONNECTION;
+        p.device.reset();
+        p.deviceAddress = 0;
+    }
+
+    void SimulatedMega4::setOverCurrent(const int port, const bool overCurrent)
+    {
+        checkPort(port);
+        std::lock_guard lock(mutex_);
+
+        Port& p = ports_[port - 1];
+        if (p.overCurrent != overCurrent)
+            p.change |= CHANGE_OVER_CURRENT;
+        p.overCurrent = overCurrent;
+    }
+
+    DeviceInfo SimulatedMega4::info() const
+    {
+        std::lock_guard lock(mutex_);
+        return info_;
+    }
+
+    uint8_t SimulatedMega4::address() const
+    {
+        std::lock_guard lock(mutex_);
+        return address_;
+    }
+
+    bool SimulatedMega4::connected() const
+    {
+        std::lock_guard lock(mutex_);
+        return connected_;
+    }
+
+    bool SimulatedMega4::isPortPowered(const int port) const
+    {
+        checkPort(port);
+        std::lock_guard lock(mutex_);
+        completeSwitches();
+        return ports_[port - 1].powered;
+    }
+
+    std::vector<PortConnectionInfo> SimulatedMega4::ports() const
+    {
+        std::lock_guard lock(mutex_);
+        completeSwitches();
+
+        std::vector<PortConnectionInfo> result(4);
+        for (int i = 0; i < 4; ++i)
+        {
+            if (ports_[i].device && ports_[i].powered)
+                result[i] = *ports_[i].device;
+            else
+                result[i].hasDevice = false;
+            result[i].portNumber = i + 1;
+        }
+        return result;
+    }
+
+    uint64_t SimulatedMega4::transferCount() const
+    {
+        std::lock_guard lock(mutex_);
+        return transferCount_;
+    }
+
+    uint8_t SimulatedMega4::deviceAddress(const int port) const
+    {
+        checkPort(port);
+        std::lock_guard lock(mutex_);
+        completeSwitches();
+        return ports_[port - 1].deviceAddress;
+    }
+
+    bool SimulatedMega4::readDeviceStrings(const int port, std::string& manufacturer, std::string& product)
+    {
+        checkPort(port);
+        std::chrono::microseconds latency;
+        {
+            std::lock_guard lock(mutex_);
+            latency = latency_;
+        }
+        if (latency.count() > 0)
+            std::this_thread::sleep_for(latency);
+
+        std::lock_guard lock(mutex_);
+        completeSwitches();
+        const Port& p = ports_[port - 1];
+        if (!connected_ || !p.device || !p.powered)
+            return false;
+        manufacturer = p.device->manufacturer;
+        product = p.device->product;
+        ++stringReadCount_;
+        return true;
+    }
+
+    uint64_t SimulatedMega4::stringReadCount() const
+    {
+        std::lock_guard lock(mutex_);
+        return stringReadCount_;
+    }
+
+    uint8_t SimulatedMega4::nextDeviceAddress() const
+    {
+        lastDeviceAddress_ = static_cast<uint8_t>(lastDeviceAddress_ % 127 + 1);
+        return lastDeviceAddress_;
+    }
+
+    uint16_t SimulatedMega4::portStatus(const Port& port) const
+    {
+        const bool attached = port.powered && port.device.has_value();
+        uint16_t status = attached ? 0x0003 : 0x0000; // PORT_CONNECTION | PORT_ENABLE
+        if (port.overCurrent) status |= 0x0008; // PORT_OVER_CURRENT
+
+        if (usb3_)
+        {
+            const uint16_t link = !port.powered ? LINK_SS_DISABLED : attached ? LINK_U0 : LINK_RX_DETECT;
+            status |= link << 5;
+            if (port.powered) status |= 0x0200; // PORT_POWER (speed bits 10–12 stay 0: 5 Gbit/s)
+        }
+        else
+        {
+            if (port.powered) status |= 0x0100; // PORT_POWER
+            if (attached && port.speed == PortSpeed::Low) status |= 0x0200; // PORT_LOW_SPEED
+            if (attached && port.speed == PortSpeed::High) status |= 0x0400; // PORT_HIGH_SPEED
+        }
+        return status;
+    }
+
+    void SimulatedMega4::setPower(Port& port, const bool on) const
+    {
+        if (port.powered == on)
+            return;
+
+        // The attached device appears or disappears with the port power
+        if (port.device)
+        {
+            port.change |= CHANGE_CONNECTION;
+            port.deviceAddress = on ? nextDeviceAddress() : 0;
+        }
+        port.powered = on;
+    }
+
+    void SimulatedMega4::requestPower(Port& port, const bool on)
+    {
+        if (switchDelay_.count() == 0)
+        {
+            port.switchingTo.reset();
+            setPower(port, on);
+            return;
+        }
+        port.switchingTo = on;
+        port.switchAt = std::chrono::steady_clock::now() + switchDelay_;
+    }
+
+    void SimulatedMega4::completeSwitches() const
+    {
+        const auto now = std::chrono::steady_clock::now();
+        for (auto& port : ports_)
+        {
+            if (port.switchingTo && now >= port.switchAt)
+            {
+                setPower(port, *port.switchingTo);
+                port.switchingTo.reset();
+            }
+        }
+    }
+
+    int SimulatedMega4::controlTransfer(const uint8_t bmRequestType, const uint8_t bRequest, const uint16_t wValue,
+                                        const uint16_t wIndex, unsigned char* data, const uint16_t wLength)
+    {
+        std::chrono::microseconds latency;
+        {
+            std::lock_guard lock(mutex_);
+            ++transferCount_;
+            latency = latency_;
+        }
+        if (latency.count() > 0)
+            std::this_thread::sleep_for(latency);
+
+        std::unique_lock lock(mutex_);
+        if (paused_)
+        {
+            ++pausedTransfers_;
+            resumed_.wait(lock, [this] { return !paused_; });
+            --pausedTransfers_;
+        }
+
+        if (!connected_)
+            return LIBUSB_ERROR_NO_DEVICE;
+        completeSwitches();
+
+        if (failNext_ > 0)
+        {
+            --failNext_;
+            return failNextError_;
+        }
+        if (failureRate_ > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random_) < failureRate_)
+            return failureError_;
+
+        // Only port requests (class, recipient other) are modelled; the hub stalls anything else
+        constexpr uint8_t PORT_REQUEST = LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER;
+        if ((bmRequestType & ~LIBUSB_ENDPOINT_DIR_MASK) != PORT_REQUEST || wIndex < 1 || wIndex > 4)
+            return LIBUSB_ERROR_PIPE;
+
+        Port& port = ports_[wIndex - 1];
+
+        switch (bRequest)
+        {
+        case LIBUSB_REQUEST_GET_STATUS:
+            {
+                if (!(bmRequestType & LIBUSB_ENDPOINT_IN) || !data || wLength < 4)
+                    return LIBUSB_ERROR_PIPE;
+
+                const uint16_t status = portStatus(port);
+                data[0] = static_cast<unsigned char>(status);
+                data[1] = static_cast<unsigned char>(status >> 8);
+                data[2] = static_cast<unsigned char>(port.change);
+                data[3] = static_cast<unsigned char>(port.change >> 8);
+                return 4;
+            }
+
+        case LIBUSB_REQUEST_SET_FEATURE:
+            if (wValue == PORT_POWER)
+                requestPower(port, true);
+            else if (wValue == PORT_RESET && port.powered && port.device)
+                port.change |= CHANGE_RESET;
+            return 0;
+
+        case LIBUSB_REQUEST_CLEAR_FEATURE:
+            if (wValue == PORT_POWER)
+                requestPower(port, false);
+            else if (wValue >= C_PORT_CONNECTION && wValue <= C_PORT_RESET)
+                port.change &= static_cast<uint16_t>(~(1u << (wValue - C_PORT_CONNECTION)));
+            return 0;
+
+        default:
+            return LIBUSB_ERROR_PIPE;
+        }
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,142 @@
+#include "SimulatedTransport.hpp"
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+
+#include <libusb.h>
+#include <algorithm>
+#include <set>
+#include <string>
+
+namespace UUGear::Mega4
+{
+    SimulatedTransport::SimulatedTransport(std::vector<std::shared_ptr<SimulatedMega4>> hubs)
+    {
+        for (auto& hub : hubs)
+        {
+            auto worker = std::make_unique<Worker>();
+            worker->hub = std::move(hub);
+            worker->thread = std::thread(run, std::ref(*worker));
+            workers_.push_back(std::move(worker));
+        }
+    }
+
+    SimulatedTransport::~SimulatedTransport()
+    {
+        for (const auto& worker : workers_)
+        {
+            {
+                std::lock_guard lock(worker->mutex);
+                worker->stopping = true;
+            }
+            worker->wake.notify_all();
+            worker->thread.join();
+        }
+    }
+
+    void SimulatedTransport::run(Worker& worker)
+    {
+        std::unique_lock lock(worker.mutex);
+        while (true)
+        {
+            worker.wake.wait(lock, [&worker] { return worker.stopping || !worker.queue.empty(); });
+            if (worker.queue.empty())
+                return; // stopping, and every queued transfer has completed
+
+            Request request = std::move(worker.queue.front());
+            worker.queue.pop_front();
+            lock.unlock();
+
+            std::vector<unsigned char> data(request.wLength, 0);
+            const int result = worker.hub->controlTransfer(request.bmRequestType, request.bRequest, request.wValue,
+                                                           request.wIndex, data.data(), request.wLength);
+            try
+            {
+                request.done(result, result >= 0 ? data.data() : nullptr, std::max(result, 0));
+            }
+            catch (...)
+            {
+                // Same contract as the libusb event thread: a throwing callback must not stop the worker
+            }
+
+            lock.lock();
+        }
+    }
+
+    SimulatedTransport::Worker* SimulatedTransport::find(const std::string& hubPath) const
+    {
+        for (const auto& worker : workers_)
+        {
+            if (worker->hub->info().busPortPath == hubPath)
+                return worker.get();
+        }
+        return nullptr;
+    }
+
+    bool SimulatedTransport::enumerateHubs(std::vector<HubEntry>& hubs)
+    {
+        for (const auto& worker : workers_)
+        {
+            if (!worker->hub->connected())
+                continue;
+            hubs.push_back({worker->hub->info(), worker->hub->address()});
+        }
+        return true;
+    }
+
+    int SimulatedTransport::controlTransfer(const std::string& hubPath, const uint8_t bmRequestType,
+                                            const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                            unsigned char* data, const uint16_t wLength, unsigned int)
+    {
+        Worker* worker = find(hubPath);
+        if (!worker)
+            return LIBUSB_ERROR_NO_DEVICE;
+        return worker->hub->controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength);
+    }
+
+    int SimulatedTransport::submitControl(const std::string& hubPath, const uint8_t bmRequestType,
+                                          const uint8_t bRequest, const uint16_t wValue, const uint16_t wIndex,
+                                          const uint16_t wLength, unsigned int, Completion done)
+    {
+        Worker* worker = find(hubPath);
+        if (!worker || !worker->hub->connected())
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        {
+            std::lock_guard lock(worker->mutex);
+            worker->queue.push_back({bmRequestType, bRequest, wValue, wIndex, wLength, std::move(done)});
+        }
+        worker->wake.notify_one();
+        return 0;
+    }
+
+    bool SimulatedTransport::readPortConnections(const std::string& hubPath, std::vector<PortConnectionInfo>& ports)
+    {
+        Worker* worker = find(hubPath);
+        if (!worker || !worker->hub->connected())
+            return false;
+
+        ports = worker->hub->ports();
+
+        // Strings are read from the devices once per enumeration, like the libusb transport does
+        std::set<DescriptorCache::Key> present;
+        for (auto& port : ports)
+        {
+            const uint8_t address = worker->hub->deviceAddress(port.portNumber);
+            if (!port.hasDevice || address == 0)
+                continue;
+
+            const DescriptorCache::Key key{0, address, hubPath + "." + std::to_string(port.portNumber)};
+            DescriptorCache::Strings strings;
+            if (!worker->descriptors.lookup(key, strings))
+            {
+                if (!worker->hub->readDeviceStrings(port.portNumber, strings.manufacturer, strings.product))
+                    continue;
+                worker->descriptors.store(key, strings);
+            }
+            port.manufacturer = strings.manufacturer;
+            port.product = strings.product;
+            present.insert(key);
+        }
+        worker->descriptors.retain(present);
+        return true;
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,78 @@
+#ifndef UUGEAR_MEGA4_LIB_SIMULATEDTRANSPORT_HPP
+#define UUGEAR_MEGA4_LIB_SIMULATEDTRANSPORT_HPP
+
+#include "DescriptorCache.hpp"
+#include "UsbTransport.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class SimulatedMega4;
+    class SimulatedTransport;
+}
+
+/**
+ * @brief UsbTransport answering from SimulatedMega4 models instead of the USB bus.
+ *
+ * Synchronous transfers run on the calling thread. Asynchronous ones are queued
+ * to one worker thread per hub, so requests to the same hub are answered one at
+ * a time (as on a real control endpoint) while different hubs overlap.
+ */
+class UUGear::Mega4::SimulatedTransport final : public UsbTransport
+{
+public:
+    explicit SimulatedTransport(std::vector<std::shared_ptr<SimulatedMega4>> hubs);
+
+    /**
+     * @brief Completes every queued transfer, then stops the workers.
+     */
+    ~SimulatedTransport() override;
+
+    SimulatedTransport(const SimulatedTransport&) = delete;
+    SimulatedTransport& operator=(const SimulatedTransport&) = delete;
+
+    bool enumerateHubs(std::vector<HubEntry>& hubs) override;
+
+    int controlTransfer(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                        uint16_t wIndex, unsigned char* data, uint16_t wLength, unsigned int timeoutMs) override;
+
+    int submitControl(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue,
+                      uint16_t wIndex, uint16_t wLength, unsigned int timeoutMs, Completion done) override;
+
+    bool readPortConnections(const std::string& hubPath, std::vector<PortConnectionInfo>& ports) override;
+
+private:
+    struct Request
+    {
+        uint8_t bmRequestType;
+        uint8_t bRequest;
+        uint16_t wValue;
+        uint16_t wIndex;
+        uint16_t wLength;
+        Completion done;
+    };
+
+    struct Worker
+    {
+        std::shared_ptr<SimulatedMega4> hub;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<Request> queue;
+        bool stopping = false;
+        std::thread thread;
+        DescriptorCache descriptors; ///< Port device strings, as the libusb transport keeps them
+    };
+
+    [[nodiscard]] Worker* find(const std::string& hubPath) const;
+    static void run(Worker& worker);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_SIMULATEDTRANSPORT_HPP
@@ -0,0 +1,214 @@
+#include "StatusChangeListener.hpp"
+#include "AsyncTransferEngine.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    // Hub class request type for port requests (GET_STATUS adds LIBUSB_ENDPOINT_IN)
+    constexpr uint8_t PORT_REQUEST_TYPE = LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER;
+
+    /**
+     * @brief A wPortChange bit and the C_PORT_* feature selector that clears it.
+     */
+    struct ChangeFeature
+    {
+        uint16_t bit;
+        uint16_t feature;
+    };
+
+    /**
+     * @brief The change bits a hub reports, with their features. The USB3 hub reserves
+     *        bits 1–2 and adds C_BH_PORT_RESET (29), C_PORT_LINK_STATE (25) and
+     *        C_PORT_CONFIG_ERROR (26) on bits 5–7.
+     */
+    static const std::vector<ChangeFeature>& changeFeatures(const bool superSpeedHub)
+    {
+        static const std::vector<ChangeFeature> usb2 = {{0, 16}, {1, 17}, {2, 18}, {3, 19}, {4, 20}};
+        static const std::vector<ChangeFeature> usb3 = {{0, 16}, {3, 19}, {4, 20}, {5, 29}, {6, 25}, {7, 26}};
+        return superSpeedHub ? usb3 : usb2;
+    }
+
+    // Change bits of wPortChange that have a C_PORT_* feature to clear them
+    constexpr uint16_t USB2_PORT_CHANGE_MASK = 0x001F;
+    constexpr uint16_t USB3_PORT_CHANGE_MASK = 0x00F9;
+
+    constexpr unsigned int REQUEST_TIMEOUT_MS = 1000;
+
+    StatusChangeListener::StatusChangeListener(AsyncTransferEngine& engine, libusb_device* hub,
+                                               const bool superSpeedHub, Handler handler)
+        : engine_(engine), handler_(std::move(handler)), superSpeedHub_(superSpeedHub)
+    {
+        if (libusb_open(hub, &handle_) != 0)
+            throw std::runtime_error("Failed to open USB device");
+    }
+
+    StatusChangeListener::~StatusChangeListener()
+    {
+        bool interruptPending;
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+            interruptPending = interruptTransfer_ && pending_ > 0;
+        }
+
+        if (interruptPending)
+            libusb_cancel_transfer(interruptTransfer_);
+
+        {
+            std::unique_lock lock(mutex_);
+            idle_.wait(lock, [this] { return pending_ == 0; });
+        }
+
+        if (interruptTransfer_)
+            libusb_free_transfer(interruptTransfer_);
+        if (interfaceClaimed_)
+            libusb_release_interface(handle_, 0);
+        libusb_close(handle_);
+    }
+
+    int StatusChangeListener::findStatusChangeEndpoint(uint8_t& endpoint, uint16_t& packetSize) const
+    {
+        libusb_config_descriptor* config = nullptr;
+        if (const int ret = libusb_get_active_config_descriptor(libusb_get_device(handle_), &config); ret != 0)
+            return ret;
+
+        int ret = LIBUSB_ERROR_NOT_FOUND;
+        if (config->bNumInterfaces > 0 && config->interface[0].num_altsetting > 0)
+        {
+            const libusb_interface_descriptor& hubInterface = config->interface[0].altsetting[0];
+            for (int i = 0; i < hubInterface.bNumEndpoints; ++i)
+            {
+                const libusb_endpoint_descriptor& ep = hubInterface.endpoint[i];
+                if ((ep.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN &&
+                    (ep.bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT)
+                {
+                    endpoint = ep.bEndpointAddress;
+                    packetSize = ep.wMaxPacketSize;
+                    ret = 0;
+                    break;
+                }
+            }
+        }
+
+        libusb_free_config_descriptor(config);
+        return ret;
+    }
+
+    bool StatusChangeListener::start()
+    {
+        uint8_t endpoint = 0;
+        uint16_t packetSize = 0;
+        if (interruptTransfer_ || findStatusChangeEndpoint(endpoint, packetSize) != 0 || packetSize == 0)
+            return listening();
+
+        // Taking the hub interface away from the kernel driver would disconnect every downstream device
+        if (libusb_kernel_driver_active(handle_, 0) == 1 || libusb_claim_interface(handle_, 0) != 0)
+            return false;
+        interfaceClaimed_ = true;
+
+        libusb_transfer* transfer = libusb_alloc_transfer(0);
+        if (!transfer)
+            return false;
+
+        interruptBuffer_.assign(packetSize, 0);
+        libusb_fill_interrupt_transfer(transfer, handle_, endpoint, interruptBuffer_.data(), packetSize,
+                                       onInterrupt, this, 0);
+        engine_.startEventThread();
+
+        std::lock_guard lock(mutex_);
+        if (libusb_submit_transfer(transfer) != 0)
+        {
+            libusb_free_transfer(transfer);
+            return false;
+        }
+        ++pending_;
+        interruptTransfer_ = transfer;
+        return true;
+    }
+
+    void StatusChangeListener::onInterrupt(libusb_transfer* transfer)
+    {
+        auto* self = static_cast<StatusChangeListener*>(transfer->user_data);
+
+        if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+        {
+            // Bit 0 is the hub itself, bit N is port N
+            for (int port = 1; port <= 4; ++port)
+            {
+                if (port / 8 < transfer->actual_length && (transfer->buffer[port / 8] & (1u << (port % 8))))
+                    self->refreshPort(port);
+            }
+
+            std::lock_guard lock(self->mutex_);
+            if (!self->stopping_ && libusb_submit_transfer(transfer) == 0)
+                return;
+        }
+
+        // Cancelled, hub gone or endpoint error: stop listening
+        self->transferDone();
+    }
+
+    void StatusChangeListener::refreshPort(const int port)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            if (stopping_)
+                return;
+            ++pending_;
+        }
+
+        const int ret = engine_.submitControl(
+            handle_, LIBUSB_ENDPOINT_IN | PORT_REQUEST_TYPE, LIBUSB_REQUEST_GET_STATUS, 0, port, 4, nullptr,
+            REQUEST_TIMEOUT_MS,
+            [this, port](const int result, const uint8_t* data, int)
+            {
+                if (result == 4)
+                {
+                    const auto wPortStatus = static_cast<uint16_t>(data[0] | (data[1] << 8));
+                    const auto wPortChange = static_cast<uint16_t>(data[2] | (data[3] << 8));
+
+                    // Without the kernel driver nobody else acknowledges the change, or the hub keeps reporting it
+                    const uint16_t changeMask = superSpeedHub_ ? USB3_PORT_CHANGE_MASK : USB2_PORT_CHANGE_MASK;
+                    if (interfaceClaimed_ && (wPortChange & changeMask))
+                        clearChangeBits(port, wPortChange);
+
+                    handler_(port, wPortStatus, wPortChange);
+                }
+                transferDone();
+            });
+
+        if (ret != 0)
+            transferDone();
+    }
+
+    void StatusChangeListener::clearChangeBits(const int port, const uint16_t wPortChange)
+    {
+        for (const auto& [bit, feature] : changeFeatures(superSpeedHub_))
+        {
+            if (!(wPortChange & (1u << bit)))
+                continue;
+
+            {
+                std::lock_guard lock(mutex_);
+                if (stopping_)
+                    return;
+                ++pending_;
+            }
+
+            const int ret = engine_.submitControl(handle_, PORT_REQUEST_TYPE, LIBUSB_REQUEST_CLEAR_FEATURE,
+                                                  feature, port, 0, nullptr, REQUEST_TIMEOUT_MS,
+                                                  [this](int, const uint8_t*, int) { transferDone(); });
+            if (ret != 0)
+                transferDone();
+        }
+    }
+
+    void StatusChangeListener::transferDone()
+    {
+        std::lock_guard lock(mutex_);
+        if (--pending_ == 0)
+            idle_.notify_all();
+    }
+} // namespace UUGear::Mega4
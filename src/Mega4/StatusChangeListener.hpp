@@ -0,0 +1,87 @@
+#ifndef UUGEAR_MEGA4_LIB_STATUSCHANGELISTENER_HPP
+#define UUGEAR_MEGA4_LIB_STATUSCHANGELISTENER_HPP
+
+#include <libusb.h>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class AsyncTransferEngine;
+    class StatusChangeListener;
+}
+
+/**
+ * @brief Keeps an interrupt transfer pending on a hub's status-change endpoint and
+ *        reads GET_STATUS only for the ports whose change bit is set.
+ *
+ * The status-change endpoint belongs to the hub interface. When the kernel hub
+ * driver is bound to it (the normal case on Linux), the endpoint cannot be claimed
+ * without disconnecting every downstream device, so the listener runs in hint mode:
+ * it does not listen on the endpoint and only refreshes the ports it is told about
+ * through refreshPort() (hotplug events, own power requests).
+ *
+ * Handlers run on the libusb event thread.
+ */
+class UUGear::Mega4::StatusChangeListener
+{
+public:
+    /**
+     * @brief Receives the raw wPortStatus/wPortChange words read for a port.
+     */
+    using Handler = std::function<void(int port, uint16_t wPortStatus, uint16_t wPortChange)>;
+
+    /**
+     * @brief Opens its own handle on the hub; does not start listening yet.
+     * @param superSpeedHub True for the USB3 hub, whose wPortChange bits differ from USB2.
+     * @throws std::runtime_error if the hub cannot be opened.
+     */
+    StatusChangeListener(AsyncTransferEngine& engine, libusb_device* hub, bool superSpeedHub, Handler handler);
+
+    /**
+     * @brief Cancels the interrupt transfer, waits for pending reads and releases the hub.
+     */
+    ~StatusChangeListener();
+
+    StatusChangeListener(const StatusChangeListener&) = delete;
+    StatusChangeListener& operator=(const StatusChangeListener&) = delete;
+
+    /**
+     * @brief Claims the hub interface and submits the interrupt transfer.
+     * @return True if listening on the status-change endpoint, false if running in hint mode.
+     */
+    bool start();
+
+    /**
+     * @brief Reads GET_STATUS for a single port and reports it to the handler.
+     */
+    void refreshPort(int port);
+
+    [[nodiscard]] bool listening() const noexcept { return interruptTransfer_ != nullptr; }
+
+private:
+    static void LIBUSB_CALL onInterrupt(libusb_transfer* transfer);
+
+    int findStatusChangeEndpoint(uint8_t& endpoint, uint16_t& packetSize) const;
+    void clearChangeBits(int port, uint16_t wPortChange);
+    void transferDone();
+
+    AsyncTransferEngine& engine_;
+    libusb_device_handle* handle_ = nullptr;
+    Handler handler_;
+    bool superSpeedHub_;
+
+    bool interfaceClaimed_ = false;
+    libusb_transfer* interruptTransfer_ = nullptr;
+    std::vector<unsigned char> interruptBuffer_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    bool stopping_ = false;
+    int pending_ = 0; ///< Interrupt transfer + in-flight GET_STATUS/CLEAR_FEATURE requests
+};
+
+#endif //UUGEAR_MEGA4_LIB_STATUSCHANGELISTENER_HPP
@@ -0,0 +1,169 @@
+#include "SysfsBackend.hpp"
+#include "HubRegistry.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace UUGear::Mega4
+{
+    /**
+     * @brief Reads the first line of a sysfs attribute.
+     * @return False if the file cannot be read.
+     */
+    static bool readAttribute(const fs::path& path, std::string& value)
+    {
+        std::ifstream in(path);
+        return static_cast<bool>(std::getline(in, value));
+    }
+
+    static bool readHexAttribute(const fs::path& path, uint16_t& value)
+    {
+        std::string text;
+        if (!readAttribute(path, text))
+            return false;
+
+        try
+        {
+            value = static_cast<uint16_t>(std::stoul(text, nullptr, 16));
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    SysfsBackend::SysfsBackend(std::string root) : root_(std::move(root))
+    {
+    }
+
+    bool SysfsBackend::available() const
+    {
+        std::error_code ec;
+        return !root_.empty() && fs::is_directory(root_, ec);
+    }
+
+    std::string SysfsBackend::sysfsName(const std::string& busPortPath)
+    {
+        // "<bus>-<port>-<port>..." → "<bus>-<port>.<port>..."
+        std::string name = busPortPath;
+        const size_t first = name.find('-');
+        if (first == std::string::npos)
+            return name;
+
+        for (size_t i = first + 1; i < name.size(); ++i)
+        {
+            if (name[i] == '-')
+                name[i] = '.';
+        }
+        return name;
+    }
+
+    std::string SysfsBackend::portDisablePath(const std::string& busPortPath, const int port) const
+    {
+        const std::string hub = sysfsName(busPortPath);
+        return (fs::path(root_) / hub / (hub + ":1.0") / (hub + "-port" + std::to_string(port)) / "disable").string();
+    }
+
+    bool SysfsBackend::listHubs(std::vector<UsbTransport::HubEntry>& hubs) const
+    {
+        std::error_code ec;
+        fs::directory_iterator it(root_, ec);
+        if (ec)
+            return false;
+
+        for (const auto& entry : it)
+        {
+            // Interfaces ("1-1:1.0") and root hubs ("usb1") are not hub devices of interest
+            const std::string name = entry.path().filename().string();
+            if (name.find(':') != std::string::npos || name.find('-') == std::string::npos)
+                continue;
+
+            UsbTransport::HubEntry hub;
+            if (!readHexAttribute(entry.path() / "idVendor", hub.info.vid) ||
+                !readHexAttribute(entry.path() / "idProduct", hub.info.pid) ||
+                !isMega4(hub.info.vid, hub.info.pid))
+                continue;
+
+            std::string devnum;
+            readAttribute(entry.path() / "devnum", devnum);
+            hub.address = static_cast<uint8_t>(std::atoi(devnum.c_str()));
+
+            hub.info.busPortPath = name;
+            for (char& c : hub.info.busPortPath)
+            {
+                if (c == '.') c = '-';
+            }
+            hub.info.description = "VIA Labs VL817 Hub (" + std::string(
+                    hub.info.pid == MEGA4_PID_USB3 ? "USB3" : "USB2")
+                + ")";
+            hubs.push_back(std::move(hub));
+        }
+        return true;
+    }
+
+    bool SysfsBackend::readPortPower(const std::string& busPortPath, std::array<bool, 4>& states) const
+    {
+        for (int port = 1; port <= 4; ++port)
+        {
+            std::string disabled;
+            if (!readAttribute(portDisablePath(busPortPath, port), disabled) || disabled.empty())
+                return false;
+            states[port - 1] = disabled[0] == '0';
+        }
+        return true;
+    }
+
+    bool SysfsBackend::writePortPower(const std::string& busPortPath, const int port, const bool on) const
+    {
+        const std::string path = portDisablePath(busPortPath, port);
+
+        std::error_code ec;
+        if (!fs::exists(path, ec))
+            return false;
+
+        std::ofstream out(path);
+        out << (on ? "0" : "1");
+        out.flush();
+        return static_cast<bool>(out);
+    }
+
+    bool SysfsBackend::readPortConnections(const std::string& busPortPath, std::vector<PortConnectionInfo>& ports) const
+    {
+        const std::string hub = sysfsName(busPortPath);
+
+        std::error_code ec;
+        if (!fs::is_directory(fs::path(root_) / hub, ec))
+            return false;
+
+        for (int port = 1; port <= 4; ++port)
+        {
+            PortConnectionInfo& info = ports[port - 1];
+            const fs::path child = fs::path(root_) / (hub + "." + std::to_string(port));
+
+            if (!readHexAttribute(child / "idVendor", info.vid) || !readHexAttribute(child / "idProduct", info.pid))
+                continue;
+
+            info.hasDevice = true;
+            uint16_t deviceClass = 0;
+            readHexAttribute(child / "bDeviceClass", deviceClass);
+            if (deviceClass == 0)
+            {
+                // Class declared per interface: take the first interface of the active configuration
+                std::string configuration;
+                if (!readAttribute(child / "bConfigurationValue", configuration) || configuration.empty())
+                    configuration = "1";
+                readHexAttribute(child / (child.filename().string() + ":" + configuration + ".0") / "bInterfaceClass",
+                                 deviceClass);
+            }
+            info.deviceClass = static_cast<uint8_t>(deviceClass);
+            // The kernel keeps the strings it read at enumeration; reading them costs no USB I/O
+            readAttribute(child / "manufacturer", info.manufacturer);
+            readAttribute(child / "product", info.product);
+        }
+        return true;
+    }
+} // namespace UUGear::Mega4
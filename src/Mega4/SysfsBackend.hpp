@@ -0,0 +1,79 @@
+#ifndef UUGEAR_MEGA4_LIB_SYSFSBACKEND_HPP
+#define UUGEAR_MEGA4_LIB_SYSFSBACKEND_HPP
+
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UsbTransport.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class SysfsBackend;
+}
+
+/**
+ * @brief Reads the hub topology and switches port power through the Linux USB sysfs
+ *        tree (/sys/bus/usb/devices) instead of usbfs.
+ *
+ * Nothing is opened and no control transfer is issued by the process: hubs and
+ * port devices are found from their idVendor/idProduct/... attribute files, and
+ * port power goes through the hub port "disable" attribute
+ * (<hub>:1.0/<hub>-portN/disable), which the kernel hub driver maps to
+ * SET/CLEAR_FEATURE(PORT_POWER). Every method reports whether sysfs could serve
+ * the request, so callers fall back to libusb when a path is missing or not writable.
+ *
+ * Paths handed in and out use the DeviceInfo::busPortPath format ("1-1-2"); the
+ * sysfs device name of the same hub is "1-1.2".
+ */
+class UUGear::Mega4::SysfsBackend
+{
+public:
+    /**
+     * @param root Directory holding the USB device entries, normally "/sys/bus/usb/devices".
+     */
+    explicit SysfsBackend(std::string root);
+
+    /**
+     * @brief Returns true if the root directory exists.
+     */
+    [[nodiscard]] bool available() const;
+
+    /**
+     * @brief Lists the MEGA4 hubs present under the root.
+     * @return False if the root cannot be read.
+     */
+    bool listHubs(std::vector<UsbTransport::HubEntry>& hubs) const;
+
+    /**
+     * @brief Reads the power state of all four ports of a hub.
+     * @return False if any port attribute is missing or unreadable.
+     */
+    bool readPortPower(const std::string& busPortPath, std::array<bool, 4>& states) const;
+
+    /**
+     * @brief Switches the power of one port.
+     * @return False if the attribute is missing or cannot be written (e.g. no permission).
+     */
+    bool writePortPower(const std::string& busPortPath, int port, bool on) const;
+
+    /**
+     * @brief Describes the devices attached to the four ports of a hub.
+     * @return False if the hub is not present under the root.
+     */
+    bool readPortConnections(const std::string& busPortPath, std::vector<PortConnectionInfo>& ports) const;
+
+    /**
+     * @brief Converts a busPortPath ("1-1-2") to the sysfs device name ("1-1.2").
+     */
+    static std::string sysfsName(const std::string& busPortPath);
+
+private:
+    [[nodiscard]] std::string portDisablePath(const std::string& busPortPath, int port) const;
+
+    std::string root_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_SYSFSBACKEND_HPP
@@ -0,0 +1,49 @@
+#include "ThreadPool.hpp"
+
+namespace UUGear::Mega4
+{
+    ThreadPool::ThreadPool(const size_t threads)
+    {
+        const size_t count = threads ? threads : 1;
+        workers_.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            workers_.emplace_back([this] { run(); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
+    }
+
+    void ThreadPool::post(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        wake_.notify_one();
+    }
+
+    void ThreadPool::run()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+} // namespace UUGear::Mega4
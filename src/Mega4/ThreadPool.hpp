@@ -0,0 +1,55 @@
+#ifndef UUGEAR_MEGA4_LIB_THREADPOOL_HPP
+#define UUGEAR_MEGA4_LIB_THREADPOOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class ThreadPool;
+}
+
+/**
+ * @brief Fixed set of worker threads running queued tasks in FIFO order.
+ *
+ * Meant for blocking USB work: the threads mostly wait on transfers, so the
+ * pool is sized by how many hubs should be talked to at once, not by cores.
+ */
+class UUGear::Mega4::ThreadPool
+{
+public:
+    /**
+     * @param threads Number of workers (at least one).
+     */
+    explicit ThreadPool(size_t threads);
+
+    /**
+     * @brief Runs the tasks already queued, then joins the workers.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task. Tasks must not throw.
+     */
+    void post(std::function<void()> task);
+
+    [[nodiscard]] size_t size() const { return workers_.size(); }
+
+private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_THREADPOOL_HPP
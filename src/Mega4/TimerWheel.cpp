@@ -0,0 +1,54 @@
+#include "TimerWheel.hpp"
+
+namespace UUGear::Mega4
+{
+    TimerWheel::TimerWheel(const Clock::duration tick, const size_t slots)
+        : tick_(tick), slots_(slots ? slots : 1), current_(Clock::now())
+    {
+    }
+
+    void TimerWheel::schedule(const Clock::time_point deadline, Callback callback)
+    {
+        if (pending_ == 0 && current_ < Clock::now())
+            current_ = Clock::now(); // nothing was pending, so no slot was skipped
+
+        size_t ticks = 0;
+        if (deadline > current_)
+            ticks = static_cast<size_t>((deadline - current_ + tick_ - Clock::duration(1)) / tick_);
+
+        slots_[(cursor_ + ticks) % slots_.size()].push_back({ticks / slots_.size(), std::move(callback)});
+        ++pending_;
+    }
+
+    void TimerWheel::advance(const Clock::time_point now)
+    {
+        std::vector<Callback> due;
+        while (pending_ > 0 && current_ <= now)
+        {
+            auto& slot = slots_[cursor_];
+            for (size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].rounds == 0)
+                {
+                    due.push_back(std::move(slot[i].callback));
+                    slot[i] = std::move(slot.back());
+                    slot.pop_back();
+                    --pending_;
+                }
+                else
+                {
+                    --slot[i].rounds;
+                    ++i;
+                }
+            }
+
+            cursor_ = (cursor_ + 1) % slots_.size();
+            current_ += tick_;
+
+            // Run after moving on, so timers they schedule are placed from the next slot
+            for (auto& callback : due)
+                callback();
+            due.clear();
+        }
+    }
+} // namespace UUGear::Mega4
@@ -0,0 +1,61 @@
+#ifndef UUGEAR_MEGA4_LIB_TIMERWHEEL_HPP
+#define UUGEAR_MEGA4_LIB_TIMERWHEEL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class TimerWheel;
+}
+
+/**
+ * @brief Hashed timer wheel: one-shot timers in a ring of slots one tick apart.
+ *
+ * Scheduling and expiry are O(1) per timer whatever the number pending; timers
+ * further away than one revolution wait a number of extra rounds in their slot.
+ * A timer fires on the first tick at or after its deadline. Not thread-safe:
+ * meant to be driven by a single thread calling advance() at nextTick().
+ */
+class UUGear::Mega4::TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    TimerWheel(Clock::duration tick, size_t slots);
+
+    /**
+     * @brief Adds a timer. May be called from a callback run by advance().
+     */
+    void schedule(Clock::time_point deadline, Callback callback);
+
+    /**
+     * @brief Runs, in deadline order by tick, the callbacks of every timer due at now.
+     */
+    void advance(Clock::time_point now);
+
+    /**
+     * @brief Time advance() should next be called at; only meaningful when !empty().
+     */
+    [[nodiscard]] Clock::time_point nextTick() const { return current_; }
+
+    [[nodiscard]] bool empty() const { return pending_ == 0; }
+
+private:
+    struct Timer
+    {
+        size_t rounds; ///< Revolutions left before the timer fires
+        Callback callback;
+    };
+
+    Clock::duration tick_;
+    std::vector<std::vector<Timer>> slots_;
+    size_t cursor_ = 0; ///< Slot processed at current_
+    Clock::time_point current_; ///< Time of the next slot to process
+    size_t pending_ = 0;
+};
+
+#endif //UUGEAR_MEGA4_LIB_TIMERWHEEL_HPP
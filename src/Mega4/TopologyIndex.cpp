@@ -0,0 +1,97 @@
+#include "TopologyIndex.hpp"
+
+namespace UUGear::Mega4
+{
+    TopologyIndex::~TopologyIndex() { clear(); }
+
+    void TopologyIndex::clear()
+    {
+        std::lock_guard lock(mutex_);
+
+        for (const auto& [parent, ports] : children_)
+        {
+            for (const auto& [port, dev] : ports)
+                libusb_unref_device(dev);
+        }
+        children_.clear();
+        location_.clear();
+    }
+
+    void TopologyIndex::rebuild(libusb_device* const* list, const ssize_t count)
+    {
+        clear();
+        for (ssize_t i = 0; i < count; ++i)
+            add(list[i]);
+    }
+
+    void TopologyIndex::add(libusb_device* dev)
+    {
+        const libusb_device* parent = libusb_get_parent(dev);
+        const uint8_t port = libusb_get_port_number(dev);
+        if (!parent || port == 0)
+            return;
+
+        std::lock_guard lock(mutex_);
+
+        if (location_.count(dev))
+            return; // already indexed (seen by both the enumeration and a hotplug event)
+
+        libusb_device*& slot = children_[parent][port];
+        if (slot)
+        {
+            // A departure was missed; the new device replaces the stale one on that port
+            location_.erase(slot);
+            libusb_unref_device(slot);
+        }
+        slot = libusb_ref_device(dev);
+        location_[dev] = {parent, port};
+    }
+
+    void TopologyIndex::remove(libusb_device* dev)
+    {
+        std::lock_guard lock(mutex_);
+
+        if (const auto it = location_.find(dev); it != location_.end())
+        {
+            const auto [parent, port] = it->second;
+            location_.erase(it);
+
+            auto& ports = children_[parent];
+            ports.erase(port);
+            if (ports.empty())
+                children_.erase(parent);
+
+            libusb_unref_device(dev);
+        }
+
+        // Children of a departed hub leave before it does; drop whatever is left
+        if (const auto it = children_.find(dev); it != children_.end())
+        {
+            for (const auto& [port, child] : it->second)
+            {
+                location_.erase(child);
+                libusb_unref_device(child);
+            }
+            children_.erase(it);
+        }
+    }
+
+    std::vector<std::pair<uint8_t, libusb_device*>> TopologyIndex::children(const libusb_device* parent) const
+    {
+        std::vector<std::pair<uint8_t, libusb_device*>> result;
+        std::lock_guard lock(mutex_);
+
+        if (const auto it = children_.find(parent); it != children_.end())
+        {
+            for (const auto& [port, dev] : it->second)
+                result.emplace_back(port, libusb_ref_device(dev));
+        }
+        return result;
+    }
+
+    size_t TopologyIndex::size() const
+    {
+        std::lock_guard lock(mutex_);
+        return location_.size();
+    }
+} // namespace UUGear::Mega4
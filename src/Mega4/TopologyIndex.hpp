@@ -0,0 +1,73 @@
+#ifndef UUGEAR_MEGA4_LIB_TOPOLOGYINDEX_HPP
+#define UUGEAR_MEGA4_LIB_TOPOLOGYINDEX_HPP
+
+#include <libusb.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class TopologyIndex;
+}
+
+/**
+ * @brief Parent → children map of the USB bus, indexed by the parent device and
+ *        the port each child is attached to.
+ *
+ * The index is filled from one device enumeration and then kept current one
+ * device at a time (hotplug arrivals and departures), so looking up what sits
+ * on the ports of a hub does not walk the whole bus. Every indexed device holds
+ * a libusb reference until it is removed.
+ */
+class UUGear::Mega4::TopologyIndex
+{
+public:
+    TopologyIndex() = default;
+    ~TopologyIndex();
+
+    TopologyIndex(const TopologyIndex&) = delete;
+    TopologyIndex& operator=(const TopologyIndex&) = delete;
+
+    /**
+     * @brief Replaces the index with the devices of one enumeration.
+     */
+    void rebuild(libusb_device* const* list, ssize_t count);
+
+    /**
+     * @brief Indexes a device under its parent (no-op for root hubs).
+     */
+    void add(libusb_device* dev);
+
+    /**
+     * @brief Forgets a device, and its own children entry if it was a hub.
+     */
+    void remove(libusb_device* dev);
+
+    /**
+     * @brief Returns the devices attached to a parent, ordered by port number.
+     *        Each returned device carries a reference the caller must drop with
+     *        libusb_unref_device.
+     */
+    [[nodiscard]] std::vector<std::pair<uint8_t, libusb_device*>> children(const libusb_device* parent) const;
+
+    /**
+     * @brief Returns the number of indexed devices.
+     */
+    [[nodiscard]] size_t size() const;
+
+    /**
+     * @brief Drops every indexed device.
+     */
+    void clear();
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<const libusb_device*, std::map<uint8_t, libusb_device*>> children_; ///< Parent → port → child
+    std::unordered_map<const libusb_device*, std::pair<const libusb_device*, uint8_t>> location_; ///< Child → (parent, port)
+};
+
+#endif //UUGEAR_MEGA4_LIB_TOPOLOGYINDEX_HPP
@@ -0,0 +1,216 @@
+#include "TransportTrace.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace UUGear::Mega4
+{
+    constexpr char TRACE_MAGIC[8] = {'M', 'E', 'G', 'A', '4', 'T', 'R', 'C'};
+    constexpr uint16_t TRACE_VERSION = 1;
+
+    namespace
+    {
+        class Encoder
+        {
+        public:
+            void u8(const uint8_t v) { bytes.push_back(v); }
+
+            void u16(const uint16_t v)
+            {
+                u8(static_cast<uint8_t>(v));
+                u8(static_cast<uint8_t>(v >> 8));
+            }
+
+            void u32(const uint32_t v)
+            {
+                u16(static_cast<uint16_t>(v));
+                u16(static_cast<uint16_t>(v >> 16));
+            }
+
+            void u64(const uint64_t v)
+            {
+                u32(static_cast<uint32_t>(v));
+                u32(static_cast<uint32_t>(v >> 32));
+            }
+
+            void blob(const void* data, const size_t size)
+            {
+                const size_t length = std::min<size_t>(size, UINT16_MAX);
+                u16(static_cast<uint16_t>(length));
+                const auto* p = static_cast<const uint8_t*>(data);
+                bytes.insert(bytes.end(), p, p + length);
+            }
+
+            void str(const std::string& s) { blob(s.data(), s.size()); }
+
+            std::vector<uint8_t> bytes;
+        };
+
+        class Decoder
+        {
+        public:
+            explicit Decoder(std::ifstream& in) : in_(in) {}
+
+            [[nodiscard]] bool atEnd() const { return in_.peek() == std::ifstream::traits_type::eof(); }
+
+            uint8_t u8()
+            {
+                char c;
+                if (!in_.get(c))
+                    throw std::runtime_error("Truncated USB trace");
+                return static_cast<uint8_t>(c);
+            }
+
+            uint16_t u16()
+            {
+                const uint16_t lo = u8();
+                return static_cast<uint16_t>(lo | (u8() << 8));
+            }
+
+            uint32_t u32()
+            {
+                const uint32_t lo = u16();
+                return lo | (static_cast<uint32_t>(u16()) << 16);
+            }
+
+            uint64_t u64()
+            {
+                const uint64_t lo = u32();
+                return lo | (static_cast<uint64_t>(u32()) << 32);
+            }
+
+            std::vector<uint8_t> blob()
+            {
+                std::vector<uint8_t> data(u16());
+                if (!data.empty() && !in_.read(reinterpret_cast<char*>(data.data()),
+                                               static_cast<std::streamsize>(data.size())))
+                    throw std::runtime_error("Truncated USB trace");
+                return data;
+            }
+
+            std::string str()
+            {
+                const auto data = blob();
+                return {data.begin(), data.end()};
+            }
+
+        private:
+            std::ifstream& in_;
+        };
+    }
+
+    TraceWriter::TraceWriter(const std::string& path)
+        : out_(path, std::ios::binary | std::ios::trunc), origin_(std::chrono::steady_clock::now())
+    {
+        if (!out_)
+            throw std::runtime_error("Failed to create USB trace file: " + path);
+
+        Encoder header;
+        for (const char c : TRACE_MAGIC)
+            header.u8(static_cast<uint8_t>(c));
+        header.u16(TRACE_VERSION);
+        out_.write(reinterpret_cast<const char*>(header.bytes.data()),
+                   static_cast<std::streamsize>(header.bytes.size()));
+    }
+
+    std::chrono::nanoseconds TraceWriter::elapsed() const
+    {
+        return std::chrono::steady_clock::now() - origin_;
+    }
+
+    void TraceWriter::write(const TraceRecord& record)
+    {
+        Encoder e;
+        e.u8(static_cast<uint8_t>(record.kind));
+        e.u8(record.flags);
+        e.u64(static_cast<uint64_t>(record.start.count()));
+        e.u64(static_cast<uint64_t>(record.duration.count()));
+        e.u32(static_cast<uint32_t>(record.result));
+
+        if (record.kind == TraceRecord::Kind::Enumeration)
+        {
+            e.u16(static_cast<uint16_t>(record.hubs.size()));
+            for (const auto& hub : record.hubs)
+            {
+                e.str(hub.info.busPortPath);
+                e.u16(hub.info.vid);
+                e.u16(hub.info.pid);
+                e.u8(hub.address);
+                e.str(hub.info.description);
+            }
+        }
+        else
+        {
+            e.str(record.hubPath);
+            e.u8(record.bmRequestType);
+            e.u8(record.bRequest);
+            e.u16(record.wValue);
+            e.u16(record.wIndex);
+            e.u16(record.wLength);
+            e.blob(record.data.data(), record.data.size());
+            if (record.flags & TraceRecord::FLAG_THREW)
+                e.str(record.message);
+        }
+
+        std::lock_guard lock(mutex_);
+        out_.write(reinterpret_cast<const char*>(e.bytes.data()), static_cast<std::streamsize>(e.bytes.size()));
+    }
+
+    std::vector<TraceRecord> TraceReader::readAll(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("Failed to open USB trace file: " + path);
+
+        Decoder d(in);
+        for (const char c : TRACE_MAGIC)
+        {
+            if (d.u8() != static_cast<uint8_t>(c))
+                throw std::runtime_error("Not a USB trace file: " + path);
+        }
+        if (d.u16() != TRACE_VERSION)
+            throw std::runtime_error("Unsupported USB trace version: " + path);
+
+        std::vector<TraceRecord> records;
+        while (!d.atEnd())
+        {
+            TraceRecord record;
+            record.kind = static_cast<TraceRecord::Kind>(d.u8());
+            record.flags = d.u8();
+            record.start = std::chrono::nanoseconds(d.u64());
+            record.duration = std::chrono::nanoseconds(d.u64());
+            record.result = static_cast<int32_t>(d.u32());
+
+            if (record.kind == TraceRecord::Kind::Enumeration)
+            {
+                record.hubs.resize(d.u16());
+                for (auto& hub : record.hubs)
+                {
+                    hub.info.busPortPath = d.str();
+                    hub.info.vid = d.u16();
+                    hub.info.pid = d.u16();
+                    hub.address = d.u8();
+                    hub.info.description = d.str();
+                }
+            }
+            else if (record.kind == TraceRecord::Kind::Control || record.kind == TraceRecord::Kind::AsyncControl)
+            {
+                record.hubPath = d.str();
+                record.bmRequestType = d.u8();
+                record.bRequest = d.u8();
+                record.wValue = d.u16();
+                record.wIndex = d.u16();
+                record.wLength = d.u16();
+                record.data = d.blob();
+                if (record.flags & TraceRecord::FLAG_THREW)
+                    record.message = d.str();
+            }
+            else
+            {
+                throw std::runtime_error("Corrupt USB trace file: " + path);
+            }
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+} // namespace UUGear::Mega4
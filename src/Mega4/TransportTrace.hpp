@@ -0,0 +1,98 @@
+#ifndef UUGEAR_MEGA4_LIB_TRANSPORTTRACE_HPP
+#define UUGEAR_MEGA4_LIB_TRANSPORTTRACE_HPP
+
+#include "UsbTransport.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    struct TraceRecord;
+    class TraceWriter;
+    class TraceReader;
+}
+
+/**
+ * @brief One call captured at the UsbTransport boundary.
+ *
+ * File layout (little-endian): the 8-byte magic "MEGA4TRC", a uint16 version,
+ * then records back to back. Every record starts with its kind (uint8), flags
+ * (uint8), start offset from the beginning of the capture and duration (two
+ * uint64 nanosecond counts) and the result (int32). An enumeration continues
+ * with a uint16 hub count and, per hub, path, vid, pid, address and description;
+ * a control transfer with hub path, the 8-byte setup packet and the data stage
+ * (uint16 length + bytes). Strings are a uint16 length followed by the bytes.
+ */
+struct UUGear::Mega4::TraceRecord
+{
+    enum class Kind : uint8_t
+    {
+        Enumeration = 1,
+        Control = 2, ///< Synchronous controlTransfer()
+        AsyncControl = 3 ///< submitControl() and its completion
+    };
+
+    static constexpr uint8_t FLAG_THREW = 0x01; ///< The call threw std::runtime_error (message in `message`)
+    static constexpr uint8_t FLAG_NOT_SUBMITTED = 0x02; ///< submitControl() returned result, done never ran
+
+    Kind kind = Kind::Control;
+    uint8_t flags = 0;
+    std::chrono::nanoseconds start{0}; ///< Since the capture started
+    std::chrono::nanoseconds duration{0}; ///< Until the call returned or the completion ran
+    int32_t result = 0; ///< Byte count or libusb error; enumeration: 1 on success, 0 on failure
+
+    std::vector<UsbTransport::HubEntry> hubs; ///< Enumeration only
+
+    std::string hubPath;
+    uint8_t bmRequestType = 0;
+    uint8_t bRequest = 0;
+    uint16_t wValue = 0;
+    uint16_t wIndex = 0;
+    uint16_t wLength = 0;
+    std::vector<uint8_t> data; ///< Response for IN transfers, payload for OUT transfers
+    std::string message;
+};
+
+/**
+ * @brief Appends TraceRecords to a capture file. Thread-safe.
+ */
+class UUGear::Mega4::TraceWriter
+{
+public:
+    /**
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    explicit TraceWriter(const std::string& path);
+
+    /**
+     * @brief Time elapsed since the capture started, to stamp TraceRecord::start.
+     */
+    [[nodiscard]] std::chrono::nanoseconds elapsed() const;
+
+    void write(const TraceRecord& record);
+
+private:
+    std::mutex mutex_;
+    std::ofstream out_;
+    std::chrono::steady_clock::time_point origin_;
+};
+
+/**
+ * @brief Reads a capture file written by TraceWriter.
+ */
+class UUGear::Mega4::TraceReader
+{
+public:
+    /**
+     * @brief Reads every record of a capture.
+     * @throws std::runtime_error if the file cannot be opened, is not a capture or is truncated.
+     */
+    static std::vector<TraceRecord> readAll(const std::string& path);
+};
+
+#endif //UUGEAR_MEGA4_LIB_TRANSPORTTRACE_HPP
@@ -0,0 +1,99 @@
+#ifndef UUGEAR_MEGA4_LIB_USBTRANSPORT_HPP
+#define UUGEAR_MEGA4_LIB_USBTRANSPORT_HPP
+
+#include "UUGear/Mega4/Mega4Types.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace UUGear::Mega4
+{
+    class UsbTransport;
+}
+
+/**
+ * @brief What Mega4Hub needs from the USB stack: finding the hubs and exchanging
+ *        control transfers with them, addressed by bus/port path.
+ *
+ * LibusbTransport talks to real hardware; SimulatedTransport answers from
+ * in-process SimulatedMega4 models. Return values follow libusb: a byte count
+ * (>= 0) on success, a negative LIBUSB_ERROR_* code on failure.
+ */
+class UUGear::Mega4::UsbTransport
+{
+public:
+    /**
+     * @brief Completion of an asynchronous control transfer (see AsyncTransferEngine::Completion).
+     */
+    using Completion = std::function<void(int result, const uint8_t* data, int length)>;
+
+    /**
+     * @brief A hub as seen by one enumeration.
+     */
+    struct HubEntry
+    {
+        DeviceInfo info;
+        uint8_t address = 0; ///< Device address; changes when the hub is replugged
+    };
+
+    virtual ~UsbTransport() = default;
+
+    /**
+     * @brief Lists the MEGA4 hubs currently present.
+     * @return False if the bus could not be enumerated.
+     */
+    virtual bool enumerateHubs(std::vector<HubEntry>& hubs) = 0;
+
+    /**
+     * @brief Sends a control transfer and waits for it.
+     * @param data Data stage (wLength bytes), read for IN transfers, written for OUT transfers.
+     * @return Bytes transferred or a negative libusb error code.
+     * @throws std::runtime_error if the hub cannot be opened.
+     */
+    virtual int controlTransfer(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest,
+                                uint16_t wValue, uint16_t wIndex, unsigned char* data, uint16_t wLength,
+                                unsigned int timeoutMs) = 0;
+
+    /**
+     * @brief Queues a control transfer without blocking (OUT transfers carry no data stage).
+     * @param done Called exactly once when the transfer finishes, only if submission succeeded.
+     * @return 0 if the transfer was submitted, or a negative libusb error code.
+     */
+    virtual int submitControl(const std::string& hubPath, uint8_t bmRequestType, uint8_t bRequest,
+                              uint16_t wValue, uint16_t wIndex, uint16_t wLength, unsigned int timeoutMs,
+                              Completion done) = 0;
+
+    /**
+     * @brief Describes the devices on the ports of a hub when the transport knows them
+     *        directly (e.g. a simulation).
+     * @return False to let the hub resolve connections itself from the libusb topology.
+     */
+    virtual bool readPortConnections(const std::string& hubPath, std::vector<PortConnectionInfo>& ports)
+    {
+        (void)hubPath;
+        (void)ports;
+        return false;
+    }
+
+    /**
+     * @brief Called with the hub path whenever the transport had to reopen a hub that
+     *        disappeared and came back (its ports were power-cycled).
+     */
+    void setReattachHandler(std::function<void(const std::string& hubPath)> handler)
+    {
+        reattached_ = std::move(handler);
+    }
+
+protected:
+    void notifyReattached(const std::string& hubPath) const
+    {
+        if (reattached_) reattached_(hubPath);
+    }
+
+private:
+    std::function<void(const std::string& hubPath)> reattached_;
+};
+
+#endif //UUGEAR_MEGA4_LIB_USBTRANSPORT_HPP
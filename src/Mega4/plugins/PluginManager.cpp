@@ -1,8 +1,15 @@
 #ifdef UUGEAR_PLUGIN_LINK_MODE_MODULE
 #include "UUGear/Mega4/PluginManager.hpp"
+#include "UUGear/Mega4/Logger.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <utility>
 #include <dlfcn.h>
-#include <iostream>
 
 
 namespace fs = std::filesystem;
@@ -16,6 +23,7 @@ namespace UUGear::Mega4
 
     PluginManager::~PluginManager()
     {
+        detach();
         for (auto& plugin : plugins_)
         {
             if (plugin.instance && plugin.destroy)
@@ -25,59 +33,227 @@ namespace UUGear::Mega4
         }
     }
 
+    namespace
+    {
+        std::string trim(const std::string& text)
+        {
+            const auto first = text.find_first_not_of(" \t\r");
+            if (first == std::string::npos)
+                return {};
+            return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+        }
+
+        template <typename T>
+        bool parseHex(const std::string& text, T& value)
+        {
+            try
+            {
+                size_t used = 0;
+                const unsigned long parsed = std::stoul(text, &used, 16);
+                if (used != text.size() || parsed > std::numeric_limits<T>::max())
+                    return false;
+                value = static_cast<T>(parsed);
+                return true;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+    }
+
+    bool PluginManager::MatchRule::matches(const PortConnectionInfo& info) const
+    {
+        return (!vid || *vid == info.vid) && (!pid || *pid == info.pid) &&
+               (!deviceClass || *deviceClass == info.deviceClass);
+    }
+
+    std::optional<PluginManager::DeferredPlugin> PluginManager::readManifest(const std::string& manifestPath,
+                                                                            const std::string& pluginPath)
+    {
+        std::ifstream in(manifestPath);
+        if (!in)
+        {
+            UUGEAR_MEGA4_LOG_WARNING("[PluginManager] Cannot read manifest: " << manifestPath);
+            return std::nullopt;
+        }
+
+        DeferredPlugin plugin{pluginPath, {}, {}};
+        std::string line;
+        for (int number = 1; std::getline(in, line); ++number)
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            const auto equals = line.find('=');
+            const std::string key = trim(line.substr(0, equals));
+            const std::string value = equals == std::string::npos ? std::string() : trim(line.substr(equals + 1));
+            if (key == "name")
+            {
+                plugin.name = value;
+                continue;
+            }
+            if (key != "match")
+                continue; // keys of newer manifests
+
+            MatchRule rule;
+            std::istringstream fields(value);
+            std::string field;
+            bool valid = true;
+            while (valid && fields >> field)
+            {
+                const auto colon = field.find(':');
+                const std::string name = field.substr(0, colon);
+                const std::string hex = colon == std::string::npos ? std::string() : field.substr(colon + 1);
+                if (name == "vid")
+                    valid = parseHex(hex, rule.vid.emplace());
+                else if (name == "pid")
+                    valid = parseHex(hex, rule.pid.emplace());
+                else if (name == "class")
+                    valid = parseHex(hex, rule.deviceClass.emplace());
+                else
+                    valid = false;
+            }
+            if (!valid || (!rule.vid && !rule.pid && !rule.deviceClass))
+            {
+                UUGEAR_MEGA4_LOG_WARNING("[PluginManager] Invalid match rule at " << manifestPath << ":" << number);
+                return std::nullopt;
+            }
+            plugin.rules.push_back(rule);
+        }
+
+        if (plugin.name.empty() || plugin.rules.empty())
+        {
+            UUGEAR_MEGA4_LOG_WARNING("[PluginManager] Manifest needs a name and a match rule: " << manifestPath);
+            return std::nullopt;
+        }
+        return plugin;
+    }
+
+    bool PluginManager::load(const std::string& path) const
+    {
+        void* handle = dlopen(path.c_str(), RTLD_NOW);
+        if (!handle)
+        {
+            UUGEAR_MEGA4_LOG_ERROR("Failed to load plugin: " << path << " — " << dlerror());
+            return false;
+        }
+
+        const auto create = reinterpret_cast<DevicePlugin* (*)()>(dlsym(handle, "createPlugin"));
+        const auto destroy = reinterpret_cast<void (*)(DevicePlugin*)>(dlsym(handle, "destroyPlugin"));
+
+        if (!create || !destroy)
+        {
+            UUGEAR_MEGA4_LOG_ERROR("Invalid plugin: " << path);
+            dlclose(handle);
+            return false;
+        }
+
+        DevicePlugin* instance = create();
+        UUGEAR_MEGA4_LOG_INFO("[PluginManager] Loaded plugin: " << instance->name());
+
+        plugins_.push_back({handle, instance, destroy, std::make_unique<CallbackLatency>()});
+        return true;
+    }
+
     void PluginManager::loadAll()
     {
         if (!fs::exists(directory_))
         {
-            std::cerr << "Plugin directory not found: " << directory_ << "\n";
+            UUGEAR_MEGA4_LOG_ERROR("Plugin directory not found: " << directory_);
             return;
         }
 
+        std::lock_guard lock(mutex_);
         for (const auto& entry : fs::directory_iterator(directory_))
         {
             if (entry.path().extension() != ".so")
                 continue;
 
             const std::string path = entry.path().string();
-            void* handle = dlopen(path.c_str(), RTLD_NOW);
-            if (!handle)
+            const fs::path manifest = fs::path(entry.path()).replace_extension(".manifest");
+            if (fs::exists(manifest))
             {
-                std::cerr << "Failed to load plugin: " << path << " — " << dlerror() << "\n";
-                continue;
+                if (auto plugin = readManifest(manifest.string(), path))
+                {
+                    UUGEAR_MEGA4_LOG_INFO("[PluginManager] Indexed plugin: " << plugin->name
+                        << " (loaded when a matching device connects)");
+                    deferred_.push_back(std::move(*plugin));
+                    continue;
+                }
             }
+            load(path);
+        }
+    }
 
-            const auto create = reinterpret_cast<DevicePlugin* (*)()>(dlsym(handle, "createPlugin"));
-            const auto destroy = reinterpret_cast<void (*)(DevicePlugin*)>(dlsym(handle, "destroyPlugin"));
-
-            if (!create || !destroy)
+    void PluginManager::handlePortChange(const PortConnectionInfo& info, bool connected) const
+    {
+        // Plugins stay loaded until the manager is destroyed, so their instances and histograms
+        // can be called after the lock is released, letting callbacks call back into the manager
+        std::vector<std::pair<DevicePlugin*, CallbackLatency*>> targets;
+        {
+            std::lock_guard lock(mutex_);
+            if (connected && info.hasDevice)
             {
-                std::cerr << "Invalid plugin: " << path << "\n";
-                dlclose(handle);
-                continue;
+                for (auto it = deferred_.begin(); it != deferred_.end();)
+                {
+                    if (std::none_of(it->rules.begin(), it->rules.end(),
+                                     [&](const MatchRule& rule) { return rule.matches(info); }))
+                    {
+                        ++it;
+                        continue;
+                    }
+                    load(it->path); // a plugin that fails to load is not retried
+                    it = deferred_.erase(it);
+                }
             }
 
-            DevicePlugin* instance = create();
-            std::cout << "[PluginManager] Loaded plugin: " << instance->name() << "\n";
-
-            plugins_.push_back({handle, instance, destroy});
+            targets.reserve(plugins_.size());
+            for (const auto& plugin : plugins_)
+                targets.emplace_back(plugin.instance, plugin.latency.get());
         }
-    }
 
-    void PluginManager::handlePortChange(const PortConnectionInfo& info, bool connected) const
-    {
-        for (auto& plugin : plugins_)
+        for (const auto& [instance, latency] : targets)
         {
-            if (!plugin.instance->canHandle(info))
+            bool handles;
+            {
+                const LatencyHistogram::Timer timer(latency->canHandle);
+                handles = instance->canHandle(info);
+            }
+            if (!handles)
             {
                 continue;
             }
-            if (connected) plugin.instance->onDeviceConnected(info);
-            else plugin.instance->onDeviceDisconnected(info);
+
+            const LatencyHistogram::Timer timer(connected ? latency->connected : latency->disconnected);
+            if (connected) instance->onDeviceConnected(info);
+            else instance->onDeviceDisconnected(info);
         }
     }
 
+    void PluginManager::attachTo(const Mega4Hub& hub)
+    {
+        detach();
+        subscriptionId_ = hub.subscribePortEvents([this](const PortEvent& event)
+        {
+            handlePortChange(event.port, event.connected);
+        });
+        hub_ = &hub;
+    }
+
+    void PluginManager::detach()
+    {
+        if (!hub_)
+            return;
+        hub_->unsubscribePortEvents(subscriptionId_);
+        hub_ = nullptr;
+        subscriptionId_ = 0;
+    }
+
     std::vector<DevicePlugin*> PluginManager::plugins() const
     {
+        std::lock_guard lock(mutex_);
         std::vector<DevicePlugin*> out;
         out.reserve(plugins_.size());
         for (const auto& p : plugins_)
@@ -87,18 +263,53 @@ namespace UUGear::Mega4
 
     size_t PluginManager::pluginCount() const noexcept
     {
+        std::lock_guard lock(mutex_);
         return plugins_.size();
     }
 
+    size_t PluginManager::deferredCount() const noexcept
+    {
+        std::lock_guard lock(mutex_);
+        return deferred_.size();
+    }
+
+    MetricsSnapshot PluginManager::metrics() const
+    {
+        std::lock_guard lock(mutex_);
+        MetricsSnapshot snapshot;
+        for (const auto& plugin : plugins_)
+        {
+            const std::string name = plugin.instance->name();
+            snapshot.pluginCallbacks.push_back(plugin.latency->canHandle.snapshot("canHandle", name));
+            snapshot.pluginCallbacks.push_back(plugin.latency->connected.snapshot("onDeviceConnected", name));
+            snapshot.pluginCallbacks.push_back(plugin.latency->disconnected.snapshot("onDeviceDisconnected", name));
+        }
+        return snapshot;
+    }
+
 
     // ----------------------------- Template Specializations ----------------------------
     DevicePlugin* PluginManager::getPluginByName(const std::string& name) const
     {
+        std::lock_guard lock(mutex_);
         for (auto& plugin : plugins_)
         {
             if (plugin.instance && plugin.instance->name() == name)
                 return plugin.instance;
         }
+
+        const auto deferred = std::find_if(deferred_.begin(), deferred_.end(),
+                                           [&](const DeferredPlugin& plugin) { return plugin.name == name; });
+        if (deferred == deferred_.end())
+            return nullptr;
+        const std::string path = deferred->path;
+        deferred_.erase(deferred);
+        if (!load(path))
+            return nullptr;
+        if (plugins_.back().instance->name() == name)
+            return plugins_.back().instance;
+        UUGEAR_MEGA4_LOG_WARNING("[PluginManager] " << path << " declares " << name << " but is "
+            << plugins_.back().instance->name());
         return nullptr;
     }
 } // namespace UUGear::Mega4
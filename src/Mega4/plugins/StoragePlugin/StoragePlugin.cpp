@@ -1,8 +1,8 @@
 #include "UUGear/Mega4/plugins/StoragePlugin.hpp"
 
+#include "UUGear/Mega4/Logger.hpp"
 #include "UUGear/Mega4/Mega4Types.hpp"
 
-#include <iostream>
 #include <fstream>
 #include <cstdlib>
 #include <regex>
@@ -29,14 +29,13 @@ namespace UUGear::Mega4
 
     void StoragePlugin::onDeviceConnected(const PortConnectionInfo& info)
     {
-        std::cout << "[StoragePlugin] Detected storage device on port " << info.portNumber
-            << " (" << info.manufacturer << " " << info.product << ")\n";
+        UUGEAR_MEGA4_LOG_INFO("[StoragePlugin] Detected storage device on port " << info.portNumber
+            << " (" << info.manufacturer << " " << info.product << ")");
 
         const std::string devPath = findBlockDevice(info);
         if (devPath.empty())
         {
-            std::cerr << "[StoragePlugin] Could not resolve block device for port "
-                << info.portNumber << "\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Could not resolve block device for port " << info.portNumber);
             return;
         }
 
@@ -44,21 +43,21 @@ namespace UUGear::Mega4
         fs::create_directories(mountPoint);
 
         if (mountDevice(devPath, mountPoint))
-            std::cout << "[StoragePlugin] Mounted " << devPath << " → " << mountPoint << "\n";
+            UUGEAR_MEGA4_LOG_INFO("[StoragePlugin] Mounted " << devPath << " → " << mountPoint);
         else
-            std::cerr << "[StoragePlugin] Failed to mount " << devPath << "\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Failed to mount " << devPath);
     }
 
     void StoragePlugin::onDeviceDisconnected(const PortConnectionInfo& info)
     {
         std::string mountPoint = "/mnt/mega4/port" + std::to_string(info.portNumber);
-        std::cout << "[StoragePlugin] Device removed from port " << info.portNumber << ", unmounting " << mountPoint <<
-            "\n";
+        UUGEAR_MEGA4_LOG_INFO("[StoragePlugin] Device removed from port " << info.portNumber << ", unmounting "
+            << mountPoint);
 
         if (unmountDevice(mountPoint))
-            std::cout << "[StoragePlugin] Unmounted successfully.\n";
+            UUGEAR_MEGA4_LOG_INFO("[StoragePlugin] Unmounted successfully.");
         else
-            std::cerr << "[StoragePlugin] Failed to unmount.\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Failed to unmount.");
     }
 
     /**
@@ -108,7 +107,7 @@ namespace UUGear::Mega4
         struct libmnt_context* cxt = mnt_new_context();
         if (!cxt)
         {
-            std::cerr << "[StoragePlugin] Failed to create libmount context\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Failed to create libmount context");
             return false;
         }
 
@@ -121,7 +120,7 @@ namespace UUGear::Mega4
         {
             char buf[256];
             mnt_context_get_excode(cxt, status, buf, sizeof(buf));
-            std::cerr << "[StoragePlugin] Mount error (" << status << "): " << buf << "\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Mount error (" << status << "): " << buf);
             mnt_free_context(cxt);
             return false;
         }
@@ -129,7 +128,7 @@ namespace UUGear::Mega4
         mnt_free_context(cxt);
         return true;
     #else
-        std::cerr << "[StoragePlugin] Mount not supported on this platform\n";
+        UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Mount not supported on this platform");
         return false;
     #endif
     }
@@ -140,7 +139,7 @@ namespace UUGear::Mega4
         struct libmnt_context* cxt = mnt_new_context();
         if (!cxt)
         {
-            std::cerr << "[StoragePlugin] Failed to create libmount context\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Failed to create libmount context");
             return false;
         }
 
@@ -150,7 +149,7 @@ namespace UUGear::Mega4
         {
             char buf[256];
             mnt_context_get_excode(cxt, status, buf, sizeof(buf));
-            std::cerr << "[StoragePlugin] Unmount error (" << status << "): " << buf << "\n";
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Unmount error (" << status << "): " << buf);
             mnt_free_context(cxt);
             return false;
         }
@@ -158,7 +157,7 @@ namespace UUGear::Mega4
         mnt_free_context(cxt);
         return true;
     #else
-        std::cerr << "[StoragePlugin] Unmount not supported on this platform\n";
+        UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Unmount not supported on this platform");
         return false;
     #endif
     }
@@ -189,7 +188,7 @@ namespace UUGear::Mega4
     {
         std::string mountPoint = getMountPoint(info);
         if (mountPoint.empty()) {
-            std::cerr << "[StoragePlugin] Device is not mounted, cannot write to file." << std::endl;
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Device is not mounted, cannot write to file.");
             return false;
         }
 
@@ -197,7 +196,7 @@ namespace UUGear::Mega4
 
         std::ofstream outFile(filePath);
         if (!outFile) {
-            std::cerr << "[StoragePlugin] Failed to open file for writing: " << filePath << std::endl;
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Failed to open file for writing: " << filePath);
             return false;
         }
 
@@ -210,14 +209,14 @@ namespace UUGear::Mega4
     {
         std::string mountPoint = getMountPoint(info);
         if (mountPoint.empty()) {
-            std::cerr << "[StoragePlugin] Device is not mounted, cannot read from file." << std::endl;
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Device is not mounted, cannot read from file.");
             return "";
         }
 
         std::string filePath = mountPoint + "/" + filename;
         std::ifstream inFile(filePath);
         if (!inFile) {
-            std::cerr << "[StoragePlugin] Failed to open file for reading: " << filePath << std::endl;
+            UUGEAR_MEGA4_LOG_ERROR("[StoragePlugin] Failed to open file for reading: " << filePath);
             return "";
         }
 
@@ -11,6 +11,8 @@
 #include <dlfcn.h>
 #include <iostream>
 #include <filesystem>
+#include <fstream>
+#include <unistd.h>
 
 using namespace UUGear::Mega4;
 namespace fs = std::filesystem;
@@ -181,7 +183,8 @@ ASSERT_TRUE (fs::exists(pluginDir)) << "Plugin directory not found: " << pluginD
 PluginManager manager(pluginDir);
 manager.loadAll();
 
-ASSERT_GT (manager.pluginCount(), 0u) << "No plugins loaded; cannot test dynamic plugins.";
+// Plugins with a manifest are only indexed until needed
+ASSERT_GT (manager.pluginCount() + manager.deferredCount(), 0u) << "No plugins found; cannot test dynamic plugins.";
 
 // Try to find the StoragePlugin by name
 DevicePlugin* plugin = manager.getPluginByName("StoragePlugin");
@@ -197,6 +200,96 @@ EXPECT_NO_THROW (manager.handlePortChange(mock, true));
 EXPECT_NO_THROW (manager.handlePortChange(mock, false));
 }
 
+// ------------------------------------------------------------------
+// Manifest-driven lazy loading
+// ------------------------------------------------------------------
+/**
+ * @brief Directory with links to the first built plugin, each with an optional manifest.
+ */
+static fs::path manifestDirectory(const std::string& test,
+                                  const std::vector<std::pair<std::string, std::string>>& plugins)
+{
+#ifdef UUGEAR_PLUGIN_DIR
+    const std::string pluginDir = UUGEAR_PLUGIN_DIR;
+#else
+    const std::string pluginDir = "./plugins";
+#endif
+    fs::path built;
+    for (const auto& entry : fs::directory_iterator(pluginDir))
+    {
+        if (entry.path().extension() == ".so")
+        {
+            built = fs::absolute(entry.path());
+            break;
+        }
+    }
+    if (built.empty())
+        return {};
+
+    const fs::path dir = fs::temp_directory_path() / ("mega4_manifest_" + test + "_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    for (const auto& [name, manifest] : plugins)
+    {
+        fs::create_symlink(built, dir / (name + ".so"));
+        if (!manifest.empty())
+            std::ofstream(dir / (name + ".manifest")) << manifest;
+    }
+    return dir;
+}
+
+TEST(PluginManager, ManifestDefersLoadingUntilAMatchingDevice)
+{
+    const fs::path dir = manifestDirectory("defer", {
+        {"lazy", "# storage only\nname = StoragePlugin\nmatch = vid:046d\nmatch = vid:13fe pid:4300\n"},
+        {"eager", ""},
+        {"broken", "name = StoragePlugin\nmatch = serial:1234\n"},
+    });
+    if (dir.empty())
+        GTEST_SKIP() << "No plugin built";
+
+    PluginManager manager(dir.string());
+    manager.loadAll();
+    EXPECT_EQ(manager.pluginCount(), 2u) << "plugins without a valid manifest are loaded right away";
+    EXPECT_EQ(manager.deferredCount(), 1u);
+
+    auto other = makeMockPort(1, true);
+    other.pid = 0x1234;
+    manager.handlePortChange(other, true);
+    manager.handlePortChange(makeMockPort(1, true), false);
+    EXPECT_EQ(manager.pluginCount(), 2u) << "no match, or a disconnect, loads nothing";
+
+    manager.handlePortChange(makeMockPort(1, true), true);
+    EXPECT_EQ(manager.pluginCount(), 3u);
+    EXPECT_EQ(manager.deferredCount(), 0u);
+
+    fs::remove_all(dir);
+}
+
+TEST(PluginManager, ManifestMatchesDeviceClassAndName)
+{
+    const fs::path dir = manifestDirectory("class", {{"storage", "name = StoragePlugin\nmatch = class:08\n"}});
+    if (dir.empty())
+        GTEST_SKIP() << "No plugin built";
+
+    PluginManager byClass(dir.string());
+    byClass.loadAll();
+    ASSERT_EQ(byClass.pluginCount(), 0u);
+    auto disk = makeMockPort(2, true);
+    disk.deviceClass = 0x08;
+    byClass.handlePortChange(disk, true);
+    EXPECT_EQ(byClass.pluginCount(), 1u);
+
+    PluginManager byName(dir.string());
+    byName.loadAll();
+    EXPECT_EQ(byName.getPluginByName("Unknown"), nullptr);
+    ASSERT_NE(byName.getPluginByName("StoragePlugin"), nullptr) << "looking a plugin up by name loads it";
+    EXPECT_EQ(byName.pluginCount(), 1u);
+    EXPECT_EQ(byName.deferredCount(), 0u);
+
+    fs::remove_all(dir);
+}
+
 #else  // ----------------------------------------------------------------------
 
 
@@ -220,7 +313,7 @@ TEST(StoragePlugin, DirectUseAndRTTICheck)
 
     // Test static helper methods
     fs::create_directories("/mnt/mega4/port" + std::to_string(mock.portNumber));
-    EXPECT_NO_THROW(const auto mountPoint = StoragePlugin::getMountPoint(mock));
+    EXPECT_NO_THROW(const auto mountPoint = plugin.getMountPoint(mock));
     fs::remove_all("mnt/mega4/port" + std::to_string(mock.portNumber));
 }
 
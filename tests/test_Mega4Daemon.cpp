@@ -0,0 +1,304 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "UUGear/Mega4/HubExecutor.hpp"
+#include "UUGear/Mega4/Mega4Client.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Server.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Metrics.hpp"
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+
+using UUGear::Mega4::Mega4Client;
+using UUGear::Mega4::Mega4Hub;
+using UUGear::Mega4::Mega4HubOptions;
+using UUGear::Mega4::Mega4Server;
+using UUGear::Mega4::SimulatedMega4;
+
+namespace
+{
+    /**
+     * @brief A daemon serving simulated hubs on a socket of its own.
+     */
+    struct Daemon
+    {
+        explicit Daemon(const std::vector<std::shared_ptr<SimulatedMega4>>& hubs, const char* name)
+            : hub(options(hubs)),
+              server(hub, (std::filesystem::temp_directory_path() /
+                           (std::string(name) + "_" + std::to_string(::getpid()) + ".sock")).string())
+        {
+            (void)hub.listDevices();
+        }
+
+        static Mega4HubOptions options(const std::vector<std::shared_ptr<SimulatedMega4>>& hubs)
+        {
+            Mega4HubOptions options;
+            options.simulatedHubs = hubs;
+            options.stateCacheTtl = std::chrono::hours(1);
+            return options;
+        }
+
+        const Mega4Hub hub;
+        const Mega4Server server;
+    };
+}
+
+TEST(Mega4Daemon, ClientForwardsHubApi)
+{
+    const auto first = std::make_shared<SimulatedMega4>("1-1");
+    const auto second = std::make_shared<SimulatedMega4>("1-2", true);
+    UUGear::Mega4::PortConnectionInfo disk{};
+    disk.portNumber = 3;
+    disk.hasDevice = true;
+    disk.vid = 0x13fe;
+    disk.pid = 0x4300;
+    disk.product = "USB DISK 3.0";
+    second->attachDevice(disk);
+    const Daemon daemon({first, second}, "mega4d_api");
+
+    const Mega4Client client(daemon.server.socketPath());
+    const auto devices = client.listDevices();
+    ASSERT_EQ(devices.size(), 2u);
+    EXPECT_EQ(devices[1].busPortPath, "1-2");
+    EXPECT_EQ(devices[1].pid, 0x0817);
+    EXPECT_EQ(client.deviceIndexOf("1-2"), 1);
+
+    client.powerOff(2, 1);
+    EXPECT_FALSE(second->isPortPowered(2));
+    EXPECT_FALSE(client.isPortOn(2, 1));
+    EXPECT_EQ(client.getPortStates(1), (std::array<bool, 4>{true, false, true, true}));
+    client.applyPowerMask(0x02, 0x09, 1);
+    EXPECT_EQ(client.getPortStates(1, true), (std::array<bool, 4>{false, true, true, false}));
+
+    const auto snapshot = client.getPortStateSnapshot(1);
+    EXPECT_TRUE(snapshot.valid);
+    EXPECT_EQ(snapshot.states, daemon.hub.getPortStateSnapshot(1).states);
+    EXPECT_LE(snapshot.timestamp, std::chrono::steady_clock::now());
+
+    const auto status = client.getPortStatus(1);
+    EXPECT_TRUE(status[2].connected);
+    EXPECT_TRUE(status[2].powered);
+    EXPECT_EQ(status[2].speed, UUGear::Mega4::PortSpeed::Super);
+
+    const auto connections = client.getPortConnections(1);
+    ASSERT_EQ(connections.size(), 4u);
+    EXPECT_TRUE(connections[2].hasDevice);
+    EXPECT_EQ(connections[2].product, "USB DISK 3.0");
+
+    // The daemon's exception types survive the trip
+    EXPECT_THROW(client.powerOn(5, 0), std::out_of_range);
+    EXPECT_THROW((void)client.getPortStates(7), std::out_of_range);
+    first->failNextTransfers(1);
+    EXPECT_THROW(client.powerOff(1, 0), std::runtime_error);
+
+    auto cycle = client.powerCycle(4, std::chrono::milliseconds(20), 0);
+    ASSERT_EQ(cycle.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    EXPECT_NO_THROW(cycle.get());
+    EXPECT_TRUE(first->isPortPowered(4));
+
+    const auto metrics = client.metrics();
+    EXPECT_GT(metrics.transfers, 0u);
+
+    // A client is a Mega4Hub: the fan-out helpers work through the daemon too
+    const UUGear::Mega4::HubExecutor executor(client);
+    const auto results = executor.powerOff(3);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_TRUE(results[0].ok());
+    EXPECT_TRUE(results[1].ok());
+    EXPECT_FALSE(first->isPortPowered(3));
+    EXPECT_FALSE(second->isPortPowered(3));
+}
+
+TEST(Mega4Daemon, PipelinedRequestsFromManyThreads)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    sim->setLatency(std::chrono::microseconds(2000));
+    const Daemon daemon({sim}, "mega4d_pipeline");
+    const Mega4Client client(daemon.server.socketPath());
+
+    // Asynchronous requests all leave at once: the total is about one latency, not one per request
+    std::vector<std::future<void>> pending;
+    for (int i = 0; i < 16; ++i)
+        pending.push_back(i % 2 ? client.powerOnAsync(i % 4 + 1) : client.powerOffAsync(i % 4 + 1));
+    for (auto& request : pending)
+    {
+        ASSERT_EQ(request.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_NO_THROW(request.get());
+    }
+    EXPECT_THROW(client.powerOnAsync(9).get(), std::out_of_range);
+
+    std::atomic<int> answered{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            for (int i = 0; i < 50; ++i)
+            {
+                if (client.getPortStates().size() == 4 && client.knownDevices().size() == 1)
+                    answered.fetch_add(1);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(answered.load(), 400);
+}
+
+TEST(Mega4Daemon, PushesPortStatusChanges)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Daemon daemon({sim}, "mega4d_push");
+    const Mega4Client client(daemon.server.socketPath());
+    const Mega4Client other(daemon.server.socketPath());
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<UUGear::Mega4::PortStatusChange> changes;
+    const int subscription = client.subscribePortStatus([&](const UUGear::Mega4::PortStatusChange& change)
+    {
+        std::lock_guard lock(mutex);
+        changes.push_back(change);
+        changed.notify_all();
+    });
+
+    // Pushed to every subscriber, whichever client made the change
+    other.powerOff(2);
+    {
+        std::unique_lock lock(mutex);
+        ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(2), [&] { return !changes.empty(); }));
+        EXPECT_EQ(changes[0].deviceIndex, 0);
+        EXPECT_EQ(changes[0].portNumber, 2);
+        EXPECT_FALSE(changes[0].powered);
+        EXPECT_FALSE(changes[0].status.powered);
+    }
+
+    client.unsubscribePortStatus(subscription);
+    (void)client.getPortStates(); // the unsubscribe was sent before this request
+    other.powerOn(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::lock_guard lock(mutex);
+    EXPECT_EQ(changes.size(), 1u);
+
+    // Simulated hubs have no hotplug events, which the daemon reports as unavailable
+    EXPECT_THROW(client.subscribePortEvents([](const UUGear::Mega4::PortEvent&) {}), std::runtime_error);
+}
+
+TEST(Mega4Daemon, PowerCyclesTakeNoWorker)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Daemon daemon({sim}, "mega4d_cycles");
+    const Mega4Client client(daemon.server.socketPath());
+
+    // More cycles than workers, each OFF for a second
+    std::vector<std::future<void>> cycles;
+    for (size_t i = 0; i < 2 * Mega4Server::DEFAULT_WORKERS; ++i)
+        cycles.push_back(client.powerCycle(static_cast<int>(i % 4) + 1, std::chrono::milliseconds(1000)));
+
+    auto states = std::async(std::launch::async, [&] { return client.getPortStates(0, true); });
+    ASSERT_EQ(states.wait_for(std::chrono::milliseconds(500)), std::future_status::ready)
+        << "a blocking request waited for the cycles";
+    EXPECT_EQ(cycles.front().wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+    for (auto& cycle : cycles)
+    {
+        ASSERT_EQ(cycle.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_NO_THROW(cycle.get());
+    }
+    EXPECT_TRUE(sim->isPortPowered(1));
+}
+
+TEST(Mega4Daemon, ClientThatStopsReadingHoldsUpNobodyElse)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Daemon daemon({sim}, "mega4d_slow");
+    const Mega4Client client(daemon.server.socketPath());
+
+    // A raw client that subscribes to pushes, pipelines requests and never reads a response
+    const int slow = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(slow, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, daemon.server.socketPath().c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(::connect(slow, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+    const auto request = [slow](const uint32_t id, const uint8_t op)
+    {
+        const uint8_t frame[9] = {5, 0, 0, 0, static_cast<uint8_t>(id), static_cast<uint8_t>(id >> 8),
+                                  static_cast<uint8_t>(id >> 16), static_cast<uint8_t>(id >> 24), op};
+        return ::send(slow, frame, sizeof(frame), MSG_NOSIGNAL) == sizeof(frame);
+    };
+    ASSERT_TRUE(request(1, 18)); // SubscribePortStatus
+
+    // Responses worth 2 MiB: more than the socket buffers hold, less than MAX_PENDING_BYTES.
+    // Read up to the length of the first Metrics response, behind the 9-byte subscribe response.
+    ASSERT_TRUE(request(2, 20)); // Metrics
+    uint8_t head[13];
+    for (size_t received = 0; received < sizeof(head);)
+    {
+        const ssize_t n = ::recv(slow, head + received, sizeof(head) - received, 0);
+        ASSERT_GT(n, 0);
+        received += static_cast<size_t>(n);
+    }
+    const size_t metricsSize = 4 + (head[9] | head[10] << 8 | head[11] << 16 | static_cast<size_t>(head[12]) << 24);
+    uint32_t id = 3;
+    for (const uint32_t last = id + (2u << 20) / metricsSize; id < last; ++id)
+        ASSERT_TRUE(request(id, 20));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // Pushes to the slow client, asynchronous completions and worker requests of the others go on
+    auto powered = client.powerOffAsync(2);
+    ASSERT_EQ(powered.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_NO_THROW(powered.get());
+    auto switched = std::async(std::launch::async, [&] { (void)client.powerOff(3); }); // pushed to the slow client
+    ASSERT_EQ(switched.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    auto states = std::async(std::launch::async, [&] { return client.getPortStates(0, true); });
+    ASSERT_EQ(states.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(states.get(), (std::array<bool, 4>{true, false, false, true}));
+
+    // Its backlog is bounded: the daemon disconnects it instead of queueing without end
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    bool disconnected = false;
+    while (!disconnected && std::chrono::steady_clock::now() < deadline)
+        disconnected = !request(id++, 20);
+    EXPECT_TRUE(disconnected);
+    ::close(slow);
+    EXPECT_EQ(client.knownDevices().size(), 1u);
+}
+
+TEST(Mega4Daemon, CallsFailOnceTheDaemonIsGone)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    auto daemon = std::make_unique<Daemon>(std::vector<std::shared_ptr<SimulatedMega4>>{sim}, "mega4d_gone");
+    const std::string path = daemon->server.socketPath();
+    const Mega4Client client(path);
+    EXPECT_EQ(client.listDevices().size(), 1u);
+
+    daemon.reset();
+    EXPECT_FALSE(std::filesystem::exists(path));
+    EXPECT_THROW((void)client.listDevices(), std::runtime_error);
+    EXPECT_THROW(Mega4Client{path}, std::runtime_error);
+
+    // Resolving the paths fails too, which the executor reports per hub
+    const UUGear::Mega4::HubExecutor executor(client);
+    for (const auto& paths : {std::vector<std::string>{"1-1"}, std::vector<std::string>{"1-1", "1-2"}})
+    {
+        const auto results = executor.getPortStates(paths);
+        ASSERT_EQ(results.size(), paths.size());
+        for (const auto& result : results)
+        {
+            EXPECT_FALSE(result.ok());
+            EXPECT_EQ(result.deviceIndex, -1);
+            EXPECT_THROW(std::rethrow_exception(result.error), std::runtime_error);
+        }
+    }
+}
@@ -1,4 +1,10 @@
 #include <thread>
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unistd.h>
 #include <gtest/gtest.h>
 #include "UUGear/Mega4/Mega4Hub.hpp"
 #include "UUGear/Mega4/Mega4Types.hpp"
@@ -146,3 +152,308 @@ TEST(Mega4Hub, PortConnectionAndPowerStateConsistency)
         }
         });
 }
+
+TEST(Mega4Hub, BatchPowerMaskValidation)
+{
+    UUGear::Mega4::Mega4Hub hub;
+    // Bits above port 4 are rejected whether or not a hub is present
+    EXPECT_THROW(hub.applyPowerMask(0x10, 0x00), std::out_of_range);
+    EXPECT_THROW(hub.applyPowerMasks({{99, 0x01, 0x00}}), std::out_of_range);
+
+    if (hub.listDevices().empty())
+    {
+        std::cout << "No MEGA4 hubs detected — skipping conflicting mask check.\n";
+        return;
+    }
+    EXPECT_THROW(hub.applyPowerMask(0x01, 0x01), std::invalid_argument);
+}
+
+TEST(Mega4Hub, BatchPowerMaskSingleSettle)
+{
+    UUGear::Mega4::Mega4Hub hub;
+    if (hub.listDevices().empty())
+    {
+        std::cout << "No MEGA4 hubs detected — skipping batch power test.\n";
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_NO_THROW(hub.applyPowerMask(0x0F, 0x00));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // All four ports switched with one settle wait rather than four
+    EXPECT_LT(elapsed, std::chrono::milliseconds(150));
+    for (int port = 1; port <= 4; ++port)
+        EXPECT_TRUE(hub.isPortOn(port));
+
+    ASSERT_NO_THROW(hub.applyPowerMask(0x00, 0x0F));
+    for (int port = 1; port <= 4; ++port)
+        EXPECT_FALSE(hub.isPortOn(port));
+}
+
+TEST(Mega4Hub, AsyncInvalidPortHandling)
+{
+    UUGear::Mega4::Mega4Hub hub;
+    EXPECT_THROW((void)hub.powerOnAsync(99), std::out_of_range);
+    EXPECT_THROW((void)hub.powerOffAsync(99), std::out_of_range);
+    EXPECT_THROW((void)hub.getPortStatesAsync(99), std::out_of_range);
+}
+
+TEST(Mega4Hub, AsyncPowerAndStateQuery)
+{
+    UUGear::Mega4::Mega4Hub hub;
+    if (hub.listDevices().empty())
+    {
+        std::cout << "No MEGA4 hubs detected — skipping async test.\n";
+        return;
+    }
+
+    ASSERT_NO_THROW(hub.powerOnAsync(3).get());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // async requests do not wait for settling
+    EXPECT_TRUE(hub.getPortStatesAsync().get()[2]);
+
+    // Callback flavour, several requests in flight at once
+    std::promise<void> off;
+    hub.powerOffAsync(3, 0, [&off](const std::exception_ptr& error)
+    {
+        if (error) off.set_exception(error);
+        else off.set_value();
+    });
+    auto states = hub.getPortStatesAsync();
+    ASSERT_NO_THROW(off.get_future().get());
+    ASSERT_NO_THROW(states.get());
+}
+
+TEST(Mega4Hub, PortEventSubscription)
+{
+    UUGear::Mega4::Mega4Hub hub;
+
+    int id = 0;
+    try
+    {
+        id = hub.subscribePortEvents([](const UUGear::Mega4::PortEvent& event)
+        {
+            std::cout << "[Hub " << event.deviceIndex << " port " << event.port.portNumber << "] "
+                << (event.connected ? "connected" : "disconnected") << "\n";
+        });
+    }
+    catch (const std::runtime_error& ex)
+    {
+        GTEST_SKIP() << "Hotplug not available: " << ex.what();
+    }
+
+    EXPECT_GT(id, 0);
+    const int second = hub.subscribePortEvents([](const UUGear::Mega4::PortEvent&) {});
+    EXPECT_NE(id, second);
+
+    EXPECT_NO_THROW(hub.unsubscribePortEvents(id));
+    EXPECT_NO_THROW(hub.unsubscribePortEvents(second));
+    EXPECT_NO_THROW(hub.unsubscribePortEvents(12345)); // unknown ids are ignored
+}
+
+TEST(Mega4Hub, PortStatusChangeOnPowerToggle)
+{
+    UUGear::Mega4::Mega4Hub hub;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<UUGear::Mega4::PortStatusChange> changes;
+
+    const int id = hub.subscribePortStatus([&](const UUGear::Mega4::PortStatusChange& change)
+    {
+        std::lock_guard lock(mutex);
+        changes.push_back(change);
+        changed.notify_all();
+    });
+    EXPECT_GT(id, 0);
+
+    if (hub.listDevices().empty())
+    {
+        hub.unsubscribePortStatus(id);
+        GTEST_SKIP() << "No MEGA4 hubs detected — skipping status change test.";
+    }
+
+    ASSERT_NO_THROW(hub.powerOff(4));
+
+    std::unique_lock lock(mutex);
+    ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(2), [&]
+    {
+        return std::any_of(changes.begin(), changes.end(), [](const auto& c) { return c.portNumber == 4; });
+    }));
+    const auto it = std::find_if(changes.begin(), changes.end(), [](const auto& c) { return c.portNumber == 4; });
+    EXPECT_EQ(it->deviceIndex, 0);
+    EXPECT_FALSE(it->powered);
+    lock.unlock();
+
+    hub.unsubscribePortStatus(id);
+}
+
+TEST(Mega4Hub, CachedPortStateSnapshot)
+{
+    UUGear::Mega4::Mega4HubOptions options;
+    options.stateCacheTtl = std::chrono::seconds(10);
+    UUGear::Mega4::Mega4Hub hub(options);
+
+    if (hub.listDevices().empty())
+    {
+        EXPECT_THROW((void)hub.getPortStateSnapshot(0), std::out_of_range);
+        GTEST_SKIP() << "No MEGA4 hubs detected — skipping snapshot cache test.";
+    }
+
+    const auto first = hub.getPortStateSnapshot(0);
+    ASSERT_TRUE(first.valid);
+
+    // Within the TTL the snapshot is served without touching the hardware
+    const auto cached = hub.getPortStateSnapshot(0);
+    EXPECT_EQ(cached.generation, first.generation);
+    EXPECT_EQ(cached.timestamp, first.timestamp);
+
+    // Own power requests update the snapshot without a new read
+    const bool wasOn = hub.isPortOn(1);
+    ASSERT_NO_THROW(wasOn ? hub.powerOff(1) : hub.powerOn(1));
+    const auto toggled = hub.getPortStateSnapshot(0);
+    EXPECT_EQ(toggled.states[0], !wasOn);
+    EXPECT_GT(toggled.generation, cached.generation);
+    EXPECT_EQ(toggled.timestamp, first.timestamp);
+
+    // Forcing a hardware read refreshes the timestamp and agrees with the snapshot
+    const auto forced = hub.getPortStateSnapshot(0, true);
+    EXPECT_GT(forced.timestamp, first.timestamp);
+    EXPECT_EQ(forced.states[0], !wasOn);
+
+    ASSERT_NO_THROW(wasOn ? hub.powerOn(1) : hub.powerOff(1));
+}
+
+TEST(Mega4Hub, FullPortStatusDecoding)
+{
+    UUGear::Mega4::Mega4Hub hub;
+
+    if (hub.listDevices().empty())
+    {
+        EXPECT_THROW((void)hub.getPortStatus(0), std::out_of_range);
+        GTEST_SKIP() << "No MEGA4 hubs detected — skipping port status test.";
+    }
+
+    const auto statuses = hub.getPortStatus(0);
+    const auto states = hub.getPortStates(0, true);
+    const auto connections = hub.getPortConnections(0);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ASSERT_TRUE(statuses[i].valid);
+        EXPECT_EQ(statuses[i].portNumber, i + 1);
+        EXPECT_EQ(statuses[i].powered, states[i]);
+        EXPECT_EQ(statuses[i].connected, connections[i].hasDevice);
+        if (!statuses[i].connected)
+        {
+            EXPECT_EQ(statuses[i].speed, UUGear::Mega4::PortSpeed::Unknown);
+        }
+    }
+}
+
+TEST(Mega4Hub, RepeatedListingIsStable)
+{
+    const UUGear::Mega4::Mega4Hub hub;
+
+    const auto first = hub.listDevices();
+    for (int i = 0; i < 10; ++i)
+    {
+        const auto again = hub.listDevices();
+        ASSERT_EQ(again.size(), first.size());
+        for (size_t j = 0; j < first.size(); ++j)
+            EXPECT_EQ(again[j].busPortPath, first[j].busPortPath);
+    }
+
+    // Nothing was plugged or unplugged in between
+    const auto changes = hub.rescanDevices();
+    EXPECT_TRUE(changes.added.empty());
+    EXPECT_TRUE(changes.removed.empty());
+}
+
+TEST(Mega4Hub, RepeatedPortListingUsesCachedStrings)
+{
+    const UUGear::Mega4::Mega4Hub hub;
+
+    if (hub.listDevices().empty())
+        GTEST_SKIP() << "No MEGA4 hubs detected — skipping port listing test.";
+
+    const auto first = hub.getPortConnections(0);
+    const auto second = hub.getPortConnections(0);
+
+    ASSERT_EQ(first.size(), second.size());
+    for (size_t i = 0; i < first.size(); ++i)
+    {
+        EXPECT_EQ(first[i].hasDevice, second[i].hasDevice);
+        EXPECT_EQ(first[i].vid, second[i].vid);
+        EXPECT_EQ(first[i].pid, second[i].pid);
+        EXPECT_EQ(first[i].manufacturer, second[i].manufacturer);
+        EXPECT_EQ(first[i].product, second[i].product);
+    }
+}
+
+TEST(Mega4Hub, SysfsBackendOnFakeTree)
+{
+    namespace fs = std::filesystem;
+
+    // Minimal /sys/bus/usb/devices layout: one USB2 MEGA4 at 1-1 with a device on port 2
+    const fs::path root = fs::temp_directory_path() / ("mega4_sysfs_" + std::to_string(::getpid()));
+    fs::remove_all(root);
+    const auto writeFile = [](const fs::path& path, const std::string& content)
+    {
+        fs::create_directories(path.parent_path());
+        std::ofstream(path) << content << "\n";
+    };
+
+    writeFile(root / "1-1" / "idVendor", "2109");
+    writeFile(root / "1-1" / "idProduct", "2817");
+    writeFile(root / "1-1" / "devnum", "5");
+    for (int port = 1; port <= 4; ++port)
+        writeFile(root / "1-1" / "1-1:1.0" / ("1-1-port" + std::to_string(port)) / "disable", port == 3 ? "1" : "0");
+    writeFile(root / "1-1.2" / "idVendor", "13fe");
+    writeFile(root / "1-1.2" / "idProduct", "4300");
+    writeFile(root / "1-1.2" / "manufacturer", "Wilk");
+    writeFile(root / "1-1.2" / "product", "USB DISK 3.0");
+    writeFile(root / "1-1.2" / "bDeviceClass", "00");
+    writeFile(root / "1-1.2" / "bConfigurationValue", "1");
+    writeFile(root / "1-1.2" / "1-1.2:1.0" / "bInterfaceClass", "08");
+    writeFile(root / "1-1:1.0" / "bInterfaceClass", "09");
+
+    UUGear::Mega4::Mega4HubOptions options;
+    options.sysfsRoot = root.string();
+    const UUGear::Mega4::Mega4Hub hub(options);
+
+    const auto devices = hub.listDevices();
+    ASSERT_EQ(devices.size(), 1u);
+    EXPECT_EQ(devices[0].busPortPath, "1-1");
+    EXPECT_EQ(devices[0].pid, 0x2817);
+
+    const auto states = hub.getPortStates(0);
+    EXPECT_TRUE(states[0]);
+    EXPECT_TRUE(states[1]);
+    EXPECT_FALSE(states[2]);
+    EXPECT_TRUE(states[3]);
+
+    const auto ports = hub.getPortConnections(0);
+    EXPECT_FALSE(ports[0].hasDevice);
+    ASSERT_TRUE(ports[1].hasDevice);
+    EXPECT_EQ(ports[1].vid, 0x13fe);
+    EXPECT_EQ(ports[1].product, "USB DISK 3.0");
+    EXPECT_EQ(ports[1].deviceClass, 0x08); // declared per interface
+
+    ASSERT_NO_THROW(hub.powerOn(3));
+    ASSERT_NO_THROW(hub.powerOff(1));
+    EXPECT_TRUE(hub.isPortOn(3));
+    EXPECT_FALSE(hub.isPortOn(1));
+
+    std::string disabled;
+    std::ifstream(root / "1-1" / "1-1:1.0" / "1-1-port1" / "disable") >> disabled;
+    EXPECT_EQ(disabled, "1");
+
+    // The hub left: the next scan reports it
+    fs::remove_all(root / "1-1");
+    const auto changes = hub.rescanDevices();
+    ASSERT_EQ(changes.removed.size(), 1u);
+    EXPECT_TRUE(hub.listDevices().empty());
+
+    fs::remove_all(root);
+}
@@ -0,0 +1,978 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "UUGear/Mega4/HubExecutor.hpp"
+#include "UUGear/Mega4/Logger.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/Metrics.hpp"
+#include "UUGear/Mega4/PowerScheduler.hpp"
+#include "UUGear/Mega4/SharedState.hpp"
+#include "UUGear/Mega4/SharedStatePublisher.hpp"
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+
+using UUGear::Mega4::Mega4Hub;
+using UUGear::Mega4::Mega4HubOptions;
+using UUGear::Mega4::SimulatedMega4;
+
+namespace
+{
+    Mega4HubOptions simulated(const std::vector<std::shared_ptr<SimulatedMega4>>& hubs)
+    {
+        Mega4HubOptions options;
+        options.simulatedHubs = hubs;
+        return options;
+    }
+
+    UUGear::Mega4::PortConnectionInfo usbDisk(const int port)
+    {
+        UUGear::Mega4::PortConnectionInfo device{};
+        device.portNumber = port;
+        device.hasDevice = true;
+        device.vid = 0x13fe;
+        device.pid = 0x4300;
+        device.product = "USB DISK 3.0";
+        return device;
+    }
+}
+
+TEST(SimulatedMega4, ListsSimulatedHubsInPathOrder)
+{
+    const auto second = std::make_shared<SimulatedMega4>("1-2", true);
+    const auto first = std::make_shared<SimulatedMega4>("1-1");
+    const Mega4Hub hub(simulated({second, first}));
+
+    const auto devices = hub.listDevices();
+    ASSERT_EQ(devices.size(), 2u);
+    EXPECT_EQ(devices[0].busPortPath, "1-1");
+    EXPECT_EQ(devices[0].pid, 0x2817);
+    EXPECT_EQ(devices[1].busPortPath, "1-2");
+    EXPECT_EQ(devices[1].pid, 0x0817);
+}
+
+TEST(SimulatedMega4, PowerRequestsReachTheModel)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Mega4Hub hub(simulated({sim}));
+
+    hub.powerOff(2);
+    EXPECT_FALSE(sim->isPortPowered(2));
+    EXPECT_FALSE(hub.isPortOn(2));
+
+    hub.powerOn(2);
+    EXPECT_TRUE(sim->isPortPowered(2));
+    EXPECT_TRUE(hub.isPortOn(2));
+
+    hub.applyPowerMask(0x00, 0x05);
+    const auto states = hub.getPortStates(0, true);
+    EXPECT_FALSE(states[0]);
+    EXPECT_TRUE(states[1]);
+    EXPECT_FALSE(states[2]);
+    EXPECT_TRUE(states[3]);
+}
+
+TEST(SimulatedMega4, ReportsAttachedDevices)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    sim->attachDevice(usbDisk(3));
+    const Mega4Hub hub(simulated({sim}));
+
+    const auto status = hub.getPortStatus();
+    EXPECT_TRUE(status[2].valid);
+    EXPECT_TRUE(status[2].connected);
+    EXPECT_EQ(status[2].speed, UUGear::Mega4::PortSpeed::High);
+    EXPECT_FALSE(status[0].connected);
+
+    auto ports = hub.getPortConnections();
+    ASSERT_TRUE(ports[2].hasDevice);
+    EXPECT_EQ(ports[2].product, "USB DISK 3.0");
+
+    // A device on an unpowered port is not enumerated
+    hub.powerOff(3);
+    ports = hub.getPortConnections();
+    EXPECT_FALSE(ports[2].hasDevice);
+}
+
+TEST(SimulatedMega4, PortDeviceStringsAreReadOncePerEnumeration)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    sim->attachDevice(usbDisk(2));
+    const Mega4Hub hub(simulated({sim}));
+
+    EXPECT_EQ(hub.getPortConnections()[1].product, "USB DISK 3.0");
+    EXPECT_EQ(hub.getPortConnections()[1].product, "USB DISK 3.0");
+    EXPECT_EQ(sim->stringReadCount(), 1u) << "the second listing is served from the cache";
+
+    // Another device on the same port gets a new address, so its strings are read again
+    auto other = usbDisk(2);
+    other.product = "Flash Drive";
+    sim->detachDevice(2);
+    sim->attachDevice(other);
+    EXPECT_EQ(hub.getPortConnections()[1].product, "Flash Drive");
+    EXPECT_EQ(sim->stringReadCount(), 2u);
+
+    // Power cycling the port re-enumerates the device
+    const uint8_t address = sim->deviceAddress(2);
+    hub.powerOff(2);
+    EXPECT_FALSE(hub.getPortConnections()[1].hasDevice);
+    hub.powerOn(2);
+    EXPECT_NE(sim->deviceAddress(2), address);
+    EXPECT_EQ(hub.getPortConnections()[1].product, "Flash Drive");
+    EXPECT_EQ(sim->stringReadCount(), 3u);
+}
+
+TEST(SimulatedMega4, DecodesUsb2AndUsb3PortStatus)
+{
+    using UUGear::Mega4::PortSpeed;
+    const auto usb2 = std::make_shared<SimulatedMega4>("1-1");
+    const auto usb3 = std::make_shared<SimulatedMega4>("1-2", true);
+    usb2->attachDevice(usbDisk(1), PortSpeed::Low);
+    usb2->attachDevice(usbDisk(2), PortSpeed::Full);
+    usb2->attachDevice(usbDisk(3));
+    usb2->setOverCurrent(4, true);
+    usb3->attachDevice(usbDisk(1));
+    const Mega4Hub hub(simulated({usb2, usb3}));
+
+    // SET_FEATURE(PORT_RESET) on port 3, class request to "other"
+    ASSERT_EQ(usb2->controlTransfer(0x23, 0x03, 4, 3, nullptr, 0), 0);
+    hub.powerOff(3, 1);
+
+    const auto low = hub.getPortStatus(0);
+    EXPECT_EQ(low[0].wPortStatus, 0x0303);
+    EXPECT_EQ(low[0].speed, PortSpeed::Low);
+    EXPECT_TRUE(low[0].connected && low[0].enabled && low[0].powered);
+    EXPECT_TRUE(low[0].connectionChanged);
+    EXPECT_EQ(low[1].wPortStatus, 0x0103);
+    EXPECT_EQ(low[1].speed, PortSpeed::Full);
+    EXPECT_EQ(low[2].wPortStatus, 0x0503);
+    EXPECT_EQ(low[2].speed, PortSpeed::High);
+    EXPECT_TRUE(low[2].resetChanged);
+    EXPECT_EQ(low[3].wPortStatus, 0x0108);
+    EXPECT_FALSE(low[3].connected);
+    EXPECT_EQ(low[3].speed, PortSpeed::Unknown);
+    EXPECT_TRUE(low[3].overCurrent);
+    EXPECT_TRUE(low[3].overCurrentChanged);
+    for (const auto& status : low)
+    {
+        EXPECT_TRUE(status.valid);
+        EXPECT_FALSE(status.suspended);
+        EXPECT_EQ(status.linkState, 0);
+    }
+
+    const auto super = hub.getPortStatus(1);
+    EXPECT_EQ(super[0].wPortStatus, 0x0203); // U0
+    EXPECT_EQ(super[0].speed, PortSpeed::Super);
+    EXPECT_TRUE(super[0].connected && super[0].powered);
+    EXPECT_EQ(super[0].linkState, 0);
+    EXPECT_EQ(super[1].wPortStatus, 0x02a0); // Rx.Detect
+    EXPECT_EQ(super[1].linkState, 5);
+    EXPECT_EQ(super[1].speed, PortSpeed::Unknown);
+    EXPECT_EQ(super[2].wPortStatus, 0x0080); // SS.Disabled, unpowered
+    EXPECT_EQ(super[2].linkState, 4);
+    EXPECT_FALSE(super[2].powered);
+    EXPECT_FALSE(super[0].suspended || super[0].enableChanged || super[0].suspendChanged);
+}
+
+TEST(SimulatedMega4, InjectedFailuresSurfaceAsErrors)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Mega4Hub hub(simulated({sim}));
+
+    sim->failNextTransfers(1);
+    EXPECT_THROW(hub.powerOff(1), std::runtime_error);
+    EXPECT_TRUE(sim->isPortPowered(1));
+
+    ASSERT_NO_THROW(hub.powerOff(1));
+    EXPECT_FALSE(sim->isPortPowered(1));
+}
+
+TEST(SimulatedMega4, SnapshotServesReadsUntilTtlExpires)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    Mega4HubOptions options = simulated({sim});
+    options.stateCacheTtl = std::chrono::milliseconds(100);
+    const Mega4Hub hub(options);
+
+    const auto first = hub.getPortStateSnapshot();
+    ASSERT_TRUE(first.valid);
+    const uint64_t transfers = sim->transferCount();
+
+    // Switched behind the hub's back: the fresh snapshot still answers
+    // CLEAR_FEATURE(PORT_POWER) on port 1, class request to "other"
+    ASSERT_EQ(sim->controlTransfer(0x23, 0x01, 8, 1, nullptr, 0), 0);
+    const auto cached = hub.getPortStateSnapshot();
+    EXPECT_TRUE(cached.states[0]);
+    EXPECT_EQ(cached.generation, first.generation);
+    EXPECT_EQ(sim->transferCount(), transfers + 1);
+
+    // Own power requests update the snapshot without a read and without making it younger
+    hub.powerOff(2);
+    const auto updated = hub.getPortStateSnapshot();
+    EXPECT_FALSE(updated.states[1]);
+    EXPECT_GT(updated.generation, cached.generation);
+    EXPECT_EQ(updated.timestamp, first.timestamp);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    const auto expired = hub.getPortStateSnapshot();
+    EXPECT_FALSE(expired.states[0]) << "an expired snapshot is read again";
+    EXPECT_GT(expired.generation, updated.generation);
+    EXPECT_GT(expired.timestamp, first.timestamp);
+}
+
+TEST(SimulatedMega4, FailedPortReadsAreNotCachedAsOff)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    Mega4HubOptions options = simulated({sim});
+    options.stateCacheTtl = std::chrono::hours(1);
+    const Mega4Hub hub(options);
+
+    ASSERT_EQ(hub.getPortStates(0), (std::array<bool, 4>{true, true, true, true}));
+
+    // A timeout on port 1 fails the read instead of caching the port as OFF
+    sim->failNextTransfers(1, -7); // LIBUSB_ERROR_TIMEOUT
+    EXPECT_THROW((void)hub.getPortStates(0, true), std::runtime_error);
+    EXPECT_EQ(hub.getPortStates(0), (std::array<bool, 4>{true, true, true, true}));
+
+    sim->failNextTransfers(1, -7);
+    auto failed = hub.getPortStatesAsync(0);
+    EXPECT_THROW((void)failed.get(), std::runtime_error);
+    EXPECT_EQ(hub.getPortStates(0), (std::array<bool, 4>{true, true, true, true}));
+}
+
+TEST(SimulatedMega4, AsyncRequestsHonourLatency)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    sim->setLatency(std::chrono::milliseconds(20));
+    const Mega4Hub hub(simulated({sim}));
+
+    const auto start = std::chrono::steady_clock::now();
+    auto off = hub.powerOffAsync(4);
+    auto states = hub.getPortStatesAsync();
+    ASSERT_NO_THROW(off.get());
+    const auto result = states.get();
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+    EXPECT_FALSE(sim->isPortPowered(4));
+    EXPECT_FALSE(result[3]);
+}
+
+TEST(SimulatedMega4, UnpluggedHubIsNotListed)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Mega4Hub hub(simulated({sim}));
+    ASSERT_EQ(hub.listDevices().size(), 1u);
+
+    sim->setConnected(false);
+    auto changes = hub.rescanDevices();
+    EXPECT_EQ(changes.removed.size(), 1u);
+    EXPECT_THROW(hub.powerOn(1), std::out_of_range);
+
+    sim->setConnected(true);
+    changes = hub.rescanDevices();
+    EXPECT_EQ(changes.added.size(), 1u);
+    EXPECT_NO_THROW(hub.powerOn(1));
+}
+
+TEST(SimulatedMega4, StatusSubscribersSeeOwnPowerChanges)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    sim->attachDevice(usbDisk(1));
+    const Mega4Hub hub(simulated({sim}));
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<UUGear::Mega4::PortStatusChange> changes;
+    const int id = hub.subscribePortStatus([&](const UUGear::Mega4::PortStatusChange& change)
+    {
+        std::lock_guard lock(mutex);
+        changes.push_back(change);
+        cv.notify_all();
+    });
+
+    hub.powerOff(1);
+
+    {
+        std::unique_lock lock(mutex);
+        ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(2), [&] { return !changes.empty(); }));
+        EXPECT_EQ(changes.back().portNumber, 1);
+        EXPECT_FALSE(changes.back().powered);
+        EXPECT_TRUE(changes.back().status.connectionChanged);
+    }
+    hub.unsubscribePortStatus(id);
+}
+
+TEST(SimulatedMega4, UnsubscribeWaitsForRunningCallbacks)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Mega4Hub hub(simulated({sim}));
+
+    std::promise<void> entered;
+    std::atomic<bool> finished{false};
+    const int slow = hub.subscribePortStatus([&](const UUGear::Mega4::PortStatusChange& change)
+    {
+        if (change.portNumber != 1)
+            return;
+        entered.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        finished = true;
+    });
+    int self = 0;
+    std::atomic<int> selfCalls{0};
+    self = hub.subscribePortStatus([&](const UUGear::Mega4::PortStatusChange&)
+    {
+        ++selfCalls;
+        hub.unsubscribePortStatus(self);
+    });
+
+    auto toggle = std::async(std::launch::async, [&] { hub.powerOff(1); });
+    ASSERT_EQ(entered.get_future().wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    hub.unsubscribePortStatus(slow);
+    EXPECT_TRUE(finished);
+
+    // Unsubscribing from its own callback returned rather than waiting for itself
+    ASSERT_EQ(toggle.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    hub.powerOff(2);
+    EXPECT_EQ(selfCalls, 1);
+}
+
+TEST(SimulatedMega4, CaptureReplaysWithoutHardware)
+{
+    const auto trace = std::filesystem::temp_directory_path() /
+        ("mega4_trace_" + std::to_string(::getpid()) + ".bin");
+
+    std::array<bool, 4> captured{};
+    {
+        const auto sim = std::make_shared<SimulatedMega4>();
+        sim->attachDevice(usbDisk(2));
+        sim->setLatency(std::chrono::milliseconds(10));
+        auto options = simulated({sim});
+        options.captureFile = trace.string();
+        const Mega4Hub hub(options);
+
+        hub.powerOff(3);
+        captured = hub.getPortStates(0, true);
+        sim->failNextTransfers(1);
+        EXPECT_THROW(hub.powerOn(3), std::runtime_error);
+        EXPECT_TRUE(hub.getPortStatus()[1].connected);
+    }
+
+    // Same calls, no delays: same answers, the injected failure included
+    {
+        Mega4HubOptions options;
+        options.replayFile = trace.string();
+        options.replayWithTiming = false;
+        const Mega4Hub hub(options);
+
+        ASSERT_EQ(hub.listDevices().size(), 1u);
+        hub.powerOff(3);
+        EXPECT_EQ(hub.getPortStates(0, true), captured);
+        EXPECT_THROW(hub.powerOn(3), std::runtime_error);
+        EXPECT_TRUE(hub.getPortStatus()[1].connected);
+    }
+
+    // With the captured timing each request takes its original latency again
+    {
+        Mega4HubOptions options;
+        options.replayFile = trace.string();
+        const Mega4Hub hub(options);
+
+        const auto start = std::chrono::steady_clock::now();
+        EXPECT_FALSE(hub.getPortStates(0, true)[2]);
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(10));
+    }
+
+    std::filesystem::remove(trace);
+}
+
+TEST(SimulatedMega4, MetricsCountTransfersAndLatency)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Mega4Hub hub(simulated({sim}));
+
+    hub.powerOff(1);
+    (void)hub.getPortStates(0, true);
+    sim->failNextTransfers(1, -7); // LIBUSB_ERROR_TIMEOUT
+    EXPECT_THROW(hub.powerOn(1), std::runtime_error);
+
+    const auto metrics = hub.metrics();
+    EXPECT_EQ(metrics.transfers, 6u); // 1 power + 4 GET_STATUS + 1 failed power
+    EXPECT_EQ(metrics.transferErrors, 1u);
+    EXPECT_EQ(metrics.timeouts, 1u);
+
+    const auto find = [&](const std::string& operation)
+    {
+        for (const auto& latency : metrics.operations)
+        {
+            if (latency.operation == operation)
+                return latency;
+        }
+        return UUGear::Mega4::LatencySnapshot{};
+    };
+    EXPECT_EQ(find("powerOff").count, 1u);
+    EXPECT_GE(find("powerOff").sumNanoseconds, 50'000'000u); // includes the power settle wait
+    EXPECT_EQ(find("powerOn").failures, 1u);
+    EXPECT_EQ(find("controlTransfer").count, 6u);
+
+    const std::string text = metrics.toPrometheus();
+    EXPECT_NE(text.find("mega4_transfers_total 6\n"), std::string::npos);
+    EXPECT_NE(text.find("mega4_operation_duration_seconds_count{operation=\"powerOff\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("mega4_operation_failures_total{operation=\"powerOn\"} 1\n"), std::string::npos);
+
+    EXPECT_EQ(UUGear::Mega4::LatencyHistogram::bucketFor(0), 0u);
+    EXPECT_EQ(UUGear::Mega4::LatencyHistogram::bucketFor(1000), 10u); // 512 <= 1000 < 1024
+    EXPECT_EQ(UUGear::Mega4::LatencyHistogram::bucketFor(UINT64_MAX), UUGear::Mega4::LatencySnapshot::BUCKET_COUNT - 1);
+}
+
+TEST(SimulatedMega4, LoggerDeliversHubMessagesToSink)
+{
+    using UUGear::Mega4::Logger;
+    using UUGear::Mega4::LogLevel;
+    using UUGear::Mega4::LogRecord;
+
+    std::mutex mutex;
+    std::vector<LogRecord> records;
+    Logger& logger = Logger::instance();
+    logger.flush();
+    logger.setSink([&](const LogRecord& record)
+    {
+        std::lock_guard lock(mutex);
+        records.push_back(record);
+    });
+
+    const auto sim = std::make_shared<SimulatedMega4>();
+    {
+        const Mega4Hub hub(simulated({sim}));
+        hub.powerOff(1);
+    }
+
+    logger.setLevel(LogLevel::Warning);
+    UUGEAR_MEGA4_LOG_INFO("filtered out");
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t)
+    {
+        producers.emplace_back([t]
+        {
+            for (int i = 0; i < 100; ++i)
+                UUGEAR_MEGA4_LOG_WARNING("producer " << t << " message " << i);
+        });
+    }
+    for (auto& producer : producers)
+        producer.join();
+
+    logger.flush();
+    logger.setLevel(LogLevel::Info);
+    logger.setSink({});
+
+    std::lock_guard lock(mutex);
+    ASSERT_FALSE(records.empty());
+    EXPECT_EQ(records.front().level, LogLevel::Info);
+    EXPECT_EQ(records.front().message, "Port 1 OFF (hub 0)");
+
+    size_t warnings = 0;
+    for (const auto& record : records)
+    {
+        EXPECT_NE(record.message, "filtered out");
+        if (record.level == LogLevel::Warning)
+            ++warnings;
+    }
+    EXPECT_EQ(warnings + logger.dropped(), 400u);
+}
+
+TEST(SimulatedMega4, ExecutorFansOutAcrossHubsByPath)
+{
+    std::vector<std::shared_ptr<SimulatedMega4>> sims;
+    for (int i = 1; i <= 8; ++i)
+    {
+        sims.push_back(std::make_shared<SimulatedMega4>("1-" + std::to_string(i)));
+        sims.back()->setLatency(std::chrono::milliseconds(10));
+    }
+    const Mega4Hub hub(simulated(sims));
+    const UUGear::Mega4::HubExecutor executor(hub);
+
+    // 4 GET_STATUS of 10 ms per hub: 320 ms one hub after the other
+    const auto start = std::chrono::steady_clock::now();
+    const auto states = executor.getPortStates({}, true);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ASSERT_EQ(states.size(), 8u);
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        EXPECT_TRUE(states[i].ok());
+        EXPECT_EQ(states[i].hubPath, "1-" + std::to_string(i + 1));
+        EXPECT_EQ(states[i].value, (std::array<bool, 4>{true, true, true, true}));
+    }
+    EXPECT_LT(elapsed, std::chrono::milliseconds(200));
+
+    sims[2]->failNextTransfers(1);
+    const auto results = executor.powerOff(3, {"1-5", "1-3", "9-9"});
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_TRUE(results[0].ok());
+    EXPECT_EQ(results[0].deviceIndex, 4);
+    EXPECT_THROW(std::rethrow_exception(results[1].error), std::runtime_error);
+    EXPECT_EQ(results[2].deviceIndex, -1);
+    EXPECT_THROW(std::rethrow_exception(results[2].error), std::out_of_range);
+    EXPECT_FALSE(sims[4]->isPortPowered(3));
+    EXPECT_TRUE(sims[2]->isPortPowered(3));
+    EXPECT_TRUE(sims[0]->isPortPowered(3));
+
+    const auto counts = executor.forEach([](const Mega4Hub& h, const int deviceIndex)
+    {
+        return h.getPortConnections(deviceIndex).size();
+    }, {"1-8"});
+    ASSERT_EQ(counts.size(), 1u);
+    EXPECT_EQ(counts[0].value, 4u);
+}
+
+TEST(SimulatedMega4, PowerPlanRespectsSpacingAndConcurrency)
+{
+    using UUGear::Mega4::PowerPlan;
+    using UUGear::Mega4::PowerStepState;
+
+    const auto first = std::make_shared<SimulatedMega4>("1-1");
+    const auto second = std::make_shared<SimulatedMega4>("1-2");
+    const Mega4Hub hub(simulated({first, second}));
+    UUGear::Mega4::PowerScheduler scheduler(hub);
+
+    PowerPlan plan;
+    for (int port = 1; port <= 4; ++port)
+    {
+        plan.steps.push_back({"1-1", port, false});
+        plan.steps.push_back({"1-2", port, false});
+    }
+    plan.steps.push_back({"9-9", 1, false});
+    plan.spacing = std::chrono::milliseconds(10);
+    plan.maxConcurrent = 3;
+    plan.settleTime = std::chrono::milliseconds(60);
+
+    // Three steps per 60 ms settle window: 9 steps take at least two full windows
+    const auto start = std::chrono::steady_clock::now();
+    auto result = scheduler.submit(plan);
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const auto outcome = result.get();
+    EXPECT_FALSE(outcome.cancelled);
+    EXPECT_FALSE(outcome.ok());
+    ASSERT_EQ(outcome.steps.size(), 9u);
+    for (size_t i = 0; i < 8; ++i)
+        EXPECT_EQ(outcome.steps[i].state, PowerStepState::Done);
+    EXPECT_EQ(outcome.steps[8].state, PowerStepState::Failed);
+    EXPECT_GE(elapsed, std::chrono::milliseconds(120));
+    for (int port = 1; port <= 4; ++port)
+    {
+        EXPECT_FALSE(first->isPortPowered(port));
+        EXPECT_FALSE(second->isPortPowered(port));
+    }
+
+    // Cancelled after the first step: the others never reach the hub
+    PowerPlan slow;
+    for (int port = 1; port <= 4; ++port)
+        slow.steps.push_back({"1-1", port, true});
+    slow.spacing = std::chrono::milliseconds(500);
+
+    std::promise<UUGear::Mega4::PowerPlanResult> cancelled;
+    const uint64_t id = scheduler.submit(slow, [&](const UUGear::Mega4::PowerPlanResult& r)
+    {
+        cancelled.set_value(r);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    scheduler.cancel(id);
+
+    auto future = cancelled.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+    const auto stopped = future.get();
+    EXPECT_EQ(stopped.planId, id);
+    EXPECT_TRUE(stopped.cancelled);
+    EXPECT_EQ(stopped.steps[0].state, PowerStepState::Done);
+    EXPECT_EQ(stopped.steps[1].state, PowerStepState::Skipped);
+    EXPECT_TRUE(first->isPortPowered(1));
+    EXPECT_FALSE(first->isPortPowered(2));
+}
+
+TEST(SimulatedMega4, ConfirmedPowerSwitchWaitsForPortPower)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    Mega4HubOptions options = simulated({sim});
+    options.powerConfirmTimeout = std::chrono::milliseconds(200);
+    const Mega4Hub hub(options);
+
+    // Switches at once: confirmed by the first poll instead of a 50 ms sleep
+    EXPECT_LT(hub.powerOff(1), std::chrono::milliseconds(20));
+    EXPECT_FALSE(sim->isPortPowered(1));
+
+    sim->setSwitchDelay(std::chrono::milliseconds(30));
+    const auto took = hub.powerOn(1);
+    EXPECT_GE(took, std::chrono::milliseconds(30));
+    EXPECT_LT(took, std::chrono::milliseconds(100));
+    EXPECT_TRUE(sim->isPortPowered(1));
+
+    sim->setSwitchDelay(std::chrono::milliseconds(500));
+    EXPECT_THROW(hub.powerOff(2), std::runtime_error);
+    EXPECT_THROW(hub.applyPowerMask(0x00, 0x0C), std::runtime_error);
+
+    // Without the option the fixed settle time is waited
+    const Mega4Hub fixed(simulated({std::make_shared<SimulatedMega4>("1-2")}));
+    EXPECT_GE(fixed.powerOff(1), std::chrono::milliseconds(50));
+}
+
+TEST(SimulatedMega4, PowerCycleRunsWithoutBlocking)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    const Mega4Hub hub(simulated({sim}));
+
+    const auto start = std::chrono::steady_clock::now();
+    auto cycle = hub.powerCycle({
+        UUGear::Mega4::PortPowerCycle{0, 1, std::chrono::milliseconds(150)},
+        UUGear::Mega4::PortPowerCycle{0, 2, std::chrono::milliseconds(30)},
+    });
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(30));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    EXPECT_FALSE(sim->isPortPowered(1));
+    EXPECT_TRUE(sim->isPortPowered(2)); // its shorter off-time is over
+    EXPECT_TRUE(sim->isPortPowered(3));
+
+    ASSERT_EQ(cycle.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    EXPECT_NO_THROW(cycle.get());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+    EXPECT_TRUE(sim->isPortPowered(1));
+
+    EXPECT_THROW((void)hub.powerCycle(5, std::chrono::milliseconds(10)), std::out_of_range);
+
+    sim->failNextTransfers(1);
+    auto failed = hub.powerCycle(4, std::chrono::milliseconds(10));
+    ASSERT_EQ(failed.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_TRUE(sim->isPortPowered(4)); // turned back ON even though turning it OFF failed
+}
+
+TEST(SimulatedMega4, ConcurrentReadersDoNotWaitOnOtherHubs)
+{
+    const auto toggled = std::make_shared<SimulatedMega4>("1-1");
+    const auto read = std::make_shared<SimulatedMega4>("1-2");
+    Mega4HubOptions options = simulated({toggled, read});
+    options.stateCacheTtl = std::chrono::hours(1); // only power requests update the snapshot of 1-1
+    const Mega4Hub hub(options);
+    (void)hub.getPortStates(0);
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+
+    // Two writers toggling the same hub; each toggle waits the 50 ms settle time
+    for (int writer = 0; writer < 2; ++writer)
+    {
+        threads.emplace_back([&, writer]
+        {
+            for (int i = 0; !stop; ++i)
+            {
+                try
+                {
+                    const int port = 1 + (writer * 2 + i) % 4;
+                    const int deviceIndex = hub.deviceIndexOf("1-1");
+                    (i % 2) ? hub.powerOn(port, deviceIndex) : hub.powerOff(port, deviceIndex);
+                }
+                catch (const std::exception&)
+                {
+                    ++failures;
+                }
+            }
+        });
+    }
+
+    // Rescans keep publishing new registry snapshots under the readers
+    threads.emplace_back([&]
+    {
+        while (!stop)
+        {
+            if (hub.listDevices().size() != 2)
+                ++failures;
+        }
+    });
+
+    std::atomic<int> reads{0};
+    for (int reader = 0; reader < 4; ++reader)
+    {
+        threads.emplace_back([&]
+        {
+            while (!stop)
+            {
+                try
+                {
+                    const auto states = hub.getPortStates(hub.deviceIndexOf("1-2"), true);
+                    if (states != std::array<bool, 4>{true, true, true, true})
+                        ++failures;
+                }
+                catch (const std::exception&)
+                {
+                    ++failures;
+                }
+                ++reads;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(failures, 0);
+    EXPECT_GT(reads, 100);
+
+    // A writer held inside the transport of 1-1 does not hold up the readers of 1-2
+    toggled->setPaused(true);
+    std::thread held([&] { hub.powerOff(1, hub.deviceIndexOf("1-1")); });
+    while (toggled->pausedTransfers() == 0)
+        std::this_thread::yield();
+    auto readers = std::async(std::launch::async, [&]
+    {
+        for (int i = 0; i < 20; ++i)
+            (void)hub.getPortStates(hub.deviceIndexOf("1-2"), true);
+        (void)hub.listDevices();
+    });
+    const bool readersDone = readers.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+    EXPECT_EQ(toggled->pausedTransfers(), 1) << "the writer was released before the readers finished";
+    toggled->setPaused(false);
+    held.join();
+    EXPECT_TRUE(readersDone) << "readers of 1-2 waited on the writer held on 1-1";
+
+    // Writers are done: the snapshot they kept up to date agrees with the hardware
+    const auto cached = hub.getPortStates(0);
+    for (int port = 1; port <= 4; ++port)
+        EXPECT_EQ(cached[port - 1], toggled->isPortPowered(port));
+}
+
+TEST(SimulatedMega4, ReadsStayOnOneHubWhileRescansShiftIndices)
+{
+    // 1-2 is hub 0 or hub 1 depending on whether 1-1 is plugged in
+    const auto coming = std::make_shared<SimulatedMega4>("1-1");
+    const auto staying = std::make_shared<SimulatedMega4>("1-2");
+    for (uint16_t port = 1; port <= 4; ++port)
+        ASSERT_EQ(staying->controlTransfer(0x23, 0x01, 8, port, nullptr, 0), 0); // CLEAR_FEATURE(PORT_POWER)
+    coming->setLatency(std::chrono::microseconds(200));
+    staying->setLatency(std::chrono::microseconds(200));
+    Mega4HubOptions options = simulated({coming, staying});
+    options.stateCacheTtl = std::chrono::hours(1);
+    const Mega4Hub hub(options);
+
+    constexpr std::array<bool, 4> allOn{true, true, true, true};
+    constexpr std::array<bool, 4> allOff{false, false, false, false};
+    std::atomic<bool> stop{false};
+    std::atomic<int> reads{0};
+    std::atomic<int> mixed{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            while (!stop)
+            {
+                try
+                {
+                    const auto states = hub.getPortStates(0, true);
+                    ++reads;
+                    if (states != allOn && states != allOff)
+                        ++mixed; // ports of both hubs in one read
+                }
+                catch (const std::runtime_error&)
+                {
+                    // 1-1 unplugged during the read
+                }
+            }
+        });
+    }
+
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    for (bool connected = false; std::chrono::steady_clock::now() < end || reads < 20; connected = !connected)
+    {
+        coming->setConnected(connected);
+        (void)hub.rescanDevices();
+        std::this_thread::sleep_for(std::chrono::microseconds(300));
+    }
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    coming->setConnected(true);
+    (void)hub.rescanDevices();
+    EXPECT_EQ(mixed.load(), 0);
+    // Each hub's snapshot holds its own ports, whichever index it had when it was read
+    EXPECT_EQ(hub.getPortStates(hub.deviceIndexOf("1-2")), allOff);
+}
+
+TEST(SimulatedMega4, ReadOverlappingAPowerRequestDoesNotCacheStaleState)
+{
+    const auto sim = std::make_shared<SimulatedMega4>();
+    Mega4HubOptions options = simulated({sim});
+    options.stateCacheTtl = std::chrono::hours(1);
+    options.powerConfirmTimeout = std::chrono::seconds(1);
+    const Mega4Hub hub(options);
+    ASSERT_TRUE(hub.getPortStates(0)[0]);
+
+    // The read takes 4 x 20 ms: port 1 is read before the OFF request lands, the result stored after it
+    sim->setLatency(std::chrono::milliseconds(20));
+    auto read = std::async(std::launch::async, [&] { return hub.getPortStates(0, true); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    hub.powerOff(1);
+    (void)read.get();
+
+    EXPECT_FALSE(hub.getPortStates(0)[0]) << "the overlapping read replaced the newer OFF state";
+    EXPECT_FALSE(sim->isPortPowered(1));
+}
+
+TEST(SimulatedMega4, SharedStateReaderSeesPublishedHubs)
+{
+    const auto sim = std::make_shared<SimulatedMega4>("1-3");
+    sim->attachDevice(usbDisk(2));
+    Mega4HubOptions options = simulated({sim});
+    options.stateCacheTtl = std::chrono::hours(1);
+    options.powerConfirmTimeout = std::chrono::milliseconds(500); // no fixed settle wait per toggle
+    const Mega4Hub hub(options);
+    (void)hub.listDevices();
+
+    const std::string name = "/uugear_mega4_test_" + std::to_string(::getpid());
+    auto publisher = std::make_unique<UUGear::Mega4::SharedStatePublisher>(hub, name, std::chrono::hours(1));
+    const UUGear::Mega4::SharedStateReader reader(name);
+    EXPECT_TRUE(reader.isAlive(std::chrono::seconds(10)));
+
+    auto state = reader.hub("1-3");
+    ASSERT_TRUE(state.has_value());
+    EXPECT_EQ(state->states, (std::array<bool, 4>{true, true, true, true}));
+    ASSERT_EQ(state->connections.size(), 4u);
+    EXPECT_TRUE(state->connections[1].hasDevice);
+    EXPECT_EQ(state->connections[1].vid, 0x13fe);
+    EXPECT_EQ(state->connections[1].product, "USB DISK 3.0");
+    EXPECT_FALSE(state->connections[0].hasDevice);
+
+    // A power change is published without waiting for the (hour-long) interval
+    const uint64_t generation = reader.generation();
+    hub.powerOff(4);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (reader.generation() == generation && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    state = reader.hub("1-3");
+    ASSERT_TRUE(state.has_value());
+    EXPECT_EQ(state->states, (std::array<bool, 4>{true, true, true, false}));
+    EXPECT_EQ(state->generation, 2u);
+
+    // Readers never see a half-written record while the publisher rewrites it
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+    std::thread readerThread([&]
+    {
+        UUGear::Mega4::SharedHubRecord record{};
+        while (!stop)
+        {
+            if (!reader.read(0, record))
+                continue;
+            // Port 4 is the one toggled; the device on port 2 stays in every version
+            if (record.ports[1].hasDevice != 1 || std::string(record.ports[1].product) != "USB DISK 3.0")
+                ++torn;
+        }
+    });
+    for (int i = 0; i < 200; ++i)
+    {
+        (i % 2) ? hub.powerOff(4) : hub.powerOn(4);
+        publisher->publish();
+    }
+    stop = true;
+    readerThread.join();
+    EXPECT_EQ(torn.load(), 0);
+
+    publisher.reset();
+    EXPECT_FALSE(reader.isAlive(std::chrono::hours(1)));
+    EXPECT_THROW(UUGear::Mega4::SharedStateReader{name}, std::runtime_error);
+}
+
+TEST(SimulatedMega4, UnreadableHubDoesNotTakeAnotherHubsSlot)
+{
+    const auto first = std::make_shared<SimulatedMega4>("1-1");
+    const auto second = std::make_shared<SimulatedMega4>("1-2");
+    const Mega4Hub hub(simulated({first, second}));
+    (void)hub.listDevices();
+
+    // 1-1 is still known but cannot be read when the publisher starts, so 1-2 gets the first slot
+    first->setConnected(false);
+    const std::string name = "/uugear_mega4_slots_" + std::to_string(::getpid());
+    const UUGear::Mega4::SharedStatePublisher publisher(hub, name, std::chrono::hours(1));
+    const UUGear::Mega4::SharedStateReader reader(name);
+    ASSERT_FALSE(reader.hub("1-1").has_value());
+    ASSERT_TRUE(reader.hub("1-2").has_value());
+
+    first->setConnected(true);
+    hub.powerOff(2, 1);
+    publisher.publish();
+    const auto one = reader.hub("1-1");
+    const auto two = reader.hub("1-2");
+    ASSERT_TRUE(one.has_value());
+    ASSERT_TRUE(two.has_value()) << "1-1 was published over the slot of 1-2";
+    EXPECT_EQ(one->states, (std::array<bool, 4>{true, true, true, true}));
+    EXPECT_EQ(two->states, (std::array<bool, 4>{true, false, true, true}));
+}
+
+TEST(SimulatedMega4, SharedStateReaderGivesUpOnASlotLeftMidWrite)
+{
+    const auto sim = std::make_shared<SimulatedMega4>("1-3");
+    const Mega4Hub hub(simulated({sim}));
+    (void)hub.listDevices();
+
+    const std::string name = "/uugear_mega4_midwrite_" + std::to_string(::getpid());
+    const UUGear::Mega4::SharedStatePublisher publisher(hub, name, std::chrono::hours(1));
+    const UUGear::Mega4::SharedStateReader reader(name);
+    ASSERT_TRUE(reader.hub("1-3").has_value());
+
+    // Leave the slot as a publisher dying in the middle of a write would
+    const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    void* mapped = ::mmap(nullptr, sizeof(UUGear::Mega4::SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fd, 0);
+    ::close(fd);
+    ASSERT_NE(mapped, MAP_FAILED);
+    auto& sequence = static_cast<UUGear::Mega4::SharedStateLayout*>(mapped)->slots[0].sequence;
+    sequence.fetch_add(1);
+
+    UUGear::Mega4::SharedHubRecord record{};
+    EXPECT_FALSE(reader.read(0, record));
+    EXPECT_FALSE(reader.read(reader.capacity(), record));
+    EXPECT_FALSE(reader.hub("1-3").has_value());
+    EXPECT_TRUE(reader.hubs().empty());
+
+    sequence.fetch_add(1);
+    EXPECT_TRUE(reader.hub("1-3").has_value());
+    ::munmap(mapped, sizeof(UUGear::Mega4::SharedStateLayout));
+}
+
+TEST(SimulatedMega4, SecondPublisherLeavesALiveSegmentAlone)
+{
+    const auto sim = std::make_shared<SimulatedMega4>("1-3");
+    const Mega4Hub hub(simulated({sim}));
+    (void)hub.listDevices();
+
+    const std::string name = "/uugear_mega4_owner_" + std::to_string(::getpid());
+    {
+        const UUGear::Mega4::SharedStatePublisher publisher(hub, name, std::chrono::hours(1));
+        const UUGear::Mega4::SharedStateReader reader(name);
+        EXPECT_THROW(UUGear::Mega4::SharedStatePublisher(hub, name, std::chrono::hours(1)), std::runtime_error);
+        EXPECT_TRUE(reader.isAlive(std::chrono::seconds(10)));
+        EXPECT_TRUE(reader.hub("1-3").has_value());
+        EXPECT_NO_THROW(UUGear::Mega4::SharedStateReader{name});
+    }
+    EXPECT_THROW(UUGear::Mega4::SharedStateReader{name}, std::runtime_error);
+
+    // A segment nobody holds, as left by a publisher that died, is replaced
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::ftruncate(fd, sizeof(UUGear::Mega4::SharedStateLayout)), 0);
+    ::close(fd);
+    const UUGear::Mega4::SharedStatePublisher publisher(hub, name, std::chrono::hours(1));
+    const UUGear::Mega4::SharedStateReader reader(name);
+    EXPECT_TRUE(reader.hub("1-3").has_value());
+}
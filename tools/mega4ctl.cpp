@@ -0,0 +1,555 @@
+#include "UUGear/Mega4/Logger.hpp"
+#include "UUGear/Mega4/Mega4Client.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t DEFAULT_JOBS = 8;
+
+    void usage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options] [COMMAND ARGS...]\n"
+            << "Runs one command given as arguments, or a script of commands (one per line) read from\n"
+            << "--file or stdin, over a single hub context. Independent commands run concurrently;\n"
+            << "every command prints one JSON line, in script order.\n\n"
+            << "Commands (HUB is a busPortPath such as 1-1.2, or an index from list):\n"
+            << "  list                    Rescan and list the hubs\n"
+            << "  power HUB PORT on|off   Switch a port\n"
+            << "  cycle HUB PORT [MS]     Turn a port OFF, then ON after MS (default 1000)\n"
+            << "  status HUB              Port power states and connected devices\n"
+            << "  wait                    Let every earlier command finish first\n"
+            << "Lines starting with # are ignored.\n\n"
+            << "Options:\n"
+            << "  -f, --file FILE         Read the script from FILE ('-' for stdin)\n"
+            << "  -j, --jobs N            Commands running at the same time (default " << DEFAULT_JOBS << ")\n"
+            << "  --daemon [SOCKET]       Go through mega4d (default " << UUGear::Mega4::Mega4Client::DEFAULT_SOCKET
+            << ")\n"
+            << "  --sysfs ROOT            Use the USB sysfs tree at ROOT where possible\n"
+            << "  --confirm-timeout MS    Poll PORT_POWER after power requests, up to MS\n"
+            << "  --simulate N            Drive N simulated hubs instead of real hardware\n"
+            << "  -v, --verbose           Also log every power request (to stderr)\n";
+    }
+
+    std::string quote(const std::string& text)
+    {
+        std::string out = "\"";
+        for (const char c : text)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+        return out + "\"";
+    }
+
+    /**
+     * @brief What a command touches: a port, a whole hub (port 0) or everything (empty hub).
+     */
+    struct Target
+    {
+        std::string hub;
+        int port = 0;
+
+        [[nodiscard]] bool conflictsWith(const Target& other) const
+        {
+            if (hub.empty() || other.hub.empty())
+                return true;
+            return hub == other.hub && (port == 0 || other.port == 0 || port == other.port);
+        }
+    };
+
+    struct Command
+    {
+        size_t line = 0;
+        std::vector<std::string> words;
+        Target target;
+        std::string error; ///< Parse error, reported instead of running the command
+    };
+
+    struct Result
+    {
+        std::string json; ///< One line, without the newline
+        bool ok = false;
+    };
+
+    class Runner
+    {
+    public:
+        Runner(const UUGear::Mega4::Mega4Hub& hub, std::vector<UUGear::Mega4::DeviceInfo> devices)
+            : hub_(hub), devices_(std::move(devices))
+        {
+        }
+
+        /**
+         * @brief Fills in the target of a parsed command, or its error.
+         */
+        void resolve(Command& command) const
+        {
+            const auto& w = command.words;
+            const std::string& name = w[0];
+            try
+            {
+                if (name == "list" || name == "wait")
+                {
+                    if (w.size() != 1)
+                        throw std::invalid_argument(name + " takes no arguments");
+                    return; // global
+                }
+                if (name == "status")
+                {
+                    if (w.size() != 2)
+                        throw std::invalid_argument("usage: status HUB");
+                    command.target = {hubPath(w[1]), 0};
+                    return;
+                }
+                if (name == "power" || name == "cycle")
+                {
+                    if (name == "power" && (w.size() != 4 || (w[3] != "on" && w[3] != "off")))
+                        throw std::invalid_argument("usage: power HUB PORT on|off");
+                    if (name == "cycle" && (w.size() < 3 || w.size() > 4))
+                        throw std::invalid_argument("usage: cycle HUB PORT [MS]");
+                    const int port = std::stoi(w[2]);
+                    if (port < 1 || port > 4)
+                        throw std::out_of_range("Invalid port number. MEGA4 has ports 1 to 4.");
+                    if (name == "cycle" && w.size() == 4)
+                        (void)std::stoul(w[3]);
+                    command.target = {hubPath(w[1]), port};
+                    return;
+                }
+                throw std::invalid_argument("unknown command " + name);
+            }
+            catch (const std::exception& ex)
+            {
+                command.error = ex.what();
+            }
+        }
+
+        using Done = std::function<void(Result result)>;
+
+        /**
+         * @brief Runs a command and hands its JSON line to done. A cycle returns as soon as it
+         *        is started; done then runs on the thread that completes it.
+         */
+        void run(const Command& command, const Done& done) const
+        {
+            const auto& w = command.words;
+            std::ostringstream out;
+            out << "{\"line\":" << command.line << ",\"cmd\":" << quote(w[0]);
+            if (!command.target.hub.empty())
+                out << ",\"hub\":" << quote(command.target.hub);
+            if (command.target.port)
+                out << ",\"port\":" << command.target.port;
+
+            const auto start = std::chrono::steady_clock::now();
+            try
+            {
+                if (!command.error.empty())
+                    throw std::invalid_argument(command.error);
+
+                if (w[0] == "list")
+                {
+                    const auto devices = hub_.listDevices();
+                    out << ",\"hubs\":[";
+                    for (size_t i = 0; i < devices.size(); ++i)
+                    {
+                        out << (i ? "," : "") << "{\"index\":" << i << ",\"path\":" << quote(devices[i].busPortPath)
+                            << ",\"vid\":" << devices[i].vid << ",\"pid\":" << devices[i].pid
+                            << ",\"description\":" << quote(devices[i].description) << "}";
+                    }
+                    out << "]";
+                }
+                else if (w[0] == "power")
+                {
+                    const int index = indexOf(command.target.hub);
+                    const bool on = w[3] == "on";
+                    (void)(on ? hub_.powerOn(command.target.port, index) : hub_.powerOff(command.target.port, index));
+                    out << ",\"on\":" << (on ? "true" : "false");
+                }
+                else if (w[0] == "cycle")
+                {
+                    const auto offTime = std::chrono::milliseconds(w.size() == 4 ? std::stoul(w[3]) : 1000);
+                    const std::vector<UUGear::Mega4::PortPowerCycle> cycles{
+                        {indexOf(command.target.hub), command.target.port, offTime}};
+                    out << ",\"offMs\":" << offTime.count();
+                    hub_.powerCycle(cycles, [json = out.str(), start, done](const std::exception_ptr& error)
+                    {
+                        done(complete(json, error, start));
+                    });
+                    return;
+                }
+                else if (w[0] == "status")
+                {
+                    const int index = indexOf(command.target.hub);
+                    const auto states = hub_.getPortStates(index, true);
+                    const auto connections = hub_.getPortConnections(index);
+                    out << ",\"ports\":[";
+                    for (size_t i = 0; i < states.size(); ++i)
+                    {
+                        out << (i ? "," : "") << "{\"port\":" << i + 1 << ",\"on\":" << (states[i] ? "true" : "false");
+                        for (const auto& connection : connections)
+                        {
+                            if (connection.portNumber != static_cast<int>(i + 1) || !connection.hasDevice)
+                                continue;
+                            out << ",\"device\":{\"vid\":" << connection.vid << ",\"pid\":" << connection.pid
+                                << ",\"class\":" << static_cast<int>(connection.deviceClass)
+                                << ",\"manufacturer\":" << quote(connection.manufacturer)
+                                << ",\"product\":" << quote(connection.product) << "}";
+                        }
+                        out << "}";
+                    }
+                    out << "]";
+                }
+            }
+            catch (const std::exception&)
+            {
+                done(complete(out.str(), std::current_exception(), start));
+                return;
+            }
+            done(complete(out.str(), nullptr, start));
+        }
+
+    private:
+        /**
+         * @brief Ends the JSON line of a command with its outcome and duration.
+         */
+        static Result complete(const std::string& json, const std::exception_ptr& error,
+                               const std::chrono::steady_clock::time_point start)
+        {
+            Result result;
+            std::ostringstream out;
+            out << json;
+            try
+            {
+                if (error)
+                    std::rethrow_exception(error);
+                out << ",\"ok\":true";
+                result.ok = true;
+            }
+            catch (const std::exception& ex)
+            {
+                out << ",\"ok\":false,\"error\":" << quote(ex.what());
+            }
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+            out << ",\"us\":" << elapsed.count() << "}";
+            result.json = out.str();
+            return result;
+        }
+
+        [[nodiscard]] std::string hubPath(const std::string& hub) const
+        {
+            if (hub.find('-') != std::string::npos)
+                return hub;
+            const size_t index = std::stoul(hub);
+            if (index >= devices_.size())
+                throw std::out_of_range("No MEGA4 hub with index " + hub);
+            return devices_[index].busPortPath;
+        }
+
+        [[nodiscard]] int indexOf(const std::string& path) const
+        {
+            const int index = hub_.deviceIndexOf(path);
+            if (index < 0)
+                throw std::out_of_range("No MEGA4 hub at " + path);
+            return index;
+        }
+
+        const UUGear::Mega4::Mega4Hub& hub_;
+        std::vector<UUGear::Mega4::DeviceInfo> devices_; ///< Scan the script's hub indexes refer to
+    };
+
+    /**
+     * @brief Runs commands on a few workers, starting each as soon as no earlier
+     *        unfinished command touches the same port, and prints the results in order.
+     *        A cycle gives its worker back while the port is OFF.
+     */
+    class Pipeline
+    {
+    public:
+        Pipeline(const Runner& runner, const size_t jobs) : runner_(runner)
+        {
+            for (size_t i = 0; i < (jobs ? jobs : 1); ++i)
+                workers_.emplace_back([this] { work(); });
+        }
+
+        ~Pipeline()
+        {
+            finish();
+        }
+
+        /**
+         * @brief Waits for every submitted command and stops the workers.
+         * @return True if every command succeeded.
+         */
+        bool finish()
+        {
+            {
+                std::unique_lock lock(mutex_);
+                changed_.wait(lock, [this] { return printed_ == submitted_; });
+                stopping_ = true;
+            }
+            changed_.notify_all();
+            for (auto& worker : workers_)
+            {
+                if (worker.joinable())
+                    worker.join();
+            }
+            return allOk_;
+        }
+
+        void submit(Command command)
+        {
+            std::unique_lock lock(mutex_);
+            changed_.wait(lock, [&]
+            {
+                if (queue_.size() + running_ >= workers_.size())
+                    return false;
+                for (const auto& active : active_)
+                {
+                    if (active.second.conflictsWith(command.target))
+                        return false;
+                }
+                return true;
+            });
+            const size_t slot = submitted_++;
+            active_.emplace_back(slot, command.target);
+            results_.emplace_back();
+            queue_.emplace_back(slot, std::move(command));
+            changed_.notify_all();
+        }
+
+    private:
+        void work()
+        {
+            std::unique_lock lock(mutex_);
+            while (true)
+            {
+                changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                auto [slot, command] = std::move(queue_.front());
+                queue_.pop_front();
+                ++running_;
+
+                lock.unlock();
+                runner_.run(command, [this, slot = slot](Result result) { complete(slot, std::move(result)); });
+                lock.lock();
+
+                --running_;
+                changed_.notify_all();
+            }
+        }
+
+        /**
+         * @brief Records the result of a command and prints every result now in order.
+         */
+        void complete(const size_t slot, Result result)
+        {
+            {
+                std::lock_guard lock(mutex_);
+                allOk_ = allOk_ && result.ok;
+                results_[slot - printed_] = std::move(result.json);
+                for (auto it = active_.begin(); it != active_.end(); ++it)
+                {
+                    if (it->first == slot)
+                    {
+                        active_.erase(it);
+                        break;
+                    }
+                }
+                while (!results_.empty() && results_.front())
+                {
+                    std::cout << *results_.front() << '\n';
+                    results_.pop_front();
+                    ++printed_;
+                }
+                std::cout.flush();
+                // Under the lock: once the last result is printed, finish() may destroy the pipeline
+                changed_.notify_all();
+            }
+        }
+
+        const Runner& runner_;
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::deque<std::pair<size_t, Command>> queue_;
+        std::vector<std::pair<size_t, Target>> active_; ///< Queued or running commands
+        std::deque<std::optional<std::string>> results_; ///< From the first unprinted command on
+        size_t submitted_ = 0;
+        size_t printed_ = 0;
+        size_t running_ = 0;
+        bool stopping_ = false;
+        bool allOk_ = true;
+        std::vector<std::thread> workers_;
+    };
+
+    std::vector<std::string> split(const std::string& line)
+    {
+        std::istringstream in(line);
+        std::vector<std::string> words;
+        for (std::string word; in >> word;)
+            words.push_back(word);
+        return words;
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    std::string scriptFile;
+    std::vector<std::string> commandWords;
+    size_t jobs = DEFAULT_JOBS;
+    std::optional<std::string> daemonSocket;
+    int simulated = 0;
+    bool verbose = false;
+    UUGear::Mega4::Mega4HubOptions options;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const auto value = [&]
+            {
+                if (i + 1 >= argc)
+                    throw std::invalid_argument("Missing value for " + arg);
+                return std::string(argv[++i]);
+            };
+
+            if (!commandWords.empty() || arg.empty() || arg[0] != '-')
+                commandWords.push_back(arg);
+            else if (arg == "--help" || arg == "-h")
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            else if (arg == "--file" || arg == "-f")
+                scriptFile = value();
+            else if (arg == "--jobs" || arg == "-j")
+                jobs = std::stoul(value());
+            else if (arg == "--daemon")
+                daemonSocket = (i + 1 < argc && argv[i + 1][0] == '/') ? value()
+                                                                       : UUGear::Mega4::Mega4Client::DEFAULT_SOCKET;
+            else if (arg == "--sysfs")
+                options.sysfsRoot = value();
+            else if (arg == "--confirm-timeout")
+                options.powerConfirmTimeout = std::chrono::milliseconds(std::stoul(value()));
+            else if (arg == "--simulate")
+                simulated = std::stoi(value());
+            else if (arg == "--verbose" || arg == "-v")
+                verbose = true;
+            else
+                throw std::invalid_argument("Unknown option " + arg);
+        }
+        if (!scriptFile.empty() && !commandWords.empty())
+            throw std::invalid_argument("Give either a command or --file, not both");
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << "\n";
+        usage(argv[0]);
+        return 2;
+    }
+
+    // stdout carries the JSON lines only
+    auto& logger = UUGear::Mega4::Logger::instance();
+    logger.setSink([](const UUGear::Mega4::LogRecord& record) { std::cerr << record.message << '\n'; });
+    logger.setLevel(verbose ? UUGear::Mega4::LogLevel::Info : UUGear::Mega4::LogLevel::Warning);
+
+    for (int i = 0; i < simulated; ++i)
+        options.simulatedHubs.push_back(std::make_shared<UUGear::Mega4::SimulatedMega4>("1-" + std::to_string(i + 1)));
+
+    try
+    {
+        // One context, one enumeration for the whole script
+        std::unique_ptr<UUGear::Mega4::Mega4Hub> hub;
+        std::vector<UUGear::Mega4::DeviceInfo> devices;
+        if (daemonSocket)
+        {
+            hub = std::make_unique<UUGear::Mega4::Mega4Client>(*daemonSocket);
+            devices = hub->knownDevices();
+        }
+        else
+        {
+            hub = std::make_unique<UUGear::Mega4::Mega4Hub>(options);
+            devices = hub->listDevices();
+        }
+
+        const Runner runner(*hub, devices);
+        Pipeline pipeline(runner, jobs);
+        {
+            const auto submit = [&](const size_t line, std::vector<std::string> words)
+            {
+                Command command;
+                command.line = line;
+                command.words = std::move(words);
+                runner.resolve(command);
+                pipeline.submit(std::move(command));
+            };
+
+            if (!commandWords.empty())
+            {
+                submit(1, commandWords);
+            }
+            else
+            {
+                std::ifstream file;
+                if (!scriptFile.empty() && scriptFile != "-")
+                {
+                    file.open(scriptFile);
+                    if (!file)
+                        throw std::runtime_error("Cannot open " + scriptFile);
+                }
+                std::istream& in = file.is_open() ? static_cast<std::istream&>(file) : std::cin;
+                size_t line = 0;
+                for (std::string text; std::getline(in, text);)
+                {
+                    ++line;
+                    auto words = split(text);
+                    if (words.empty() || words[0][0] == '#')
+                        continue;
+                    submit(line, std::move(words));
+                }
+            }
+        }
+        return pipeline.finish() ? 0 : 1;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,112 @@
+#include "UUGear/Mega4/Mega4Client.hpp"
+#include "UUGear/Mega4/Mega4Hub.hpp"
+#include "UUGear/Mega4/Mega4Server.hpp"
+#include "UUGear/Mega4/Mega4Types.hpp"
+#include "UUGear/Mega4/SharedStatePublisher.hpp"
+#include "UUGear/Mega4/SimulatedMega4.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace
+{
+    void usage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+            << "Owns the MEGA4 hubs and serves them to Mega4Client over a Unix domain socket.\n\n"
+            << "  --socket PATH           Socket to listen on (default " << UUGear::Mega4::Mega4Client::DEFAULT_SOCKET
+            << ")\n"
+            << "  --cache-ttl MS          How long port states are served from the cache (default 1000)\n"
+            << "  --confirm-timeout MS    Poll PORT_POWER after power requests, up to MS (default 0: fixed wait)\n"
+            << "  --sysfs ROOT            Use the USB sysfs tree at ROOT where possible\n"
+            << "  --workers N             Blocking requests served at the same time (default "
+            << UUGear::Mega4::Mega4Server::DEFAULT_WORKERS << ")\n"
+            << "  --simulate N            Serve N simulated hubs instead of real hardware\n"
+            << "  --shm NAME              Also publish port states to shared memory NAME for SharedStateReader\n";
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    std::string socketPath = UUGear::Mega4::Mega4Client::DEFAULT_SOCKET;
+    size_t workers = UUGear::Mega4::Mega4Server::DEFAULT_WORKERS;
+    int simulated = 0;
+    std::string sharedState;
+    UUGear::Mega4::Mega4HubOptions options;
+    options.stateCacheTtl = std::chrono::milliseconds(1000);
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+
+            const std::string value = argv[++i];
+            if (arg == "--socket")
+                socketPath = value;
+            else if (arg == "--cache-ttl")
+                options.stateCacheTtl = std::chrono::milliseconds(std::stoul(value));
+            else if (arg == "--confirm-timeout")
+                options.powerConfirmTimeout = std::chrono::milliseconds(std::stoul(value));
+            else if (arg == "--sysfs")
+                options.sysfsRoot = value;
+            else if (arg == "--workers")
+                workers = std::stoul(value);
+            else if (arg == "--simulate")
+                simulated = std::stoi(value);
+            else if (arg == "--shm")
+                sharedState = value;
+            else
+                throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << "\n";
+        usage(argv[0]);
+        return 2;
+    }
+
+    for (int i = 0; i < simulated; ++i)
+        options.simulatedHubs.push_back(std::make_shared<UUGear::Mega4::SimulatedMega4>("1-" + std::to_string(i + 1)));
+
+    // Blocked before any thread starts, so only sigwait() below receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try
+    {
+        const UUGear::Mega4::Mega4Hub hub(options);
+        const auto devices = hub.listDevices();
+        std::cout << "mega4d: " << devices.size() << " hub(s) found\n";
+
+        const UUGear::Mega4::Mega4Server server(hub, socketPath, workers);
+        std::cout << "mega4d: listening on " << server.socketPath() << std::endl;
+
+        std::unique_ptr<UUGear::Mega4::SharedStatePublisher> publisher;
+        if (!sharedState.empty())
+            publisher = std::make_unique<UUGear::Mega4::SharedStatePublisher>(hub, sharedState);
+
+        int received = 0;
+        sigwait(&signals, &received);
+        std::cout << "mega4d: shutting down\n";
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}